@@ -7,6 +7,8 @@
 #include "volume_grid.h"
 #include "memory.h"
 
+#include <mutex>
+
 namespace Rad {
 
 class AssetManager;
@@ -96,6 +98,13 @@ class RAD_EXPORT_API AssetManager {
   AssetManager& operator=(const AssetManager&) = delete;
 
   AssetLoadResult Load(ConfigNode cfg);
+  /**
+   * @brief 并行加载一批互不依赖的资产, 返回值与 cfgs 一一对应
+   * 解码在独立的 TBB 线程池上进行, 完成后按输入顺序加入管理器, 同名资产与逐个 Load 时一样保留先出现的那个
+   *
+   * @param threadCount 最多使用的线程数, 小于等于0时使用全部核心
+   */
+  std::vector<AssetLoadResult> LoadBatch(const std::vector<ConfigNode>& cfgs, Int32 threadCount = -1);
   void Unload(const std::string& name);
   /**
    * @brief 回收引用计数为1，也就是只有AssetManager引用的资产
@@ -145,9 +154,14 @@ class RAD_EXPORT_API AssetManager {
   const std::map<std::string, Share<Asset>>& GetAllAssets() const { return _assets; }
 
  private:
+  Unique<Asset> CreateAsset(const ConfigNode& cfg) const;
+  AssetLoadResult DecodeAsset(Asset& asset) const;
+  bool TryAddAsset(Unique<Asset> asset);
+
   const FactoryManager* _factory{nullptr};
   Unique<LocationResolver> _resolver;
   std::map<std::string, Share<Asset>> _assets;
+  mutable std::mutex _assetsMutex;
   Share<spdlog::logger> _logger;
   bool _isImageBlock{false};
 };
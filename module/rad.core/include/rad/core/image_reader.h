@@ -74,6 +74,19 @@ class RAD_EXPORT_API ImageReader {
    * @param img 图片数据
    */
   static void WriteExr(std::ostream& stream, const MatrixX<Color24f>& img);
+  /**
+   * @brief 写入带数据窗口的exr图片, img 只包含数据窗口内的像素
+   *
+   * @param stream 写入流
+   * @param img 数据窗口内的图片数据
+   * @param displaySize 完整图片的大小
+   * @param dataOffset 数据窗口左上角在完整图片中的位置
+   */
+  static void WriteExr(
+      std::ostream& stream,
+      const MatrixX<Color24f>& img,
+      const Eigen::Vector2i& displaySize,
+      const Eigen::Vector2i& dataOffset);
 };
 
 }  // namespace Rad
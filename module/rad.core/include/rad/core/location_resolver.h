@@ -19,9 +19,17 @@ class RAD_EXPORT_API LocationResolver {
   void SetSaveName(const std::string& name) { _saveName = name; }
 
   const std::filesystem::path& GetWorkDirectory() const { return _workDir; }
+  /**
+   * @brief 解析出资源在磁盘上的实际路径, 找不到时抛出异常
+   */
+  std::filesystem::path GetPath(const std::string& location) const;
   Unique<std::istream> GetStream(const std::string& location, std::ios::openmode extMode = 0) const;
   Unique<std::ostream> WriteStream(const std::string& location, std::ios::openmode extMode = 0) const;
   std::string GetSaveName(const std::string& ext) const;
+  /**
+   * @brief 附带后缀的保存名, 用来保存主结果以外的其他输出, 比如 name_suffix.ext
+   */
+  std::string GetSaveName(const std::string& suffix, const std::string& ext) const;
 
  private:
   std::filesystem::path _workDir;
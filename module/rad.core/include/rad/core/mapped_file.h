@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+#include <filesystem>
+
+namespace Rad {
+
+/**
+ * @brief 映射内存的访问方式, 告诉系统如何预读和回收页面
+ */
+enum class MappedFileAccess {
+  Normal,      //没有特别的访问规律, 使用系统默认的预读
+  Sequential,  //从头到尾只读一遍, 系统可以积极预读, 读过的页面可以尽早回收
+  WillNeed     //整个文件很快就会被随机访问并一直使用, 提前把所有页面读进来
+};
+
+/**
+ * @brief 只读的内存映射文件, 文件内容直接映射到进程地址空间, 不需要经过流的缓冲区复制
+ */
+class RAD_EXPORT_API MappedFile {
+ public:
+  MappedFile(const std::filesystem::path& file, MappedFileAccess access = MappedFileAccess::Normal);
+  ~MappedFile() noexcept;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* Data() const { return _data; }
+  size_t Size() const { return _size; }
+
+ private:
+  const char* _data{nullptr};
+  size_t _size{0};
+#if defined(_MSC_VER)
+  void* _file{nullptr};
+  void* _mapping{nullptr};
+#endif
+};
+
+}  // namespace Rad
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "types.h"
+#include "triangle_model.h"
+
+#include <filesystem>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+namespace Rad {
+
+struct ModelBinReadResult {
+  /**
+   * @brief item1是名字，item2是数据. 第一项是完整模型, 名字为空, 之后是各个子模型
+   */
+  using Entry = std::pair<std::string, Share<TriangleModel>>;
+  /**
+   * @brief 字面意思，是否读取成功
+   */
+  bool IsSuccess;
+  std::vector<Entry> Data;
+  /**
+   * @brief 如果读取失败，会储存失败原因
+   */
+  std::string FailReason;
+};
+
+/**
+ * @brief 二进制网格格式, 文件里的数组和 TriangleModel 的数组一一对应, 读取时直接映射文件而不用解析
+ * 文件结构: 文件头, 模型表, 名字, 各个数组. 数组按16字节对齐, 位置数组末尾多存一个元素, 与 TriangleModel::AllocPosition 一致
+ * 只支持小端序的机器
+ */
+class RAD_EXPORT_API ModelBin {
+ public:
+  /**
+   * @brief 写入模型, 第一项应该是完整模型, 之后是子模型
+   *
+   * @param stream 二进制写入流
+   * @param models 名字和模型
+   */
+  static void Write(std::ostream& stream, const std::vector<std::pair<std::string, const TriangleModel*>>& models);
+  /**
+   * @brief 把文件映射到内存, 返回的模型直接引用映射的内存, 所有模型都释放后才会取消映射
+   *
+   * @param file 文件路径
+   */
+  static ModelBinReadResult Read(const std::filesystem::path& file);
+};
+
+}  // namespace Rad
@@ -17,6 +17,17 @@ class RAD_EXPORT_API TriangleModel {
       const Eigen::Vector3f* normal = nullptr,
       const Eigen::Vector2f* uv = nullptr,
       const Eigen::Vector3f* tangent = nullptr);
+  /**
+   * @brief 直接引用已有的数组, 不复制数据. 位置数组末尾要像 AllocPosition 一样多留一个元素
+   */
+  TriangleModel(
+      Share<Eigen::Vector3f[]> pos,
+      UInt32 vertexCount,
+      Share<UInt32[]> indices,
+      UInt32 indexCount,
+      Share<Eigen::Vector3f[]> normal = nullptr,
+      Share<Eigen::Vector2f[]> uv = nullptr,
+      Share<Eigen::Vector3f[]> tangent = nullptr);
 
   Share<Eigen::Vector3f[]> GetPosition() const { return _position; }
   Share<Eigen::Vector3f[]> GetNormal() const { return _normal; }
@@ -29,10 +40,35 @@ class RAD_EXPORT_API TriangleModel {
   bool HasNormal() const { return _normal != nullptr; }
   bool HasUV() const { return _uv != nullptr; }
   bool HasTangent() const { return _tangent != nullptr; }
+  /**
+   * @brief 是否已经合并过重复顶点并按局部性重排, 读取预处理过的二进制网格时也会设置
+   */
+  bool IsPreprocessed() const { return _isPreprocessed; }
+  void SetPreprocessed(bool isPreprocessed) { _isPreprocessed = isPreprocessed; }
 
   void AllocNormal();
   void AllocUV();
 
+  /**
+   * @brief 合并所有属性都完全相同的顶点, 属性按位比较, 返回合并后的模型
+   */
+  TriangleModel WeldVertices() const;
+  /**
+   * @brief 按三角形重心的 Morton 码排序三角形, 再按三角形第一次引用顶点的顺序重排顶点
+   * 空间上相邻的三角形与顶点在内存里也相邻, 构建加速结构和读取顶点属性时局部性更好
+   */
+  TriangleModel ReorderForLocality() const;
+  /**
+   * @brief 按索引顺序模拟容量为 cacheSize 的 FIFO 顶点缓存, 返回平均每个三角形未命中的次数 (ACMR)
+   */
+  Float32 AverageCacheMissRatio(UInt32 cacheSize = 32) const;
+
+  /**
+   * @brief 分配顶点位置数组, 末尾多留一个元素的空间
+   * embree 直接共享这块内存作为顶点缓冲区, 它要求最后一个顶点也能用16字节的SSE指令读取
+   */
+  static Share<Eigen::Vector3f[]> AllocPosition(UInt32 vertexCount);
+
   static TriangleModel CreateSphere(Float32 radius, Int32 numberSlices);
   static TriangleModel CreateCube(Float32 halfExtend);
   static TriangleModel CreateQuad(Float32 halfExtend);
@@ -54,6 +90,7 @@ class RAD_EXPORT_API TriangleModel {
   UInt32 _vertexCount;
   UInt32 _indexCount;
   UInt32 _triangleCount;
+  bool _isPreprocessed{false};
 };
 
 }  // namespace Rad
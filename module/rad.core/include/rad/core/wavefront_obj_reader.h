@@ -29,6 +29,9 @@ struct WavefrontObjObject {
 class RAD_EXPORT_API WavefrontObjReader {
  public:
   WavefrontObjReader(Unique<std::istream> stream);
+  /**
+   * @brief 从文件读取时会把文件映射到内存, 按行切成若干块并行解析
+   */
   WavefrontObjReader(const std::filesystem::path& file);
   WavefrontObjReader(const std::string& text);
 
@@ -50,9 +53,11 @@ class RAD_EXPORT_API WavefrontObjReader {
 
  private:
   void Parse(const std::string& line, int lineNum);
+  void ReadBuffer(const char* data, size_t size);
   TriangleModel ToModel(const std::vector<WavefrontObjFace>& faces) const;
 
   Unique<std::istream> _stream;
+  std::filesystem::path _file;
   std::string _error;
 
   std::vector<Eigen::Vector3f> _pos;
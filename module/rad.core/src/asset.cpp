@@ -3,6 +3,9 @@
 #include <rad/core/stop_watch.h>
 #include <rad/core/logger.h>
 
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+
 namespace Rad {
 
 Asset::Asset(const AssetManager* ctx, const ConfigNode& cfg, AssetType type) : _type(type) {
@@ -17,27 +20,73 @@ AssetManager::AssetManager() {
 AssetLoadResult AssetManager::Load(ConfigNode cfg) {
   Stopwatch sw;
   sw.Start();
-  std::string type = cfg.Read<std::string>("type");
-  AssetFactory* factory = _factory->GetFactory<AssetFactory>(type);
-  Unique<Asset> instance = factory->Create(this, cfg);
+  Unique<Asset> instance = CreateAsset(cfg);
   if (IsLoaded(instance->GetName())) {
     return AssetLoadResult{false, "asset is loaded"};
   }
-  AssetLoadResult result = instance->Load(*_resolver);
+  AssetLoadResult result = DecodeAsset(*instance);
   std::string name = instance->GetName();
-  if (result.IsSuccess) {
-    if (instance->GetType() == AssetType::Image && _isImageBlock) {
-      ImageAsset* imageAsset = static_cast<ImageAsset*>(instance.get());
-      imageAsset->GenerateBlockBasedImage();
-    }
-    _assets.emplace(name, std::move(instance));
+  if (result.IsSuccess && !TryAddAsset(std::move(instance))) {
+    result = AssetLoadResult{false, "asset is loaded"};
   }
   sw.Stop();
   _logger->info("load asset {} ({} ms)", name, sw.ElapsedMilliseconds());
   return result;
 }
 
+std::vector<AssetLoadResult> AssetManager::LoadBatch(const std::vector<ConfigNode>& cfgs, Int32 threadCount) {
+  std::vector<AssetLoadResult> results(cfgs.size());
+  std::vector<Unique<Asset>> instances(cfgs.size());
+  tbb::task_arena arena(threadCount <= 0 ? tbb::task_arena::automatic : threadCount);
+  arena.execute([&]() {
+    //每个资产一个任务, 图片和模型的大小差别很大, 让 TBB 自己去平衡负载
+    tbb::parallel_for(size_t(0), cfgs.size(), size_t(1), [&](size_t i) {
+      Stopwatch sw;
+      sw.Start();
+      Unique<Asset> instance = CreateAsset(cfgs[i]);
+      if (IsLoaded(instance->GetName())) {
+        results[i] = AssetLoadResult{false, "asset is loaded"};
+        return;
+      }
+      results[i] = DecodeAsset(*instance);
+      sw.Stop();
+      _logger->info("load asset {} ({} ms)", instance->GetName(), sw.ElapsedMilliseconds());
+      if (results[i].IsSuccess) {
+        instances[i] = std::move(instance);
+      }
+    });
+  });
+  for (size_t i = 0; i < instances.size(); i++) {
+    if (instances[i] != nullptr && !TryAddAsset(std::move(instances[i]))) {
+      results[i] = AssetLoadResult{false, "asset is loaded"};
+    }
+  }
+  return results;
+}
+
+Unique<Asset> AssetManager::CreateAsset(const ConfigNode& cfg) const {
+  std::string type = cfg.Read<std::string>("type");
+  AssetFactory* factory = _factory->GetFactory<AssetFactory>(type);
+  return factory->Create(this, cfg);
+}
+
+AssetLoadResult AssetManager::DecodeAsset(Asset& asset) const {
+  AssetLoadResult result = asset.Load(*_resolver);
+  if (result.IsSuccess && asset.GetType() == AssetType::Image && _isImageBlock) {
+    ImageAsset& imageAsset = static_cast<ImageAsset&>(asset);
+    imageAsset.GenerateBlockBasedImage();
+  }
+  return result;
+}
+
+bool AssetManager::TryAddAsset(Unique<Asset> asset) {
+  std::lock_guard<std::mutex> lock(_assetsMutex);
+  std::string name = asset->GetName();
+  return _assets.emplace(name, std::move(asset)).second;
+}
+
 void AssetManager::Unload(const std::string& name) {
+  std::lock_guard<std::mutex> lock(_assetsMutex);
   auto iter = _assets.find(name);
   if (iter == _assets.end()) {
     throw RadArgumentException("unknown asset {}", name);
@@ -51,9 +100,12 @@ void AssetManager::Unload(const std::string& name) {
 
 void AssetManager::GarbageCollect() {
   std::vector<std::string> canUnload;
-  for (auto&& i : _assets) {
-    if (i.second.use_count() == 1) {
-      canUnload.emplace_back(i.first);
+  {
+    std::lock_guard<std::mutex> lock(_assetsMutex);
+    for (auto&& i : _assets) {
+      if (i.second.use_count() == 1) {
+        canUnload.emplace_back(i.first);
+      }
     }
   }
   for (auto&& i : canUnload) {
@@ -68,15 +120,18 @@ void AssetManager::SetWorkDirectory(const std::filesystem::path& path) {
 }
 
 bool AssetManager::IsLoaded(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(_assetsMutex);
   return _assets.find(name) != _assets.end();
 }
 
 Share<Asset> AssetManager::Reference(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(_assetsMutex);
   Share<Asset> refA = _assets.at(name);
   return refA;
 }
 
 const Asset* AssetManager::Borrow(const std::string& name) const {
+  std::lock_guard<std::mutex> lock(_assetsMutex);
   return _assets.at(name).get();
 }
 
@@ -84,6 +139,7 @@ Unique<AssetFactory> _FactoryCreateImageStbFunc_();
 Unique<AssetFactory> _FactoryCreateImageExrFunc_();
 Unique<AssetFactory> _FactoryCreateImageHdrFunc_();
 Unique<AssetFactory> _FactoryCreateModelObjFunc_();
+Unique<AssetFactory> _FactoryCreateModelBinFunc_();
 Unique<AssetFactory> _FactoryCreateVolumeVdbFunc_();
 Unique<AssetFactory> _FactoryCreateVolumeMitsubaVolFunc_();
 
@@ -93,6 +149,7 @@ std::vector<std::function<Unique<Factory>(void)>> GetRadCoreAssetFactories() {
       _FactoryCreateImageExrFunc_,
       _FactoryCreateImageHdrFunc_,
       _FactoryCreateModelObjFunc_,
+      _FactoryCreateModelBinFunc_,
       _FactoryCreateVolumeVdbFunc_,
       _FactoryCreateVolumeMitsubaVolFunc_,
   };
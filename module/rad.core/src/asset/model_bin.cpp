@@ -0,0 +1,72 @@
+#include <rad/core/asset.h>
+
+#include <rad/core/model_bin.h>
+
+namespace Rad {
+
+/**
+ * @brief 读取二进制网格, 模型数组直接引用映射的文件
+ */
+class ModelBinAsset final : public ModelAsset {
+ public:
+  ModelBinAsset(const AssetManager* ctx, const ConfigNode& cfg) : ModelAsset(ctx, cfg) {}
+  ~ModelBinAsset() noexcept override = default;
+
+  Share<TriangleModel> FullModel() const override { return _full; }
+
+  Share<TriangleModel> GetSubModel(const std::string& name) const override {
+    for (const auto& sub : _sub) {
+      if (sub.first == name) {
+        return sub.second;
+      }
+    }
+    return nullptr;
+  }
+
+  bool HasSubModel(const std::string& name) const override {
+    return GetSubModel(name) != nullptr;
+  }
+
+  AssetLoadResult Load(const LocationResolver& resolver) override {
+    AssetLoadResult result;
+    try {
+      ModelBinReadResult read = ModelBin::Read(resolver.GetPath(_location));
+      if (!read.IsSuccess) {
+        result.IsSuccess = false;
+        result.FailReason = std::move(read.FailReason);
+      } else if (read.Data.empty()) {
+        result.IsSuccess = false;
+        result.FailReason = "model bin is empty";
+      } else {
+        _full = std::move(read.Data[0].second);
+        _sub.assign(
+            std::make_move_iterator(read.Data.begin() + 1),
+            std::make_move_iterator(read.Data.end()));
+        result.IsSuccess = true;
+      }
+    } catch (std::exception& e) {
+      result.IsSuccess = false;
+      result.FailReason = e.what();
+    }
+    return result;
+  }
+
+ private:
+  Share<TriangleModel> _full;
+  std::vector<ModelBinReadResult::Entry> _sub;
+};
+
+class ModelBinFactory final : public AssetFactory {
+ public:
+  ModelBinFactory() : AssetFactory("model_bin") {}
+  ~ModelBinFactory() noexcept override = default;
+  Unique<Asset> Create(const AssetManager* ctx, const ConfigNode& cfg) const override {
+    return std::make_unique<ModelBinAsset>(ctx, cfg);
+  }
+};
+
+Unique<AssetFactory> _FactoryCreateModelBinFunc_() {
+  return std::make_unique<ModelBinFactory>();
+}
+
+}  // namespace Rad
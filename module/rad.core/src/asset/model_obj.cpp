@@ -33,8 +33,7 @@ class ModelObj final : public ModelAsset {
   }
 
   AssetLoadResult Load(const LocationResolver& resolver) override {
-    auto stream = resolver.GetStream(_location, 0);
-    WavefrontObjReader reader(std::move(stream));
+    WavefrontObjReader reader(resolver.GetPath(_location));
     reader.Read();
     AssetLoadResult result;
     try {
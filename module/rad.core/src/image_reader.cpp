@@ -227,8 +227,7 @@ class ExrOStream final : public Imf::OStream {
   std::ostream* _os;
 };
 
-void ImageReader::WriteExr(std::ostream& stream, const MatrixX<Color24f>& img) {
-  Imf::Header header((int)img.rows(), (int)img.cols());
+static void WriteExrImpl(std::ostream& stream, const MatrixX<Color24f>& img, Imf::Header& header, const Eigen::Vector2i& dataOffset) {
   header.insert("comments", Imf::StringAttribute("rad.offline"));
   Imf::ChannelList& channels = header.channels();
   channels.insert("R", Imf::Channel(Imf::FLOAT));
@@ -238,7 +237,8 @@ void ImageReader::WriteExr(std::ostream& stream, const MatrixX<Color24f>& img) {
   size_t compStride = sizeof(Color24f::Scalar);
   size_t pixelStride = sizeof(Color24f);
   size_t rowStride = pixelStride * img.rows();
-  char* data = (char*)img.data();
+  //openexr 用数据窗口内的绝对坐标寻址, 所以基址要减去窗口的偏移
+  char* data = (char*)img.data() - dataOffset.x() * pixelStride - dataOffset.y() * rowStride;
   frameBuffer.insert(
       "R",
       Imf::Slice(Imf::FLOAT, data, pixelStride, rowStride));
@@ -254,4 +254,24 @@ void ImageReader::WriteExr(std::ostream& stream, const MatrixX<Color24f>& img) {
   output.writePixels((int)img.cols());
 }
 
+void ImageReader::WriteExr(std::ostream& stream, const MatrixX<Color24f>& img) {
+  Imf::Header header((int)img.rows(), (int)img.cols());
+  WriteExrImpl(stream, img, header, Eigen::Vector2i::Zero());
+}
+
+void ImageReader::WriteExr(
+    std::ostream& stream,
+    const MatrixX<Color24f>& img,
+    const Eigen::Vector2i& displaySize,
+    const Eigen::Vector2i& dataOffset) {
+  Imath::Box2i displayWindow(
+      Imath::V2i(0, 0),
+      Imath::V2i(displaySize.x() - 1, displaySize.y() - 1));
+  Imath::Box2i dataWindow(
+      Imath::V2i(dataOffset.x(), dataOffset.y()),
+      Imath::V2i(dataOffset.x() + (int)img.rows() - 1, dataOffset.y() + (int)img.cols() - 1));
+  Imf::Header header(displayWindow, dataWindow);
+  WriteExrImpl(stream, img, header, dataOffset);
+}
+
 }  // namespace Rad
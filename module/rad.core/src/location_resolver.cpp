@@ -8,19 +8,23 @@ LocationResolver::LocationResolver(
     const std::filesystem::path& workDir)
     : _workDir(workDir) {}
 
-Unique<std::istream> LocationResolver::GetStream(const std::string& location, std::ios::openmode extMode) const {
-  auto mode = std::ios::in | extMode;
+std::filesystem::path LocationResolver::GetPath(const std::string& location) const {
   std::filesystem::path p(location);
   if (std::filesystem::exists(p)) {
-    return std::make_unique<std::ifstream>(p, mode);
+    return p;
   }
   auto search = _workDir / p;
   if (std::filesystem::exists(search)) {
-    return std::make_unique<std::ifstream>(search, mode);
+    return search;
   }
   throw RadFileNotFoundException("cannot find location: {}", location);
 }
 
+Unique<std::istream> LocationResolver::GetStream(const std::string& location, std::ios::openmode extMode) const {
+  auto mode = std::ios::in | extMode;
+  return std::make_unique<std::ifstream>(GetPath(location), mode);
+}
+
 Unique<std::ostream> LocationResolver::WriteStream(const std::string& location, std::ios::openmode extMode) const {
   auto mode = std::ios::out | extMode;
   std::filesystem::path p(location);
@@ -32,4 +36,8 @@ std::string LocationResolver::GetSaveName(const std::string& ext) const {
   return fmt::format("{}.{}", _saveName, ext);
 }
 
+std::string LocationResolver::GetSaveName(const std::string& suffix, const std::string& ext) const {
+  return fmt::format("{}_{}.{}", _saveName, suffix, ext);
+}
+
 }  // namespace Rad
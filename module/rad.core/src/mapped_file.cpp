@@ -0,0 +1,98 @@
+#include <rad/core/mapped_file.h>
+
+#if defined(_MSC_VER)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Rad {
+
+#if defined(_MSC_VER)
+MappedFile::MappedFile(const std::filesystem::path& file, MappedFileAccess access) {
+  //Windows 没有对应 WillNeed 的打开标志, 按默认方式处理
+  DWORD flags = access == MappedFileAccess::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+  HANDLE h = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+  if (h == INVALID_HANDLE_VALUE) {
+    throw RadFileNotFoundException("cannot open file: {}", file.string());
+  }
+  _file = h;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(h, &size)) {
+    CloseHandle(h);
+    throw RadInvalidOperationException("cannot get file size: {}", file.string());
+  }
+  _size = static_cast<size_t>(size.QuadPart);
+  if (_size == 0) {  //空文件不能创建映射
+    return;
+  }
+  HANDLE mapping = CreateFileMappingW(h, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr) {
+    CloseHandle(h);
+    throw RadInvalidOperationException("cannot map file: {}", file.string());
+  }
+  _mapping = mapping;
+  _data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  if (_data == nullptr) {
+    CloseHandle(mapping);
+    CloseHandle(h);
+    throw RadInvalidOperationException("cannot map file: {}", file.string());
+  }
+}
+
+MappedFile::~MappedFile() noexcept {
+  if (_data != nullptr) {
+    UnmapViewOfFile(_data);
+  }
+  if (_mapping != nullptr) {
+    CloseHandle(_mapping);
+  }
+  if (_file != nullptr) {
+    CloseHandle(_file);
+  }
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& file, MappedFileAccess access) {
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw RadFileNotFoundException("cannot open file: {}", file.string());
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    throw RadInvalidOperationException("cannot get file size: {}", file.string());
+  }
+  _size = static_cast<size_t>(st.st_size);
+  if (_size > 0) {  //空文件不能映射
+    void* ptr = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (ptr == MAP_FAILED) {
+      close(fd);
+      throw RadInvalidOperationException("cannot map file: {}", file.string());
+    }
+    switch (access) {
+      case MappedFileAccess::Sequential:
+        madvise(ptr, _size, MADV_SEQUENTIAL);
+        break;
+      case MappedFileAccess::WillNeed:
+        madvise(ptr, _size, MADV_WILLNEED);
+        break;
+      default:
+        break;
+    }
+    _data = static_cast<const char*>(ptr);
+  }
+  //映射建立后就不再需要文件描述符
+  close(fd);
+}
+
+MappedFile::~MappedFile() noexcept {
+  if (_data != nullptr) {
+    munmap(const_cast<char*>(_data), _size);
+  }
+}
+#endif
+
+}  // namespace Rad
@@ -0,0 +1,207 @@
+#include <rad/core/model_bin.h>
+
+#include <rad/core/mapped_file.h>
+
+#include <cstring>
+
+namespace Rad {
+
+constexpr char ModelBinMagic[8] = {'R', 'A', 'D', 'M', 'E', 'S', 'H', '\0'};
+constexpr UInt32 ModelBinVersion = 1;
+constexpr UInt64 ModelBinAlignment = 16;
+
+enum ModelBinFlag : UInt32 {
+  ModelBinHasNormal = 1 << 0,
+  ModelBinHasUV = 1 << 1,
+  ModelBinHasTangent = 1 << 2,
+  ModelBinPreprocessed = 1 << 3  //已经合并顶点并按局部性重排, 读取后不需要再处理
+};
+
+struct ModelBinHeader {
+  char Magic[8];
+  UInt32 Version;
+  UInt32 ModelCount;
+};
+
+/**
+ * @brief 模型表中的一项, 所有偏移量都从文件开头算起, 为0表示没有这个数组
+ */
+struct ModelBinEntry {
+  UInt64 NameOffset;
+  UInt32 NameLength;
+  UInt32 Flags;
+  UInt32 VertexCount;
+  UInt32 IndexCount;
+  UInt64 Position;
+  UInt64 Normal;
+  UInt64 UV;
+  UInt64 Tangent;
+  UInt64 Index;
+};
+
+static_assert(sizeof(ModelBinHeader) == 16, "model bin header must be tightly packed");
+static_assert(sizeof(ModelBinEntry) == 64, "model bin entry must be tightly packed");
+static_assert(sizeof(Eigen::Vector3f) == 12 && sizeof(Eigen::Vector2f) == 8, "vector must be tightly packed");
+
+static UInt64 AlignOffset(UInt64 offset) {
+  return (offset + ModelBinAlignment - 1) & ~(ModelBinAlignment - 1);
+}
+
+void ModelBin::Write(std::ostream& stream, const std::vector<std::pair<std::string, const TriangleModel*>>& models) {
+  //先算出每个数组的位置, 再按顺序写入, 写入时只需要补齐对齐用的0
+  std::vector<ModelBinEntry> entries(models.size());
+  UInt64 offset = sizeof(ModelBinHeader) + sizeof(ModelBinEntry) * models.size();
+  for (size_t i = 0; i < models.size(); i++) {
+    ModelBinEntry& e = entries[i];
+    e.NameOffset = offset;
+    e.NameLength = static_cast<UInt32>(models[i].first.size());
+    offset += e.NameLength;
+  }
+  for (size_t i = 0; i < models.size(); i++) {
+    const TriangleModel& m = *models[i].second;
+    ModelBinEntry& e = entries[i];
+    e.Flags = (m.HasNormal() ? ModelBinHasNormal : 0) |
+              (m.HasUV() ? ModelBinHasUV : 0) |
+              (m.HasTangent() ? ModelBinHasTangent : 0) |
+              (m.IsPreprocessed() ? ModelBinPreprocessed : 0);
+    e.VertexCount = m.VertexCount();
+    e.IndexCount = m.IndexCount();
+    offset = AlignOffset(offset);
+    e.Position = offset;
+    offset += sizeof(Eigen::Vector3f) * (UInt64(m.VertexCount()) + 1);
+    offset = AlignOffset(offset);
+    e.Index = offset;
+    offset += sizeof(UInt32) * UInt64(m.IndexCount());
+    e.Normal = 0;
+    if (m.HasNormal()) {
+      offset = AlignOffset(offset);
+      e.Normal = offset;
+      offset += sizeof(Eigen::Vector3f) * UInt64(m.VertexCount());
+    }
+    e.UV = 0;
+    if (m.HasUV()) {
+      offset = AlignOffset(offset);
+      e.UV = offset;
+      offset += sizeof(Eigen::Vector2f) * UInt64(m.VertexCount());
+    }
+    e.Tangent = 0;
+    if (m.HasTangent()) {
+      offset = AlignOffset(offset);
+      e.Tangent = offset;
+      offset += sizeof(Eigen::Vector3f) * UInt64(m.VertexCount());
+    }
+  }
+  UInt64 written = 0;
+  auto writeBytes = [&](const void* data, UInt64 size) {
+    stream.write(static_cast<const char*>(data), size);
+    written += size;
+  };
+  auto padTo = [&](UInt64 target) {
+    constexpr char zero[ModelBinAlignment]{};
+    writeBytes(zero, target - written);
+  };
+  ModelBinHeader header{};
+  std::memcpy(header.Magic, ModelBinMagic, sizeof(ModelBinMagic));
+  header.Version = ModelBinVersion;
+  header.ModelCount = static_cast<UInt32>(models.size());
+  writeBytes(&header, sizeof(header));
+  writeBytes(entries.data(), sizeof(ModelBinEntry) * entries.size());
+  for (const auto& [name, model] : models) {
+    writeBytes(name.data(), name.size());
+  }
+  for (size_t i = 0; i < models.size(); i++) {
+    const TriangleModel& m = *models[i].second;
+    const ModelBinEntry& e = entries[i];
+    padTo(e.Position);
+    writeBytes(m.GetPosition().get(), sizeof(Eigen::Vector3f) * UInt64(m.VertexCount()));
+    Eigen::Vector3f tail = Eigen::Vector3f::Zero();
+    writeBytes(&tail, sizeof(tail));
+    padTo(e.Index);
+    writeBytes(m.GetIndices().get(), sizeof(UInt32) * UInt64(m.IndexCount()));
+    if (e.Normal != 0) {
+      padTo(e.Normal);
+      writeBytes(m.GetNormal().get(), sizeof(Eigen::Vector3f) * UInt64(m.VertexCount()));
+    }
+    if (e.UV != 0) {
+      padTo(e.UV);
+      writeBytes(m.GetUV().get(), sizeof(Eigen::Vector2f) * UInt64(m.VertexCount()));
+    }
+    if (e.Tangent != 0) {
+      padTo(e.Tangent);
+      writeBytes(m.GetTangent().get(), sizeof(Eigen::Vector3f) * UInt64(m.VertexCount()));
+    }
+  }
+  if (!stream.good()) {
+    throw RadInvalidOperationException("cannot write model bin");
+  }
+}
+
+/**
+ * @brief 用别名构造的 shared_ptr 指向映射内存, 每个数组都持有映射文件
+ */
+template <typename T>
+static Share<T[]> AliasMapped(const Share<MappedFile>& mapped, UInt64 offset) {
+  return Share<T[]>(mapped, reinterpret_cast<T*>(const_cast<char*>(mapped->Data() + offset)));
+}
+
+ModelBinReadResult ModelBin::Read(const std::filesystem::path& file) {
+  ModelBinReadResult result{};
+  //数组在整个渲染期间都会被随机访问, 不能按顺序读取的方式提示系统
+  Share<MappedFile> mapped = std::make_shared<MappedFile>(file, MappedFileAccess::WillNeed);
+  const char* data = mapped->Data();
+  UInt64 size = mapped->Size();
+  auto fail = [&](const std::string& reason) {
+    result.IsSuccess = false;
+    result.FailReason = reason;
+    result.Data.clear();
+    return result;
+  };
+  if (size < sizeof(ModelBinHeader)) {
+    return fail("file too small");
+  }
+  ModelBinHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (std::memcmp(header.Magic, ModelBinMagic, sizeof(ModelBinMagic)) != 0) {
+    return fail("not a model bin file");
+  }
+  if (header.Version != ModelBinVersion) {
+    return fail(fmt::format("unsupported model bin version {}", header.Version));
+  }
+  if (size < sizeof(ModelBinHeader) + sizeof(ModelBinEntry) * UInt64(header.ModelCount)) {
+    return fail("broken model table");
+  }
+  //只检查数组是否完整地在文件里, 不检查索引是否越界, 那样需要把整个文件读一遍
+  auto inFile = [&](UInt64 offset, UInt64 bytes) {
+    return offset % alignof(float) == 0 && offset <= size && bytes <= size - offset;
+  };
+  const char* table = data + sizeof(ModelBinHeader);
+  for (UInt32 i = 0; i < header.ModelCount; i++) {
+    ModelBinEntry e;
+    std::memcpy(&e, table + sizeof(ModelBinEntry) * i, sizeof(e));
+    UInt64 vertexCount = e.VertexCount;
+    if (e.NameOffset > size || e.NameLength > size - e.NameOffset) {
+      return fail(fmt::format("broken model name at {}", i));
+    }
+    if (e.IndexCount % 3 != 0 ||
+        !inFile(e.Position, sizeof(Eigen::Vector3f) * (vertexCount + 1)) ||
+        !inFile(e.Index, sizeof(UInt32) * UInt64(e.IndexCount)) ||
+        ((e.Flags & ModelBinHasNormal) && !inFile(e.Normal, sizeof(Eigen::Vector3f) * vertexCount)) ||
+        ((e.Flags & ModelBinHasUV) && !inFile(e.UV, sizeof(Eigen::Vector2f) * vertexCount)) ||
+        ((e.Flags & ModelBinHasTangent) && !inFile(e.Tangent, sizeof(Eigen::Vector3f) * vertexCount))) {
+      return fail(fmt::format("broken model arrays at {}", i));
+    }
+    Share<Eigen::Vector3f[]> position = AliasMapped<Eigen::Vector3f>(mapped, e.Position);
+    Share<UInt32[]> index = AliasMapped<UInt32>(mapped, e.Index);
+    Share<Eigen::Vector3f[]> normal = (e.Flags & ModelBinHasNormal) ? AliasMapped<Eigen::Vector3f>(mapped, e.Normal) : nullptr;
+    Share<Eigen::Vector2f[]> uv = (e.Flags & ModelBinHasUV) ? AliasMapped<Eigen::Vector2f>(mapped, e.UV) : nullptr;
+    Share<Eigen::Vector3f[]> tangent = (e.Flags & ModelBinHasTangent) ? AliasMapped<Eigen::Vector3f>(mapped, e.Tangent) : nullptr;
+    std::string name(data + e.NameOffset, e.NameLength);
+    auto model = std::make_shared<TriangleModel>(position, e.VertexCount, index, e.IndexCount, normal, uv, tangent);
+    model->SetPreprocessed((e.Flags & ModelBinPreprocessed) != 0);
+    result.Data.emplace_back(std::move(name), std::move(model));
+  }
+  result.IsSuccess = true;
+  return result;
+}
+
+}  // namespace Rad
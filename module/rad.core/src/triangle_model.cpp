@@ -2,6 +2,14 @@
 
 #include <rad/core/math_base.h>
 
+#include <cstring>
+#include <numeric>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/parallel_sort.h>
+
 using namespace Rad::Math;
 
 namespace Rad {
@@ -20,7 +28,7 @@ TriangleModel::TriangleModel(
   _vertexCount = vertexCount;
   _indexCount = indexCount;
   _triangleCount = indexCount / 3;
-  _position = Share<Eigen::Vector3f[]>(new Eigen::Vector3f[vertexCount]);
+  _position = AllocPosition(vertexCount);
   std::copy(pos, pos + vertexCount, _position.get());
   _indices = Share<UInt32[]>(new UInt32[indexCount]);
   std::copy(indices, indices + indexCount, _indices.get());
@@ -38,6 +46,34 @@ TriangleModel::TriangleModel(
   }
 }
 
+TriangleModel::TriangleModel(
+    Share<Eigen::Vector3f[]> pos,
+    UInt32 vertexCount,
+    Share<UInt32[]> indices,
+    UInt32 indexCount,
+    Share<Eigen::Vector3f[]> normal,
+    Share<Eigen::Vector2f[]> uv,
+    Share<Eigen::Vector3f[]> tangent) {
+  if (indexCount % 3 != 0) {
+    throw RadException("Invalid index number {}, must be an integer multiple of 3", indexCount);
+  }
+  _vertexCount = vertexCount;
+  _indexCount = indexCount;
+  _triangleCount = indexCount / 3;
+  _position = std::move(pos);
+  _indices = std::move(indices);
+  _normal = std::move(normal);
+  _uv = std::move(uv);
+  _tangent = std::move(tangent);
+}
+
+Share<Eigen::Vector3f[]> TriangleModel::AllocPosition(UInt32 vertexCount) {
+  static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float), "position must be tightly packed");
+  Share<Eigen::Vector3f[]> result(new Eigen::Vector3f[size_t(vertexCount) + 1]);
+  result[vertexCount] = Eigen::Vector3f::Zero();
+  return result;
+}
+
 void TriangleModel::AllocNormal() {
   if (_normal == nullptr) {
     _normal = Share<Eigen::Vector3f[]>(new Eigen::Vector3f[VertexCount()]);
@@ -50,6 +86,210 @@ void TriangleModel::AllocUV() {
   }
 }
 
+static UInt64 HashBytes(const void* data, size_t size, UInt64 hash) {
+  //FNV-1a
+  const UInt8* bytes = static_cast<const UInt8*>(data);
+  for (size_t i = 0; i < size; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+/**
+ * @brief 把 21 位整数的每一位之间插入两个 0, 用于拼接三维 Morton 码
+ */
+static UInt64 ExpandBits21(UInt64 v) {
+  v &= 0x1fffff;
+  v = (v | v << 32) & 0x1f00000000ffffull;
+  v = (v | v << 16) & 0x1f0000ff0000ffull;
+  v = (v | v << 8) & 0x100f00f00f00f00full;
+  v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+  v = (v | v << 2) & 0x1249249249249249ull;
+  return v;
+}
+
+/**
+ * @brief 按 newToOld 的顺序收集顶点属性, 生成新模型
+ */
+static TriangleModel GatherVertices(
+    const TriangleModel& model,
+    const std::vector<UInt32>& newToOld,
+    Share<UInt32[]> indices) {
+  UInt32 count = static_cast<UInt32>(newToOld.size());
+  Share<Eigen::Vector3f[]> srcPos = model.GetPosition();
+  Share<Eigen::Vector3f[]> srcNormal = model.GetNormal();
+  Share<Eigen::Vector2f[]> srcUV = model.GetUV();
+  Share<Eigen::Vector3f[]> srcTangent = model.GetTangent();
+  Share<Eigen::Vector3f[]> pos = TriangleModel::AllocPosition(count);
+  Share<Eigen::Vector3f[]> normal = srcNormal == nullptr ? nullptr : Share<Eigen::Vector3f[]>(new Eigen::Vector3f[count]);
+  Share<Eigen::Vector2f[]> uv = srcUV == nullptr ? nullptr : Share<Eigen::Vector2f[]>(new Eigen::Vector2f[count]);
+  Share<Eigen::Vector3f[]> tangent = srcTangent == nullptr ? nullptr : Share<Eigen::Vector3f[]>(new Eigen::Vector3f[count]);
+  tbb::parallel_for(tbb::blocked_range<UInt32>(0, count), [&](const tbb::blocked_range<UInt32>& r) {
+    for (UInt32 i = r.begin(); i != r.end(); i++) {
+      UInt32 old = newToOld[i];
+      pos[i] = srcPos[old];
+      if (normal != nullptr) {
+        normal[i] = srcNormal[old];
+      }
+      if (uv != nullptr) {
+        uv[i] = srcUV[old];
+      }
+      if (tangent != nullptr) {
+        tangent[i] = srcTangent[old];
+      }
+    }
+  });
+  return TriangleModel(pos, count, std::move(indices), model.IndexCount(), normal, uv, tangent);
+}
+
+TriangleModel TriangleModel::WeldVertices() const {
+  UInt32 count = _vertexCount;
+  std::vector<UInt64> hash(count);
+  tbb::parallel_for(tbb::blocked_range<UInt32>(0, count), [&](const tbb::blocked_range<UInt32>& r) {
+    for (UInt32 i = r.begin(); i != r.end(); i++) {
+      UInt64 h = 14695981039346656037ull;
+      h = HashBytes(&_position[i], sizeof(Eigen::Vector3f), h);
+      if (_normal != nullptr) {
+        h = HashBytes(&_normal[i], sizeof(Eigen::Vector3f), h);
+      }
+      if (_uv != nullptr) {
+        h = HashBytes(&_uv[i], sizeof(Eigen::Vector2f), h);
+      }
+      if (_tangent != nullptr) {
+        h = HashBytes(&_tangent[i], sizeof(Eigen::Vector3f), h);
+      }
+      hash[i] = h;
+    }
+  });
+  auto isSame = [&](UInt32 a, UInt32 b) {
+    return std::memcmp(&_position[a], &_position[b], sizeof(Eigen::Vector3f)) == 0 &&
+           (_normal == nullptr || std::memcmp(&_normal[a], &_normal[b], sizeof(Eigen::Vector3f)) == 0) &&
+           (_uv == nullptr || std::memcmp(&_uv[a], &_uv[b], sizeof(Eigen::Vector2f)) == 0) &&
+           (_tangent == nullptr || std::memcmp(&_tangent[a], &_tangent[b], sizeof(Eigen::Vector3f)) == 0);
+  };
+  //哈希相同的顶点排在一起, 组内按原索引升序, 每个顶点合并到组内第一个与它完全相同的顶点
+  std::vector<UInt32> order(count);
+  std::iota(order.begin(), order.end(), 0);
+  tbb::parallel_sort(order.begin(), order.end(), [&](UInt32 a, UInt32 b) {
+    return hash[a] != hash[b] ? hash[a] < hash[b] : a < b;
+  });
+  std::vector<UInt32> remap(count);
+  for (size_t begin = 0; begin < count;) {
+    size_t end = begin + 1;
+    while (end < count && hash[order[end]] == hash[order[begin]]) {
+      end++;
+    }
+    for (size_t i = begin; i < end; i++) {
+      UInt32 v = order[i];
+      remap[v] = v;
+      for (size_t j = begin; j < i; j++) {
+        UInt32 u = order[j];
+        if (remap[u] == u && isSame(u, v)) {
+          remap[v] = u;
+          break;
+        }
+      }
+    }
+    begin = end;
+  }
+  //合并到的顶点索引总是更小, 顺序遍历时它的新索引已经确定
+  std::vector<UInt32> newToOld;
+  for (UInt32 i = 0; i < count; i++) {
+    if (remap[i] == i) {
+      remap[i] = static_cast<UInt32>(newToOld.size());
+      newToOld.emplace_back(i);
+    } else {
+      remap[i] = remap[remap[i]];
+    }
+  }
+  if (newToOld.size() == count) {
+    return *this;
+  }
+  Share<UInt32[]> indices(new UInt32[_indexCount]);
+  tbb::parallel_for(tbb::blocked_range<UInt32>(0, _indexCount), [&](const tbb::blocked_range<UInt32>& r) {
+    for (UInt32 i = r.begin(); i != r.end(); i++) {
+      indices[i] = remap[_indices[i]];
+    }
+  });
+  return GatherVertices(*this, newToOld, std::move(indices));
+}
+
+TriangleModel TriangleModel::ReorderForLocality() const {
+  BoundingBox3f bound = tbb::parallel_reduce(
+      tbb::blocked_range<UInt32>(0, _vertexCount), BoundingBox3f(),
+      [&](const tbb::blocked_range<UInt32>& r, BoundingBox3f box) {
+        for (UInt32 i = r.begin(); i != r.end(); i++) {
+          box.extend(_position[i]);
+        }
+        return box;
+      },
+      [](const BoundingBox3f& a, const BoundingBox3f& b) { return a.merged(b); });
+  if (bound.isEmpty()) {
+    TriangleModel result = *this;
+    result.SetPreprocessed(true);
+    return result;
+  }
+  constexpr Float32 maxCell = (1 << 21) - 1;
+  Vector3f extent = bound.sizes();
+  Vector3f scale;
+  for (Int32 k = 0; k < 3; k++) {
+    scale[k] = extent[k] > 0 ? maxCell / extent[k] : 0;
+  }
+  std::vector<std::pair<UInt64, UInt32>> keys(_triangleCount);
+  tbb::parallel_for(tbb::blocked_range<UInt32>(0, _triangleCount), [&](const tbb::blocked_range<UInt32>& r) {
+    for (UInt32 t = r.begin(); t != r.end(); t++) {
+      Vector3f c = (_position[_indices[t * 3 + 0]] + _position[_indices[t * 3 + 1]] + _position[_indices[t * 3 + 2]]) / 3.0f;
+      Vector3f q = ((c - bound.min()).cwiseProduct(scale)).cwiseMax(0.0f).cwiseMin(maxCell);
+      UInt64 code = (ExpandBits21(UInt64(q.x())) << 2) | (ExpandBits21(UInt64(q.y())) << 1) | ExpandBits21(UInt64(q.z()));
+      keys[t] = std::make_pair(code, t);
+    }
+  });
+  tbb::parallel_sort(keys.begin(), keys.end());
+  //顶点按排序后三角形第一次引用的顺序编号, 没有被引用的顶点放在最后
+  constexpr UInt32 invalid = std::numeric_limits<UInt32>::max();
+  std::vector<UInt32> oldToNew(_vertexCount, invalid);
+  std::vector<UInt32> newToOld;
+  newToOld.reserve(_vertexCount);
+  Share<UInt32[]> indices(new UInt32[_indexCount]);
+  for (UInt32 t = 0; t < _triangleCount; t++) {
+    UInt32 old = keys[t].second;
+    for (UInt32 k = 0; k < 3; k++) {
+      UInt32 v = _indices[old * 3 + k];
+      if (oldToNew[v] == invalid) {
+        oldToNew[v] = static_cast<UInt32>(newToOld.size());
+        newToOld.emplace_back(v);
+      }
+      indices[t * 3 + k] = oldToNew[v];
+    }
+  }
+  for (UInt32 v = 0; v < _vertexCount; v++) {
+    if (oldToNew[v] == invalid) {
+      newToOld.emplace_back(v);
+    }
+  }
+  TriangleModel result = GatherVertices(*this, newToOld, std::move(indices));
+  result.SetPreprocessed(true);
+  return result;
+}
+
+Float32 TriangleModel::AverageCacheMissRatio(UInt32 cacheSize) const {
+  if (_triangleCount == 0) {
+    return 0;
+  }
+  //记录每个顶点进入缓存时的未命中计数, 之后又有 cacheSize 次未命中时它就被挤出了 FIFO
+  std::vector<UInt64> stamp(_vertexCount, 0);
+  UInt64 miss = 0;
+  for (UInt32 i = 0; i < _indexCount; i++) {
+    UInt32 v = _indices[i];
+    if (stamp[v] == 0 || miss - stamp[v] >= cacheSize) {
+      miss++;
+      stamp[v] = miss;
+    }
+  }
+  return static_cast<Float32>(static_cast<Float64>(miss) / _triangleCount);
+}
+
 TriangleModel TriangleModel::CreateSphere(Float32 radius, Int32 numberSlices) {
   const Vector3f axisX = {1.0f, 0.0f, 0.0f};
 
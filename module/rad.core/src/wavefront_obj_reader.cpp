@@ -1,5 +1,7 @@
 #include <rad/core/wavefront_obj_reader.h>
 
+#include <rad/core/mapped_file.h>
+
 #include <memory>
 #include <string>
 #include <string_view>
@@ -12,6 +14,10 @@
 #include <vector>
 #include <limits>
 #include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#include <tbb/parallel_for.h>
 
 namespace Rad {
 
@@ -20,10 +26,10 @@ WavefrontObjReader::WavefrontObjReader(Unique<std::istream> stream) {
 }
 
 WavefrontObjReader::WavefrontObjReader(const std::filesystem::path& file) {
-  _stream = std::make_unique<std::ifstream>(file);
   if (!std::filesystem::exists(file)) {
     throw RadFileNotFoundException("cannot find file: {}", file.string());
   }
+  _file = file;
 }
 
 WavefrontObjReader::WavefrontObjReader(const std::string& text) {
@@ -35,14 +41,19 @@ bool WavefrontObjReader::HasError() const {
 }
 
 void WavefrontObjReader::Read() {
-  UInt32 allLine = 0;
-  std::string buffer;
-  while (std::getline(*_stream, buffer)) {
-    allLine++;
-    if (buffer.empty()) {
-      continue;
+  if (!_file.empty()) {
+    MappedFile mapped(_file, MappedFileAccess::Sequential);
+    ReadBuffer(mapped.Data(), mapped.Size());
+  } else {
+    UInt32 allLine = 0;
+    std::string buffer;
+    while (std::getline(*_stream, buffer)) {
+      allLine++;
+      if (buffer.empty()) {
+        continue;
+      }
+      Parse(buffer, allLine);
     }
-    Parse(buffer, allLine);
   }
   if (_error.size() > 0 && *_error.rbegin() == '\n') {
     _error.erase(_error.begin() + _error.size() - 1);
@@ -335,6 +346,301 @@ void WavefrontObjReader::Parse(const std::string& line, int lineNum) {
   }
 }
 
+//////////////////////////////////////////////////
+// parallel parse of a memory buffer
+/**
+ * @brief 一块连续行的解析结果, 面的索引都是块内的局部索引
+ */
+struct WavefrontObjChunk {
+  std::vector<Eigen::Vector3f> Pos;
+  std::vector<Eigen::Vector2f> UV;
+  std::vector<Eigen::Vector3f> Normal;
+  std::vector<WavefrontObjFace> Faces;
+  std::vector<std::string> Mtllibs;
+  std::vector<WavefrontObjObject> Objects;
+  //块内第一个 o/g 之前的面和材质属于之前某一块的最后一个物体, 合并时才知道是谁
+  std::vector<size_t> LeadingFaces;
+  std::string LeadingMaterial;
+  bool HasLeadingMaterial = false;
+  //块内行号(从1开始)和错误信息
+  std::vector<std::pair<UInt32, std::string>> Errors;
+  UInt32 LineCount = 0;
+};
+
+static bool IsBlank(char c) {
+  return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static std::string_view TrimBlank(std::string_view str) {
+  size_t start = 0;
+  while (start < str.size() && IsBlank(str[start])) {
+    start++;
+  }
+  size_t end = str.size();
+  while (end > start && IsBlank(str[end - 1])) {
+    end--;
+  }
+  return str.substr(start, end - start);
+}
+
+template <size_t Count>
+static bool ParseFloats(std::string_view str, std::array<float, Count>& arr) {
+  const char* p = str.data();
+  const char* end = p + str.size();
+  arr.fill(0);
+  for (size_t i = 0; i < Count; i++) {
+    while (p < end && IsBlank(*p)) {
+      p++;
+    }
+    if (p == end) {
+      return i > 0;
+    }
+    if (*p == '+') {  //from_chars 不接受正号
+      p++;
+    }
+    auto [ptr, ec] = std::from_chars(p, end, arr[i]);
+    if (ec != std::errc()) {
+      return false;
+    }
+    p = ptr;
+  }
+  return true;
+}
+
+static bool ParseInt(const char*& p, const char* end, Int32& value) {
+  if (p < end && *p == '+') {
+    p++;
+  }
+  auto [ptr, ec] = std::from_chars(p, end, value);
+  if (ec != std::errc()) {
+    return false;
+  }
+  p = ptr;
+  return true;
+}
+
+static bool ParseFaceVertexFast(const char*& p, const char* end, Int32& v, Int32& vt, Int32& vn) {
+  vt = 0;
+  vn = 0;
+  if (!ParseInt(p, end, v)) {
+    return false;
+  }
+  if (p < end && *p == '/') {
+    p++;
+    if (p < end && *p == '/') {
+      p++;
+      return ParseInt(p, end, vn);
+    }
+    if (!ParseInt(p, end, vt)) {
+      return false;
+    }
+    if (p < end && *p == '/') {
+      p++;
+      return ParseInt(p, end, vn);
+    }
+  }
+  return true;
+}
+
+static bool ParseFaceFast(std::string_view data, WavefrontObjFace& face) {
+  const char* p = data.data();
+  const char* end = p + data.size();
+  Int32* v[3] = {&face.V1, &face.V2, &face.V3};
+  Int32* vt[3] = {&face.Vt1, &face.Vt2, &face.Vt3};
+  Int32* vn[3] = {&face.Vn1, &face.Vn2, &face.Vn3};
+  for (size_t i = 0; i < 3; i++) {
+    while (p < end && IsBlank(*p)) {
+      p++;
+    }
+    if (p == end || !ParseFaceVertexFast(p, end, *v[i], *vt[i], *vn[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void ParseChunkLine(std::string_view line, UInt32 lineNum, WavefrontObjChunk& chunk) {
+  std::string_view view = TrimBlank(line);
+  size_t cmdEnd = 0;
+  while (cmdEnd < view.size() && !IsBlank(view[cmdEnd])) {
+    cmdEnd++;
+  }
+  if (cmdEnd == view.size()) {
+    return;
+  }
+  std::string_view cmd = view.substr(0, cmdEnd);
+  std::string_view data = TrimBlank(view.substr(cmdEnd));
+  ObjCmd objCmd;
+  //最常见的几个命令直接比较, 不去查表
+  if (cmd.size() == 1 && cmd[0] == 'v') {
+    objCmd = ObjCmd::Vertex;
+  } else if (cmd.size() == 1 && cmd[0] == 'f') {
+    objCmd = ObjCmd::Face;
+  } else if (cmd == "vn") {
+    objCmd = ObjCmd::Normal;
+  } else if (cmd == "vt") {
+    objCmd = ObjCmd::UV;
+  } else {
+    auto iter = __strToObjCmd.find(cmd);
+    if (iter == __strToObjCmd.end()) {
+      chunk.Errors.emplace_back(lineNum, fmt::format("unknown cmd {}", cmd));
+      return;
+    }
+    objCmd = iter->second;
+  }
+  switch (objCmd) {
+    case ObjCmd::Commit:
+      break;
+    case ObjCmd::Vertex: {
+      std::array<float, 3> result;
+      if (!ParseFloats(data, result)) {
+        chunk.Errors.emplace_back(lineNum, fmt::format("can't parse vertex {}", data));
+      }
+      chunk.Pos.emplace_back(result[0], result[1], result[2]);
+      break;
+    }
+    case ObjCmd::UV: {
+      std::array<float, 2> result;
+      if (!ParseFloats(data, result)) {
+        chunk.Errors.emplace_back(lineNum, fmt::format("can't parse uv {}", data));
+      }
+      chunk.UV.emplace_back(result[0], result[1]);
+      break;
+    }
+    case ObjCmd::Normal: {
+      std::array<float, 3> result;
+      if (!ParseFloats(data, result)) {
+        chunk.Errors.emplace_back(lineNum, fmt::format("can't parse normal {}", data));
+      }
+      chunk.Normal.emplace_back(result[0], result[1], result[2]);
+      break;
+    }
+    case ObjCmd::Face: {
+      WavefrontObjFace face{};
+      if (!ParseFaceFast(data, face)) {
+        chunk.Errors.emplace_back(lineNum, fmt::format("can't parse face {}", data));
+      }
+      size_t index = chunk.Faces.size();
+      chunk.Faces.push_back(face);
+      if (chunk.Objects.size() > 0) {
+        chunk.Objects.rbegin()->Faces.push_back(index);
+      } else {
+        chunk.LeadingFaces.push_back(index);
+      }
+      break;
+    }
+    case ObjCmd::Mtllib:
+      chunk.Mtllibs.emplace_back(data);
+      break;
+    case ObjCmd::UseMtl: {
+      if (chunk.Objects.size() > 0) {
+        chunk.Objects.rbegin()->Material = std::string(data);
+      } else {
+        chunk.LeadingMaterial = std::string(data);
+        chunk.HasLeadingMaterial = true;
+      }
+      break;
+    }
+    case ObjCmd::Geometry:
+    case ObjCmd::Object: {
+      WavefrontObjObject obj{};
+      obj.Name = std::string(data);
+      chunk.Objects.emplace_back(std::move(obj));
+      break;
+    }
+    case ObjCmd::Smooth:
+      break;
+  }
+}
+
+static void ParseChunk(const char* begin, const char* end, WavefrontObjChunk& chunk) {
+  const char* p = begin;
+  while (p < end) {
+    const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (lineEnd == nullptr) {
+      lineEnd = end;
+    }
+    chunk.LineCount++;
+    if (lineEnd != p) {
+      ParseChunkLine(std::string_view(p, lineEnd - p), chunk.LineCount, chunk);
+    }
+    p = lineEnd + 1;
+  }
+}
+
+void WavefrontObjReader::ReadBuffer(const char* data, size_t size) {
+  //每块约 4MB, 切分点向后移动到下一个换行符之后, 保证每块都由完整的行组成
+  constexpr size_t ChunkSize = size_t(4) << 20;
+  size_t chunkCount = std::max(size / ChunkSize, size_t(1));
+  std::vector<size_t> bounds{0};
+  for (size_t i = 1; i < chunkCount; i++) {
+    size_t at = std::max(size * i / chunkCount, bounds.back());
+    const char* lineEnd = static_cast<const char*>(std::memchr(data + at, '\n', size - at));
+    if (lineEnd == nullptr) {
+      break;
+    }
+    size_t next = lineEnd - data + 1;
+    if (next > bounds.back() && next < size) {
+      bounds.push_back(next);
+    }
+  }
+  bounds.push_back(size);
+  std::vector<WavefrontObjChunk> chunks(bounds.size() - 1);
+  tbb::parallel_for(size_t(0), chunks.size(), size_t(1), [&](size_t i) {
+    ParseChunk(data + bounds[i], data + bounds[i + 1], chunks[i]);
+  });
+  //按块的顺序合并, 结果与逐行读取时一样
+  std::vector<size_t> posStart(chunks.size()), uvStart(chunks.size()), normalStart(chunks.size()), faceStart(chunks.size());
+  size_t posCount = _pos.size(), uvCount = _uv.size(), normalCount = _normal.size(), faceCount = _faces.size();
+  for (size_t i = 0; i < chunks.size(); i++) {
+    posStart[i] = posCount;
+    uvStart[i] = uvCount;
+    normalStart[i] = normalCount;
+    faceStart[i] = faceCount;
+    posCount += chunks[i].Pos.size();
+    uvCount += chunks[i].UV.size();
+    normalCount += chunks[i].Normal.size();
+    faceCount += chunks[i].Faces.size();
+  }
+  _pos.resize(posCount);
+  _uv.resize(uvCount);
+  _normal.resize(normalCount);
+  _faces.resize(faceCount);
+  tbb::parallel_for(size_t(0), chunks.size(), size_t(1), [&](size_t i) {
+    const WavefrontObjChunk& chunk = chunks[i];
+    std::copy(chunk.Pos.begin(), chunk.Pos.end(), _pos.begin() + posStart[i]);
+    std::copy(chunk.UV.begin(), chunk.UV.end(), _uv.begin() + uvStart[i]);
+    std::copy(chunk.Normal.begin(), chunk.Normal.end(), _normal.begin() + normalStart[i]);
+    std::copy(chunk.Faces.begin(), chunk.Faces.end(), _faces.begin() + faceStart[i]);
+  });
+  UInt32 lineStart = 0;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    WavefrontObjChunk& chunk = chunks[i];
+    for (const auto& [line, msg] : chunk.Errors) {
+      _error += fmt::format("at line {}: {}\n", lineStart + line, msg);
+    }
+    lineStart += chunk.LineCount;
+    for (std::string& mtl : chunk.Mtllibs) {
+      _mtllibs.emplace_back(std::move(mtl));
+    }
+    if (_objects.size() > 0) {
+      WavefrontObjObject& last = *_objects.rbegin();
+      for (size_t f : chunk.LeadingFaces) {
+        last.Faces.push_back(f + faceStart[i]);
+      }
+      if (chunk.HasLeadingMaterial) {
+        last.Material = std::move(chunk.LeadingMaterial);
+      }
+    }
+    for (WavefrontObjObject& obj : chunk.Objects) {
+      for (size_t& f : obj.Faces) {
+        f += faceStart[i];
+      }
+      _objects.emplace_back(std::move(obj));
+    }
+  }
+}
+
 // .obj face support reverse index. so we should check if it is less than zero
 static size_t CvtIdx(int f, size_t count) {
   return f >= 0 ? f - 1 : count + f;
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <rad/core/common.h>
+#include <rad/core/logger.h>
+#include <rad/core/config_node.h>
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unordered_map>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#endif
+
+/*
+ * 所有基准测试共用的工具: 命令行解析、进程内存查询、场景配置读取
+ * 只依赖核心库, 不链接离线渲染库的基准测试也能使用
+ */
+
+namespace Rad::Bench {
+
+/**
+ * @brief 解析 "--name value" 与 "--flag" 形式的命令行参数, 不认识的参数直接忽略
+ */
+class BenchArgs {
+ public:
+  BenchArgs(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+      std::string cmd(argv[i]);
+      if (cmd.rfind("--", 0) != 0) {
+        continue;
+      }
+      //后面跟着的不是另一个选项时当作参数值
+      if (i + 1 < argc && std::string(argv[i + 1]).rfind("--", 0) != 0) {
+        _values[cmd] = std::string(argv[i + 1]);
+        i++;
+      } else {
+        _values[cmd] = std::string();
+      }
+    }
+  }
+
+  bool Has(const std::string& name) const { return _values.find(name) != _values.end(); }
+
+  std::string GetString(const std::string& name, const std::string& defaultValue = {}) const {
+    auto iter = _values.find(name);
+    return iter == _values.end() || iter->second.empty() ? defaultValue : iter->second;
+  }
+
+  /**
+   * @brief 读取无符号整数, 结果不会小于 minValue
+   */
+  UInt32 GetUInt(const std::string& name, UInt32 defaultValue, UInt32 minValue = 0) const {
+    auto iter = _values.find(name);
+    if (iter == _values.end() || iter->second.empty()) {
+      return std::max(defaultValue, minValue);
+    }
+    return std::max(static_cast<UInt32>(std::stoul(iter->second)), minValue);
+  }
+
+ private:
+  std::unordered_map<std::string, std::string> _values;
+};
+
+struct MemoryUsage {
+  size_t Current;  //当前常驻内存, 字节
+  size_t Peak;     //进程启动以来的常驻内存峰值, 字节
+};
+
+inline MemoryUsage QueryMemoryUsage() {
+  MemoryUsage usage{0, 0};
+#if defined(_WIN32)
+  PROCESS_MEMORY_COUNTERS pmc{};
+  if (GetProcessMemoryInfo(GetCurrentProcess(), &pmc, sizeof(pmc))) {
+    usage.Current = pmc.WorkingSetSize;
+    usage.Peak = pmc.PeakWorkingSetSize;
+  }
+#else
+  //单位是 kB
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmRSS:", 0) == 0) {
+      usage.Current = std::stoull(line.substr(6)) * 1024;
+    } else if (line.rfind("VmHWM:", 0) == 0) {
+      usage.Peak = std::stoull(line.substr(6)) * 1024;
+    }
+  }
+#endif
+  return usage;
+}
+
+inline nlohmann::json LoadSceneConfig(const std::filesystem::path& path) {
+  std::ifstream cfgStream(path);
+  if (!cfgStream.is_open()) {
+    throw RadArgumentException("cannot open file: {}", path.string());
+  }
+  return nlohmann::json::parse(cfgStream);
+}
+
+/**
+ * @brief 基准测试的 main 外壳: 初始化核心库, 把异常打印成日志并返回非零退出码
+ */
+template <typename Func>
+int RunBench(Func&& func) {
+  RadCoreInit();
+  int exitCode = 0;
+  try {
+    func();
+  } catch (const std::exception& e) {
+    Logger::Get()->error("unhandled exception: {}", e.what());
+    exitCode = 1;
+  } catch (...) {
+    Logger::Get()->error("unknown exception");
+    exitCode = 1;
+  }
+  RadCoreShutdown();
+  return exitCode;
+}
+
+}  // namespace Rad::Bench
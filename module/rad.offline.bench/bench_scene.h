@@ -0,0 +1,53 @@
+#pragma once
+
+#include "bench_common.h"
+
+#include <rad/offline/build/build_context.h>
+#include <rad/offline/render/renderer.h>
+
+/*
+ * 链接离线渲染库的基准测试共用的场景构建工具
+ */
+
+namespace Rad::Bench {
+
+inline void SetMeshOptionsRecursive(nlohmann::json& entity, const nlohmann::json& options) {
+  auto shape = entity.find("shape");
+  if (shape != entity.end() && shape->is_object() && shape->value("type", "") == "mesh") {
+    for (auto iter = options.begin(); iter != options.end(); ++iter) {
+      (*shape)[iter.key()] = iter.value();
+    }
+  }
+  auto children = entity.find("children");
+  if (children != entity.end() && children->is_array()) {
+    for (nlohmann::json& child : *children) {
+      SetMeshOptionsRecursive(child, options);
+    }
+  }
+}
+
+/**
+ * @brief 把 options 里的每一项写进场景中所有 mesh 形状的配置, 包括子实体
+ */
+inline void SetMeshOptions(nlohmann::json& sceneCfg, const nlohmann::json& options) {
+  auto scene = sceneCfg.find("scene");
+  if (scene != sceneCfg.end() && scene->is_array()) {
+    for (nlohmann::json& entity : *scene) {
+      SetMeshOptionsRecursive(entity, options);
+    }
+  }
+}
+
+/**
+ * @brief 用场景文件所在目录作为资产目录构建渲染器
+ * 上下文持有资产与压缩缓存, 返回时已经析构, 只剩渲染时需要的数据
+ */
+inline Unique<Renderer> BuildRenderer(nlohmann::json& sceneCfg, const std::filesystem::path& scenePath) {
+  BuildContext ctx{};
+  ctx.SetFromJson(sceneCfg);
+  ctx.SetDefaultFactoryManager();
+  ctx.SetDefaultAssetManager(scenePath.parent_path().string());
+  return ctx.Build();
+}
+
+}  // namespace Rad::Bench
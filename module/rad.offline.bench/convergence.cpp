@@ -0,0 +1,194 @@
+#include "bench_scene.h"
+
+#include <rad/core/stop_watch.h>
+#include <rad/offline/render/scene.h>
+#include <rad/offline/render/camera.h>
+
+#include <cmath>
+#include <sstream>
+
+/*
+ * 采样器收敛基准测试
+ * 先用 independent 采样器和很高的样本数渲染一张参考图, 再用每种采样器在递增的样本数下渲染同一个场景
+ * 输出每次渲染与参考图的均方根误差, 以及 log(RMSE) 对 log(spp) 的斜率. 纯蒙特卡洛大约是 -0.5, 低差异序列应该更陡
+ * 没有 --scene 时使用内置的 Cornell box, 只由矩形、球和面光源组成, 不需要任何资产
+ * 参考图本身也有噪声, 样本数接近参考图时误差会被它的噪声托住, 参考样本数应该远大于测试的最大样本数
+ */
+
+static nlohmann::json RectangleEntity(const Rad::Vector3& translate, const Rad::Vector3& axis, Rad::Float angle, const Rad::Vector3& scale) {
+  return {
+      {"shape", {{"type", "rectangle"}}},
+      {"to_world",
+       {{"translate", {translate.x(), translate.y(), translate.z()}},
+        {"rotate", {{"axis", {axis.x(), axis.y(), axis.z()}}, {"angle", angle}}},
+        {"scale", {scale.x(), scale.y(), scale.z()}}}}};
+}
+
+static nlohmann::json Diffuse(Rad::Float r, Rad::Float g, Rad::Float b) {
+  return {{"type", "diffuse"}, {"reflectance", {r, g, b}}};
+}
+
+/**
+ * @brief 内置的 Cornell box, 盒子是 [-1, 1]^3, 相机在 -z 方向看向原点
+ */
+static nlohmann::json CornellBoxConfig(Rad::Int32 width, Rad::Int32 height) {
+  nlohmann::json scene = nlohmann::json::array();
+  Rad::Vector3 one(1, 1, 1);
+  Rad::Vector3 xAxis(1, 0, 0);
+  Rad::Vector3 yAxis(0, 1, 0);
+  //矩形在局部空间是 xy 平面上的 [-1, 1]^2, 法线是 +z, 旋转到朝向盒子内部
+  nlohmann::json floor = RectangleEntity({0, -1, 0}, xAxis, -90, one);
+  floor["bsdf"] = Diffuse(0.725f, 0.71f, 0.68f);
+  nlohmann::json ceiling = RectangleEntity({0, 1, 0}, xAxis, 90, one);
+  ceiling["bsdf"] = Diffuse(0.725f, 0.71f, 0.68f);
+  nlohmann::json back = RectangleEntity({0, 0, 1}, yAxis, 180, one);
+  back["bsdf"] = Diffuse(0.725f, 0.71f, 0.68f);
+  nlohmann::json left = RectangleEntity({-1, 0, 0}, yAxis, 90, one);
+  left["bsdf"] = Diffuse(0.63f, 0.065f, 0.05f);
+  nlohmann::json right = RectangleEntity({1, 0, 0}, yAxis, -90, one);
+  right["bsdf"] = Diffuse(0.14f, 0.45f, 0.091f);
+  nlohmann::json light = RectangleEntity({0, Rad::Float(0.99), 0}, xAxis, 90, {Rad::Float(0.25), Rad::Float(0.25), 1});
+  light["bsdf"] = Diffuse(0, 0, 0);
+  light["light"] = {{"type", "area"}, {"radiance", {17, 12, 4}}};
+  nlohmann::json ballA = {
+      {"shape", {{"type", "sphere"}, {"center", {-0.4, -0.6, 0.3}}, {"radius", 0.4}}},
+      {"bsdf", Diffuse(0.725f, 0.71f, 0.68f)}};
+  nlohmann::json ballB = {
+      {"shape", {{"type", "sphere"}, {"center", {0.45, -0.7, -0.3}}, {"radius", 0.3}}},
+      {"bsdf", Diffuse(0.725f, 0.71f, 0.68f)}};
+  for (nlohmann::json* e : {&floor, &ceiling, &back, &left, &right, &light, &ballA, &ballB}) {
+    scene.emplace_back(std::move(*e));
+  }
+  return {
+      {"camera",
+       {{"type", "perspective"},
+        {"fov", 40},
+        {"resolution", {width, height}},
+        {"origin", {0, 0, -3.8}},
+        {"target", {0, 0, 0}},
+        {"up", {0, 1, 0}}}},
+      {"renderer", {{"type", "path"}, {"max_depth", 8}}},
+      {"scene", std::move(scene)}};
+}
+
+static std::vector<Rad::UInt32> ParseUIntList(const std::string& list) {
+  std::vector<Rad::UInt32> result;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      result.emplace_back(std::max(static_cast<Rad::UInt32>(std::stoul(item)), 1u));
+    }
+  }
+  return result;
+}
+
+static std::vector<std::string> ParseStringList(const std::string& list) {
+  std::vector<std::string> result;
+  std::stringstream ss(list);
+  std::string item;
+  while (std::getline(ss, item, ',')) {
+    if (!item.empty()) {
+      result.emplace_back(item);
+    }
+  }
+  return result;
+}
+
+/**
+ * @brief 用指定的采样器渲染场景, 等待渲染结束后返回归一化的图片
+ */
+static Rad::MatrixX<Rad::Spectrum> Render(
+    const nlohmann::json& cfg,
+    const std::filesystem::path& scenePath,
+    const std::string& sampler,
+    Rad::UInt32 spp,
+    Rad::UInt32 seed,
+    Rad::Int64& time) {
+  nlohmann::json sceneCfg = cfg;
+  sceneCfg["sampler"] = {{"type", sampler}, {"sample_count", spp}, {"seed", seed}};
+  Rad::Unique<Rad::Renderer> renderer = Rad::Bench::BuildRenderer(sceneCfg, scenePath);
+  Rad::Stopwatch sw;
+  sw.Start();
+  renderer->Start();
+  renderer->Wait();
+  sw.Stop();
+  time = sw.ElapsedMilliseconds();
+  return renderer->GetScene().GetCamera().GetFrameBuffer();
+}
+
+static double Rmse(const Rad::MatrixX<Rad::Spectrum>& image, const Rad::MatrixX<Rad::Spectrum>& reference) {
+  if (image.rows() != reference.rows() || image.cols() != reference.cols()) {
+    throw Rad::RadInvalidOperationException("image size mismatch reference");
+  }
+  double sum = 0;
+  for (Eigen::Index i = 0; i < image.size(); i++) {
+    for (Rad::UInt32 c = 0; c < Rad::Spectrum::ComponentCount; c++) {
+      double d = double(image.coeff(i)[c]) - double(reference.coeff(i)[c]);
+      sum += d * d;
+    }
+  }
+  return std::sqrt(sum / (double(image.size()) * Rad::Spectrum::ComponentCount));
+}
+
+/**
+ * @brief 最小二乘拟合 log(RMSE) = k * log(spp) + b, 返回斜率 k
+ */
+static double ConvergenceSlope(const std::vector<Rad::UInt32>& spps, const std::vector<double>& errors) {
+  double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < spps.size(); i++) {
+    if (errors[i] <= 0) {
+      continue;
+    }
+    double x = std::log(double(spps[i])), y = std::log(errors[i]);
+    n += 1;
+    sx += x;
+    sy += y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+  double denom = n * sxx - sx * sx;
+  return n < 2 || denom == 0 ? 0 : (n * sxy - sx * sy) / denom;
+}
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    std::vector<Rad::UInt32> spps = ParseUIntList(args.GetString("--spp", "1,4,16,64,256"));
+    std::vector<std::string> samplers = ParseStringList(args.GetString("--samplers", "independent,sobol,halton"));
+    Rad::UInt32 referenceSpp = args.GetUInt("--reference-spp", 8192, 1);
+    Rad::UInt32 seed = args.GetUInt("--seed", 0);
+    if (spps.empty() || samplers.empty()) {
+      throw Rad::RadArgumentException("should input cmd like \"[--scene <scene.json>] [--spp 1,4,16] [--samplers independent,sobol,halton] [--reference-spp <count>]\"");
+    }
+    std::filesystem::path p;
+    nlohmann::json cfg;
+    if (args.Has("--scene")) {
+      p = std::filesystem::path(args.GetString("--scene"));
+      cfg = Rad::Bench::LoadSceneConfig(p);
+    } else {
+      p = std::filesystem::current_path() / "cornell_box.json";
+      cfg = CornellBoxConfig(Rad::Int32(args.GetUInt("--width", 128, 1)), Rad::Int32(args.GetUInt("--height", 128, 1)));
+    }
+    if (args.Has("--threads")) {
+      cfg["renderer"]["thread_count"] = args.GetUInt("--threads", 1, 1);
+    }
+    auto logger = Rad::Logger::Get();
+    //参考图换一个种子, 不和被测的 independent 渲染共用样本
+    Rad::Int64 referenceTime;
+    Rad::MatrixX<Rad::Spectrum> reference = Render(cfg, p, "independent", referenceSpp, seed + 0x9e3779b9u, referenceTime);
+    logger->info("reference: independent {} spp, {}x{}, {} ms", referenceSpp, reference.rows(), reference.cols(), referenceTime);
+    logger->info("{:<14} {:>8} {:>14} {:>10}", "sampler", "spp", "RMSE", "time ms");
+    for (const std::string& sampler : samplers) {
+      std::vector<double> errors;
+      for (Rad::UInt32 spp : spps) {
+        Rad::Int64 time;
+        Rad::MatrixX<Rad::Spectrum> image = Render(cfg, p, sampler, spp, seed, time);
+        double error = Rmse(image, reference);
+        errors.emplace_back(error);
+        logger->info("{:<14} {:>8} {:>14.6e} {:>10}", sampler, spp, error, time);
+      }
+      logger->info("{:<14} slope of log(RMSE) over log(spp): {:.3f}", sampler, ConvergenceSlope(spps, errors));
+    }
+  });
+}
@@ -0,0 +1,146 @@
+#include "bench_scene.h"
+
+#include <rad/core/stop_watch.h>
+#include <rad/offline/render/scene.h>
+#include <rad/offline/render/camera.h>
+#include <rad/offline/render/accel.h>
+#include <rad/offline/warp.h>
+
+#include <atomic>
+#include <random>
+#include <thread>
+
+/*
+ * 加速结构基准测试
+ * 用每一种加速结构配置构建同一个场景, 再发射同一组光线: 每个像素中心一条相机光线, 以及固定种子生成的随机光线
+ * 输出构建时间、加速结构内存与每秒求交的光线数
+ */
+
+struct BenchResult {
+  std::string Name;
+  Rad::Int64 BuildTime;
+  size_t Memory;
+  double PrimaryMrays;
+  double RandomMrays;
+  double ShadowMrays;
+};
+
+/**
+ * @brief 所有线程分块领取光线, 返回每秒百万条光线
+ */
+template <typename Func>
+static double Trace(const std::vector<Rad::Ray>& rays, Rad::UInt32 threadCount, Func&& func) {
+  constexpr size_t chunk = 1024;
+  std::atomic<size_t> next{0};
+  std::atomic<size_t> hitCount{0};
+  Rad::Stopwatch sw;
+  sw.Start();
+  std::vector<std::thread> threads;
+  for (Rad::UInt32 t = 0; t < threadCount; t++) {
+    threads.emplace_back([&]() {
+      size_t hits = 0;
+      while (true) {
+        size_t begin = next.fetch_add(chunk);
+        if (begin >= rays.size()) {
+          break;
+        }
+        size_t end = std::min(begin + chunk, rays.size());
+        for (size_t i = begin; i < end; i++) {
+          hits += func(rays[i]) ? 1 : 0;
+        }
+      }
+      hitCount.fetch_add(hits);
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  sw.Stop();
+  //防止求交被优化掉, 顺便让结果可以和其他配置对照
+  Rad::Logger::Get()->debug("{} of {} rays hit", hitCount.load(), rays.size());
+  double seconds = std::max(sw.ElapsedMilliseconds(), Rad::Int64(1)) / 1000.0;
+  return rays.size() / seconds / 1e6;
+}
+
+static std::vector<nlohmann::json> DefaultAccelConfigs() {
+  return {
+      {{"type", "embree"}, {"build_quality", "low"}},
+      {{"type", "embree"}, {"build_quality", "medium"}},
+      {{"type", "embree"}, {"build_quality", "high"}},
+      {{"type", "embree"}, {"build_quality", "high"}, {"compact", true}},
+      {{"type", "embree"}, {"build_quality", "high"}, {"robust", true}},
+      {{"type", "bvh"}, {"width", 4}},
+      {{"type", "bvh"}, {"width", 8}}};
+}
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    std::string scenePath = args.GetString("--scene");
+    Rad::UInt32 randomRayCount = args.GetUInt("--rays", 1 << 22);
+    Rad::UInt32 threadCount = args.GetUInt("--threads", std::thread::hardware_concurrency(), 1);
+    if (scenePath.empty()) {
+      throw Rad::RadArgumentException("should input cmd like \"--scene <scene.json> [--rays <count>] [--threads <count>]\"");
+    }
+    std::filesystem::path p(scenePath);
+    nlohmann::json cfg = Rad::Bench::LoadSceneConfig(p);
+    std::vector<Rad::Ray> primaryRays;
+    std::vector<Rad::Ray> randomRays;
+    std::vector<BenchResult> results;
+    for (const nlohmann::json& accelCfg : DefaultAccelConfigs()) {
+      nlohmann::json sceneCfg = cfg;
+      sceneCfg["accel"] = accelCfg;
+      Rad::Unique<Rad::Renderer> renderer = Rad::Bench::BuildRenderer(sceneCfg, p);
+      const Rad::Scene& scene = renderer->GetScene();
+      const Rad::Accel& accel = scene.GetAccel();
+      if (primaryRays.empty()) {
+        //光线只生成一次, 所有配置求交的是完全相同的光线
+        const Rad::Camera& camera = scene.GetCamera();
+        Eigen::Vector2i res = camera.Resolution();
+        for (Rad::Int32 y = 0; y < res.y(); y++) {
+          for (Rad::Int32 x = 0; x < res.x(); x++) {
+            primaryRays.emplace_back(camera.SampleRay(Rad::Vector2(x + Rad::Float(0.5), y + Rad::Float(0.5))));
+          }
+        }
+        Rad::BoundingBox3 bound = accel.GetWorldBound();
+        std::mt19937 rng(0);
+        std::uniform_real_distribution<Rad::Float> dist(0, 1);
+        randomRays.resize(randomRayCount);
+        for (Rad::Ray& ray : randomRays) {
+          Rad::Vector3 t(dist(rng), dist(rng), dist(rng));
+          ray.O = bound.min() + t.cwiseProduct(bound.sizes());
+          ray.D = Rad::Warp::SquareToUniformSphere(Rad::Vector2(dist(rng), dist(rng)));
+          ray.MinT = 0;
+          ray.MaxT = std::numeric_limits<Rad::Float>::infinity();
+        }
+      }
+      BenchResult r{};
+      r.Name = accelCfg.dump();
+      r.BuildTime = accel.BuildTime();
+      r.Memory = accel.MemoryUsage();
+      r.PrimaryMrays = Trace(primaryRays, threadCount, [&](const Rad::Ray& ray) {
+        Rad::HitShapeRecord hsr;
+        return accel.RayIntersectPreliminary(ray, hsr);
+      });
+      r.RandomMrays = Trace(randomRays, threadCount, [&](const Rad::Ray& ray) {
+        Rad::HitShapeRecord hsr;
+        return accel.RayIntersectPreliminary(ray, hsr);
+      });
+      r.ShadowMrays = Trace(randomRays, threadCount, [&](const Rad::Ray& ray) {
+        return accel.RayIntersect(ray);
+      });
+      results.emplace_back(r);
+    }
+    Rad::Logger::Get()->info(
+        "{} primary rays, {} random rays, {} threads",
+        primaryRays.size(), randomRays.size(), threadCount);
+    Rad::Logger::Get()->info(
+        "{:<60} {:>10} {:>12} {:>14} {:>14} {:>14}",
+        "accel", "build ms", "memory MB", "primary Mray/s", "random Mray/s", "shadow Mray/s");
+    for (const BenchResult& r : results) {
+      Rad::Logger::Get()->info(
+          "{:<60} {:>10} {:>12.2f} {:>14.2f} {:>14.2f} {:>14.2f}",
+          r.Name, r.BuildTime, r.Memory / (1024.0 * 1024.0), r.PrimaryMrays, r.RandomMrays, r.ShadowMrays);
+    }
+  });
+}
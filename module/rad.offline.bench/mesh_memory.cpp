@@ -0,0 +1,36 @@
+#include "bench_scene.h"
+
+#include <rad/core/stop_watch.h>
+
+/*
+ * 网格内存基准测试
+ * 把场景里所有网格的 compress_attributes 和 preprocess 改成同一个值后构建场景, 输出构建耗时与进程常驻内存
+ * 分配器不一定把释放的内存还给系统, 对比不同选项时应该分别运行一次进程
+ */
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    std::string scenePath = args.GetString("--scene");
+    bool isCompress = args.Has("--compress");
+    bool isPreprocess = !args.Has("--no-preprocess");
+    if (scenePath.empty()) {
+      throw Rad::RadArgumentException("should input cmd like \"--scene <scene.json> [--compress] [--no-preprocess]\"");
+    }
+    std::filesystem::path p(scenePath);
+    nlohmann::json cfg = Rad::Bench::LoadSceneConfig(p);
+    Rad::Bench::SetMeshOptions(cfg, {{"compress_attributes", isCompress}, {"preprocess", isPreprocess}});
+    auto logger = Rad::Logger::Get();
+    Rad::Bench::MemoryUsage before = Rad::Bench::QueryMemoryUsage();
+    Rad::Stopwatch sw;
+    sw.Start();
+    Rad::Unique<Rad::Renderer> renderer = Rad::Bench::BuildRenderer(cfg, p);
+    sw.Stop();
+    Rad::Bench::MemoryUsage after = Rad::Bench::QueryMemoryUsage();
+    constexpr double mb = 1024.0 * 1024.0;
+    logger->info("compress attributes: {}, preprocess: {}, build {} ms", isCompress, isPreprocess, sw.ElapsedMilliseconds());
+    logger->info(
+        "resident {:.2f} MB (scene {:.2f} MB), peak {:.2f} MB",
+        after.Current / mb, (after.Current - std::min(after.Current, before.Current)) / mb, after.Peak / mb);
+  });
+}
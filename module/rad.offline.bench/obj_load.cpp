@@ -0,0 +1,88 @@
+#include "bench_common.h"
+
+#include <rad/core/stop_watch.h>
+#include <rad/core/wavefront_obj_reader.h>
+
+#include <fstream>
+#include <random>
+
+/*
+ * .obj 读取基准测试
+ * 生成一个带 uv 和法线的网格平面, 分别用流逐行读取和内存映射并行读取, 输出各阶段耗时
+ * --file 指向已存在的文件时直接读取它, 不会删除
+ */
+
+static void WriteSyntheticObj(const std::filesystem::path& path, Rad::UInt32 side) {
+  std::ofstream obj(path, std::ios::binary);
+  if (!obj.is_open()) {
+    throw Rad::RadArgumentException("cannot open file: {}", path.string());
+  }
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<float> jitter(-0.01f, 0.01f);
+  float inv = 1.0f / (side - 1);
+  obj << "# synthetic grid " << side << "x" << side << "\n";
+  obj << "o grid\n";
+  for (Rad::UInt32 y = 0; y < side; y++) {
+    for (Rad::UInt32 x = 0; x < side; x++) {
+      obj << "v " << x * inv << " " << jitter(rng) << " " << y * inv << "\n";
+    }
+  }
+  for (Rad::UInt32 y = 0; y < side; y++) {
+    for (Rad::UInt32 x = 0; x < side; x++) {
+      obj << "vt " << x * inv << " " << y * inv << "\n";
+    }
+  }
+  obj << "vn 0 1 0\n";
+  for (Rad::UInt32 y = 0; y + 1 < side; y++) {
+    for (Rad::UInt32 x = 0; x + 1 < side; x++) {
+      Rad::UInt32 a = y * side + x + 1, b = a + 1, c = a + side, d = c + 1;
+      obj << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+      obj << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    Rad::UInt32 side = args.GetUInt("--side", 2048, 2);
+    std::filesystem::path path = args.Has("--file")
+                                     ? std::filesystem::path(args.GetString("--file"))
+                                     : std::filesystem::temp_directory_path() / "rad_bench_grid.obj";
+    bool isKeep = args.Has("--keep");
+    auto logger = Rad::Logger::Get();
+    Rad::Stopwatch sw;
+    bool isGenerated = !std::filesystem::exists(path);
+    if (isGenerated) {
+      sw.Start();
+      WriteSyntheticObj(path, side);
+      sw.Stop();
+      logger->info("write {} ({} ms)", path.string(), sw.ElapsedMilliseconds());
+    }
+    logger->info("file size {:.2f} MB", std::filesystem::file_size(path) / (1024.0 * 1024.0));
+    {
+      sw.Start();
+      Rad::WavefrontObjReader reader(std::make_unique<std::ifstream>(path, std::ios::binary));
+      reader.Read();
+      sw.Stop();
+      logger->info("stream read: {} ms, {} vertices, {} faces", sw.ElapsedMilliseconds(), reader.Positions().size(), reader.Faces().size());
+    }
+    {
+      sw.Start();
+      Rad::WavefrontObjReader reader(path);
+      reader.Read();
+      sw.Stop();
+      logger->info("mapped read: {} ms, {} vertices, {} faces", sw.ElapsedMilliseconds(), reader.Positions().size(), reader.Faces().size());
+      if (reader.HasError()) {
+        logger->warn("{}", reader.Error());
+      }
+      sw.Start();
+      Rad::TriangleModel model = reader.ToModel();
+      sw.Stop();
+      logger->info("to model: {} ms, {} vertices, {} triangles", sw.ElapsedMilliseconds(), model.VertexCount(), model.TriangleCount());
+    }
+    if (isGenerated && !isKeep) {
+      std::filesystem::remove(path);
+    }
+  });
+}
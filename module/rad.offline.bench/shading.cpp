@@ -0,0 +1,82 @@
+#include "bench_scene.h"
+
+#include <rad/core/stop_watch.h>
+#include <rad/offline/render/scene.h>
+#include <rad/offline/render/accel.h>
+#include <rad/offline/warp.h>
+
+#include <algorithm>
+#include <random>
+
+/*
+ * 着色数据读取基准测试
+ * 用固定种子的随机光线收集一组交点并打乱顺序, 再单线程对每个交点调用 ComputeInteraction
+ * 分别测试按顶点索引读取、压缩顶点属性和三角形记录三种布局, 输出每秒计算的交点数
+ */
+
+struct ShadingLayout {
+  const char* Name;
+  bool IsCompress;
+  bool IsTriangleRecord;
+};
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    std::string scenePath = args.GetString("--scene");
+    Rad::UInt32 hitCount = args.GetUInt("--hits", 1 << 21, 1);
+    Rad::UInt32 rounds = args.GetUInt("--rounds", 4, 1);
+    if (scenePath.empty()) {
+      throw Rad::RadArgumentException("should input cmd like \"--scene <scene.json> [--hits <count>] [--rounds <count>]\"");
+    }
+    std::filesystem::path p(scenePath);
+    nlohmann::json cfg = Rad::Bench::LoadSceneConfig(p);
+    auto logger = Rad::Logger::Get();
+    const ShadingLayout layouts[] = {
+        {"vertex", false, false},
+        {"compressed vertex", true, false},
+        {"triangle record", false, true}};
+    for (const ShadingLayout& layout : layouts) {
+      nlohmann::json sceneCfg = cfg;
+      Rad::Bench::SetMeshOptions(sceneCfg, {{"compress_attributes", layout.IsCompress}, {"triangle_records", layout.IsTriangleRecord}});
+      Rad::Unique<Rad::Renderer> renderer = Rad::Bench::BuildRenderer(sceneCfg, p);
+      const Rad::Accel& accel = renderer->GetScene().GetAccel();
+      //每种布局用同一个种子, 得到的交点完全相同
+      std::vector<std::pair<Rad::Ray, Rad::HitShapeRecord>> hits;
+      hits.reserve(hitCount);
+      Rad::BoundingBox3 bound = accel.GetWorldBound();
+      std::mt19937 rng(0);
+      std::uniform_real_distribution<Rad::Float> dist(0, 1);
+      for (size_t attempt = 0; hits.size() < hitCount && attempt < size_t(hitCount) * 16; attempt++) {
+        Rad::Ray ray;
+        Rad::Vector3 t(dist(rng), dist(rng), dist(rng));
+        ray.O = bound.min() + t.cwiseProduct(bound.sizes());
+        ray.D = Rad::Warp::SquareToUniformSphere(Rad::Vector2(dist(rng), dist(rng)));
+        ray.MinT = 0;
+        ray.MaxT = std::numeric_limits<Rad::Float>::infinity();
+        Rad::HitShapeRecord hsr;
+        if (accel.RayIntersectPreliminary(ray, hsr)) {
+          hits.emplace_back(ray, hsr);
+        }
+      }
+      if (hits.empty()) {
+        throw Rad::RadInvalidOperationException("no ray hits the scene");
+      }
+      std::shuffle(hits.begin(), hits.end(), rng);
+      Rad::Float checksum = 0;
+      Rad::Stopwatch sw;
+      sw.Start();
+      for (Rad::UInt32 r = 0; r < rounds; r++) {
+        for (const auto& [ray, hsr] : hits) {
+          Rad::SurfaceInteraction si = hsr.ComputeSurfaceInteraction(ray);
+          checksum += si.Shading.N.x() + si.UV.x();
+        }
+      }
+      sw.Stop();
+      double seconds = std::max(sw.ElapsedMilliseconds(), Rad::Int64(1)) / 1000.0;
+      logger->info(
+          "{:<20} {} hits x {} rounds: {:.2f} M interactions/s (checksum {:.3f})",
+          layout.Name, hits.size(), rounds, double(hits.size()) * rounds / seconds / 1e6, checksum);
+    }
+  });
+}
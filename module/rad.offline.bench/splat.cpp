@@ -0,0 +1,162 @@
+#include "bench_common.h"
+
+#include <rad/core/stop_watch.h>
+#include <rad/offline/pcg32.h>
+#include <rad/offline/render/splat_film.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+/*
+ * 溅射胶卷基准测试
+ * 模拟 BDPT 与粒子追踪把贡献溅射到任意像素: 每个线程分块领取溅射任务, 像素位置和值由固定种子生成
+ * thread 是改动前的做法: 每个线程一整张图, 每块开始时清零, 结束后加锁合并到累加图
+ * film 是现在的做法: 所有线程原子累加到同一个 SplatFilm
+ * 输出两种做法的耗时与进程常驻内存峰值. 峰值只增不减, 所以先运行占用小的 film
+ */
+
+using Rad::Float;
+using Rad::Int32;
+using Rad::Spectrum;
+using Rad::UInt32;
+using Rad::UInt64;
+
+struct SplatTask {
+  Int32 Width;
+  Int32 Height;
+  UInt64 SplatCount;
+  UInt64 ChunkSize;
+  UInt32 ThreadCount;
+};
+
+/**
+ * @brief 所有线程分块领取溅射, func(threadIndex, chunkBegin, chunkEnd) 处理一块
+ */
+template <typename Func>
+static void RunChunks(const SplatTask& task, Func&& func) {
+  std::atomic<UInt64> next{0};
+  std::vector<std::thread> threads;
+  for (UInt32 t = 0; t < task.ThreadCount; t++) {
+    threads.emplace_back([&, t]() {
+      while (true) {
+        UInt64 begin = next.fetch_add(task.ChunkSize);
+        if (begin >= task.SplatCount) {
+          break;
+        }
+        func(t, begin, std::min(begin + task.ChunkSize, task.SplatCount));
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/**
+ * @brief 第 index 个溅射的位置和值只由索引决定, 两种做法溅射的内容完全相同
+ */
+template <typename Func>
+static void ForEachSplat(const SplatTask& task, UInt64 begin, UInt64 end, Func&& func) {
+  Rad::Pcg32 rng;
+  rng.Seed(begin, 0);
+  for (UInt64 i = begin; i < end; i++) {
+    Int32 x = std::min(Int32(rng.NextFloat() * task.Width), task.Width - 1);
+    Int32 y = std::min(Int32(rng.NextFloat() * task.Height), task.Height - 1);
+    func(x, y, Spectrum(rng.NextFloat(), rng.NextFloat(), rng.NextFloat()));
+  }
+}
+
+struct SplatResult {
+  double Checksum;
+  size_t BufferSize;  //溅射用到的所有图像缓冲, 字节
+};
+
+static double Checksum(const Rad::MatrixX<Spectrum>& image) {
+  double sum = 0;
+  for (Eigen::Index i = 0; i < image.size(); i++) {
+    sum += image.coeff(i).sum();
+  }
+  return sum;
+}
+
+static SplatResult RunPerThread(const SplatTask& task) {
+  std::vector<Rad::Unique<Rad::MatrixX<Spectrum>>> tls(task.ThreadCount);
+  std::mutex mutex;
+  Rad::MatrixX<Spectrum> accumulate = Rad::MatrixX<Spectrum>::Constant(task.Width, task.Height, Spectrum(0));
+  RunChunks(task, [&](UInt32 t, UInt64 begin, UInt64 end) {
+    if (tls[t] == nullptr) {
+      tls[t] = std::make_unique<Rad::MatrixX<Spectrum>>(task.Width, task.Height);
+    }
+    Rad::MatrixX<Spectrum>& tempFb = *tls[t];
+    tempFb.setZero();
+    ForEachSplat(task, begin, end, [&](Int32 x, Int32 y, const Spectrum& v) {
+      tempFb(x, y) += v;
+    });
+    std::lock_guard<std::mutex> lock(mutex);
+    accumulate += tempFb;
+  });
+  //每个用到的线程一整张图, 再加一张累加图
+  size_t frameSize = size_t(accumulate.size()) * sizeof(Spectrum);
+  size_t bufferSize = frameSize;
+  for (const auto& fb : tls) {
+    bufferSize += fb == nullptr ? 0 : frameSize;
+  }
+  return {Checksum(accumulate), bufferSize};
+}
+
+static SplatResult RunSplatFilm(const SplatTask& task) {
+  Rad::SplatFilm film(task.Width, task.Height);
+  RunChunks(task, [&](UInt32, UInt64 begin, UInt64 end) {
+    ForEachSplat(task, begin, end, [&](Int32 x, Int32 y, const Spectrum& v) {
+      film.Add(x, y, v);
+    });
+  });
+  //直接读取胶卷, 不复制成矩阵, 峰值内存里只有胶卷本身
+  double checksum = 0;
+  for (Int32 y = 0; y < task.Height; y++) {
+    for (Int32 x = 0; x < task.Width; x++) {
+      checksum += film.Get(x, y).sum();
+    }
+  }
+  return {checksum, film.MemoryUsage()};
+}
+
+int main(int argc, char** argv) {
+  return Rad::Bench::RunBench([&]() {
+    Rad::Bench::BenchArgs args(argc, argv);
+    SplatTask task{};
+    task.Width = Int32(args.GetUInt("--width", 3840, 1));
+    task.Height = Int32(args.GetUInt("--height", 2160, 1));
+    task.ThreadCount = args.GetUInt("--threads", std::thread::hardware_concurrency(), 1);
+    //默认每个像素溅射一次, 每块相当于一个 64x64 的图块
+    task.SplatCount = args.Has("--splats") ? UInt64(args.GetUInt("--splats", 0, 1)) : UInt64(task.Width) * task.Height;
+    task.ChunkSize = args.GetUInt("--chunk", 64 * 64, 1);
+    std::string mode = args.GetString("--mode", "both");
+    if (mode != "both" && mode != "film" && mode != "thread") {
+      throw Rad::RadArgumentException("unknown mode: {}, should be both, film or thread", mode);
+    }
+    auto logger = Rad::Logger::Get();
+    logger->info(
+        "{}x{}, {} threads, {} splats in chunks of {}, {} bytes per float",
+        task.Width, task.Height, task.ThreadCount, task.SplatCount, task.ChunkSize, sizeof(Float));
+    logger->info("{:<12} {:>10} {:>16} {:>12} {:>16}", "scheme", "time ms", "buffer MB", "peak MB", "checksum");
+    constexpr double mb = 1024.0 * 1024.0;
+    auto run = [&](const char* name, auto&& func) {
+      Rad::Stopwatch sw;
+      sw.Start();
+      SplatResult result = func(task);
+      sw.Stop();
+      Rad::Bench::MemoryUsage usage = Rad::Bench::QueryMemoryUsage();
+      logger->info(
+          "{:<12} {:>10} {:>16.2f} {:>12.2f} {:>16.6e}",
+          name, sw.ElapsedMilliseconds(), result.BufferSize / mb, usage.Peak / mb, result.Checksum);
+    };
+    if (mode != "thread") {
+      run("film", RunSplatFilm);
+    }
+    if (mode != "film") {
+      run("thread", RunPerThread);
+    }
+  });
+}
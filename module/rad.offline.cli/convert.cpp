@@ -0,0 +1,58 @@
+#include "convert.h"
+
+#include <rad/core/logger.h>
+#include <rad/core/stop_watch.h>
+#include <rad/core/model_bin.h>
+#include <rad/core/wavefront_obj_reader.h>
+
+#include <filesystem>
+#include <fstream>
+
+namespace Rad {
+
+void ConvertObjToModelBin(const std::string& input, const std::string& output, bool isPreprocess) {
+  std::filesystem::path inPath(input);
+  std::filesystem::path outPath = output.empty() ? std::filesystem::path(inPath).replace_extension("radmesh") : std::filesystem::path(output);
+  Stopwatch sw;
+  sw.Start();
+  WavefrontObjReader reader(inPath);
+  reader.Read();
+  if (reader.HasError()) {
+    throw RadArgumentException("cannot parse {}: {}", input, reader.Error());
+  }
+  std::vector<TriangleModel> models;
+  models.reserve(reader.Objects().size() + 1);
+  models.emplace_back(reader.ToModel());
+  for (const auto& obj : reader.Objects()) {
+    models.emplace_back(reader.ToModel(obj.Name));
+  }
+  if (isPreprocess) {
+    Stopwatch psw;
+    psw.Start();
+    UInt32 vertexCount = models[0].VertexCount();
+    Float32 acmr = models[0].AverageCacheMissRatio();
+    for (TriangleModel& model : models) {
+      model = model.WeldVertices().ReorderForLocality();
+    }
+    psw.Stop();
+    Logger::Get()->info(
+        "preprocess: vertices {} -> {}, ACMR {:.3f} -> {:.3f} ({} ms)",
+        vertexCount, models[0].VertexCount(), acmr, models[0].AverageCacheMissRatio(), psw.ElapsedMilliseconds());
+  }
+  std::vector<std::pair<std::string, const TriangleModel*>> entries;
+  entries.emplace_back(std::string(), &models[0]);
+  for (size_t i = 0; i < reader.Objects().size(); i++) {
+    entries.emplace_back(reader.Objects()[i].Name, &models[i + 1]);
+  }
+  std::ofstream stream(outPath, std::ios::binary | std::ios::trunc);
+  if (!stream.is_open()) {
+    throw RadArgumentException("cannot open file: {}", outPath.string());
+  }
+  ModelBin::Write(stream, entries);
+  sw.Stop();
+  Logger::Get()->info(
+      "convert {} -> {}: {} vertices, {} triangles, {} sub models ({} ms)",
+      input, outPath.string(), models[0].VertexCount(), models[0].TriangleCount(), models.size() - 1, sw.ElapsedMilliseconds());
+}
+
+}  // namespace Rad
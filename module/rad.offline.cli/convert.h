@@ -0,0 +1,16 @@
+#pragma once
+
+#include <string>
+
+namespace Rad {
+
+/**
+ * @brief 把 .obj 模型转换成 model_bin 资产使用的二进制网格, 完整模型和每个子模型都会写入
+ *
+ * @param input .obj 文件
+ * @param output 输出文件, 为空时使用与输入同名的 .radmesh
+ * @param isPreprocess 是否合并重复顶点并按局部性重排, 处理过的模型渲染时直接使用
+ */
+void ConvertObjToModelBin(const std::string& input, const std::string& output, bool isPreprocess);
+
+}  // namespace Rad
@@ -0,0 +1,290 @@
+#include "distributed.h"
+
+#include <rad/core/logger.h>
+#include <rad/core/stop_watch.h>
+#include <rad/core/image_reader.h>
+#include <rad/core/location_resolver.h>
+#include <rad/core/console_progress_bar.h>
+#include <rad/offline/render/scene.h>
+#include <rad/offline/render/camera.h>
+#include <rad/offline/render/sampler.h>
+#include <rad/offline/render/checkpoint.h>
+
+#include <atomic>
+#include <cerrno>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(RAD_PLATFORM_WINDOWS)
+#include <windows.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char** environ;
+#endif
+
+namespace Rad {
+
+DistributedSplit ParseDistributedSplit(const std::string& name) {
+  if (name == "tile") {
+    return DistributedSplit::Tile;
+  } else if (name == "sample") {
+    return DistributedSplit::Sample;
+  } else {
+    throw RadArgumentException("unknown split mode: {}, should be tile or sample", name);
+  }
+}
+
+const char* DistributedSplitName(DistributedSplit split) {
+  switch (split) {
+    case DistributedSplit::Tile:
+      return "tile";
+    case DistributedSplit::Sample:
+      return "sample";
+    default:
+      return "unknown";
+  }
+}
+
+/**
+ * @brief 把 [begin, end) 尽量平均地分成 count 份, 返回第 index 份
+ */
+static std::pair<Int64, Int64> SplitRange(Int64 begin, Int64 end, Int32 index, Int32 count) {
+  Int64 length = end - begin;
+  return {begin + length * index / count, begin + length * (index + 1) / count};
+}
+
+void ApplyDistributedJob(Renderer& renderer, DistributedSplit split, Int32 job, Int32 jobCount) {
+  if (jobCount <= 0 || job < 0 || job >= jobCount) {
+    throw RadArgumentException("invalid job {} of {}", job, jobCount);
+  }
+  switch (split) {
+    case DistributedSplit::Tile: {
+      //在已有的 crop 内部按行切分, 每个条带都是完整的行, 便于合并
+      Vector2i min = renderer.CropMin();
+      Vector2i max = renderer.CropMax();
+      auto [rowBegin, rowEnd] = SplitRange(min.y(), max.y(), job, jobCount);
+      if (rowBegin >= rowEnd) {
+        throw RadArgumentException("too many jobs, crop only has {} rows", max.y() - min.y());
+      }
+      renderer.SetCrop(Vector2i(min.x(), Int32(rowBegin)), Vector2i(max.x(), Int32(rowEnd)));
+      break;
+    }
+    case DistributedSplit::Sample: {
+      UInt32 spp = renderer.GetScene().GetCamera().GetSampler().SampleCount();
+      auto [sampleBegin, sampleEnd] = SplitRange(0, spp, job, jobCount);
+      if (sampleBegin >= sampleEnd) {
+        throw RadArgumentException("too many jobs, sampler only has {} samples per pixel", spp);
+      }
+      renderer.SetSampleRange(UInt32(sampleBegin), UInt32(sampleEnd));
+      break;
+    }
+  }
+}
+
+#if defined(RAD_PLATFORM_WINDOWS)
+/**
+ * @brief 按 CommandLineToArgvW 的规则转义一个参数
+ * 引号前的反斜杠要翻倍, 参数末尾的反斜杠也要翻倍, 否则会把结尾的引号转义掉
+ */
+static void AppendWindowsArgument(std::wstring& cmd, const std::wstring& arg) {
+  if (!cmd.empty()) {
+    cmd.push_back(L' ');
+  }
+  if (!arg.empty() && arg.find_first_of(L" \t\n\v\"") == std::wstring::npos) {
+    cmd.append(arg);
+    return;
+  }
+  cmd.push_back(L'"');
+  for (auto it = arg.begin();; ++it) {
+    size_t backslash = 0;
+    while (it != arg.end() && *it == L'\\') {
+      ++it;
+      ++backslash;
+    }
+    if (it == arg.end()) {
+      cmd.append(backslash * 2, L'\\');
+      break;
+    } else if (*it == L'"') {
+      cmd.append(backslash * 2 + 1, L'\\');
+      cmd.push_back(*it);
+    } else {
+      cmd.append(backslash, L'\\');
+      cmd.push_back(*it);
+    }
+  }
+  cmd.push_back(L'"');
+}
+#endif
+
+/**
+ * @brief 直接用参数数组启动子进程并等待它结束, 不经过 shell, 路径里的引号或 shell 元字符不会被解释
+ * @return 子进程的退出码, 无法启动时返回 -1
+ */
+static int RunProcess(const std::vector<std::string>& args) {
+#if defined(RAD_PLATFORM_WINDOWS)
+  std::wstring cmd;
+  for (auto&& arg : args) {
+    AppendWindowsArgument(cmd, std::filesystem::u8path(arg).wstring());
+  }
+  STARTUPINFOW si{};
+  si.cb = sizeof(si);
+  PROCESS_INFORMATION pi{};
+  if (!CreateProcessW(nullptr, cmd.data(), nullptr, nullptr, FALSE, 0, nullptr, nullptr, &si, &pi)) {
+    return -1;
+  }
+  WaitForSingleObject(pi.hProcess, INFINITE);
+  DWORD code = 0;
+  if (!GetExitCodeProcess(pi.hProcess, &code)) {
+    code = DWORD(-1);
+  }
+  CloseHandle(pi.hThread);
+  CloseHandle(pi.hProcess);
+  return int(code);
+#else
+  std::vector<char*> argv;
+  argv.reserve(args.size() + 1);
+  for (auto&& arg : args) {
+    argv.emplace_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.emplace_back(nullptr);
+  pid_t pid;
+  //posix_spawnp 在路径不带 / 时会查找 PATH, 与 shell 启动的行为一致
+  if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) {
+    return -1;
+  }
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      return -1;
+    }
+  }
+  if (WIFEXITED(status)) {
+    return WEXITSTATUS(status);
+  }
+  return WIFSIGNALED(status) ? 128 + WTERMSIG(status) : -1;
+#endif
+}
+
+static std::filesystem::path PartialResultPath(const DistributedOptions& opts, Int32 job) {
+  return opts.WorkDirectory / fmt::format("{}_part{}.radckpt", opts.SaveName, job);
+}
+
+/**
+ * @brief 删除所有任务的中间结果, 合并完成或者有任务失败时都要清理, 不然工作目录里会残留大量 radckpt
+ */
+static void RemovePartialResults(const DistributedOptions& opts) {
+  for (Int32 job = 0; job < opts.JobCount; job++) {
+    std::error_code ec;
+    std::filesystem::remove(PartialResultPath(opts, job), ec);
+  }
+}
+
+/**
+ * @brief 把所有任务的未归一化累加值逐像素相加
+ */
+static void MergePartialResults(const DistributedOptions& opts, MatrixX<Spectrum>& accumulate, MatrixX<UInt32>& weights) {
+  for (Int32 job = 0; job < opts.JobCount; job++) {
+    std::filesystem::path path = PartialResultPath(opts, job);
+    RenderCheckpoint part = RenderCheckpoint::Read(path);
+    if (part.SceneHash != opts.SceneHash) {
+      throw RadInvalidOperationException("partial result {} does not belong to current scene", path.u8string());
+    }
+    if (job == 0) {
+      accumulate = std::move(part.Accumulate);
+      weights = std::move(part.SampleCounts);
+    } else {
+      if (part.Accumulate.rows() != accumulate.rows() || part.Accumulate.cols() != accumulate.cols()) {
+        throw RadInvalidOperationException("partial result {} resolution mismatch", path.u8string());
+      }
+      for (Int64 i = 0; i < accumulate.size(); i++) {
+        accumulate.coeffRef(i) = Spectrum(accumulate.coeff(i) + part.Accumulate.coeff(i));
+      }
+      weights += part.SampleCounts;
+    }
+  }
+}
+
+void RunCoordinator(const DistributedOptions& opts) {
+  auto logger = Logger::GetCategory("coordinator");
+  if (opts.WorkerCount <= 0 || opts.JobCount <= 0) {
+    throw RadArgumentException("worker count {} and job count {} should be positive", opts.WorkerCount, opts.JobCount);
+  }
+  Int32 workerCount = std::min(opts.WorkerCount, opts.JobCount);
+  logger->info("start {} workers for {} {} jobs", workerCount, opts.JobCount, DistributedSplitName(opts.Split));
+  Stopwatch sw{};
+  sw.Start();
+  std::atomic_int32_t nextJob = 0;
+  std::atomic_int32_t completeJob = 0;
+  std::atomic_int32_t failJob = 0;
+  std::mutex failMutex;
+  std::vector<std::string> failures;
+  std::vector<std::thread> workers;
+  for (Int32 w = 0; w < workerCount; w++) {
+    workers.emplace_back([&, w]() {
+      //每个线程代表一个工作进程槽位, 一个任务结束后立刻领取下一个, 快的槽位会多做几个任务
+      for (Int32 job = nextJob++; job < opts.JobCount; job = nextJob++) {
+        std::vector<std::string> args{
+            opts.Executable.u8string(),
+            "--scene", opts.ScenePath.u8string(),
+            "--worker-job", std::to_string(job),
+            "--jobs", std::to_string(opts.JobCount),
+            "--split", DistributedSplitName(opts.Split),
+            "--partial", PartialResultPath(opts, job).u8string()};
+        int code = RunProcess(args);
+        if (code != 0) {
+          std::lock_guard<std::mutex> lock(failMutex);
+          failures.emplace_back(fmt::format("job {} on worker {} exit with code {}", job, w, code));
+          failJob++;
+        } else {
+          completeJob++;
+        }
+      }
+    });
+  }
+  std::thread barThread([&]() {
+    ConsoleProgressBar bar{};
+    while (completeJob + failJob < opts.JobCount) {
+      bar.Draw(sw.ElapsedMilliseconds(), opts.JobCount, completeJob);
+      std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+    std::cout << std::endl;
+  });
+  for (auto&& t : workers) {
+    t.join();
+  }
+  barThread.join();
+  if (!failures.empty()) {
+    for (auto&& f : failures) {
+      logger->error("{}", f);
+    }
+    RemovePartialResults(opts);
+    throw RadInvalidOperationException("{} of {} jobs failed", failures.size(), opts.JobCount);
+  }
+  MatrixX<Spectrum> accumulate;
+  MatrixX<UInt32> weights;
+  try {
+    MergePartialResults(opts, accumulate, weights);
+  } catch (...) {
+    RemovePartialResults(opts);
+    throw;
+  }
+  RemovePartialResults(opts);
+  MatrixX<Color24f> result(accumulate.rows(), accumulate.cols());
+  for (Int64 i = 0; i < result.size(); i++) {
+    UInt32 n = weights.coeff(i);
+    Spectrum v = n == 0 ? Spectrum(0) : Spectrum(accumulate.coeff(i) / Float(n));
+    result.coeffRef(i) = v.cast<Float32>();
+  }
+  LocationResolver resolver(opts.WorkDirectory);
+  resolver.SetSaveName(opts.SaveName);
+  auto saveName = resolver.GetSaveName("exr");
+  auto stream = resolver.WriteStream(saveName, std::ios::binary | std::ios::out);
+  ImageReader::WriteExr(*stream, result);
+  sw.Stop();
+  logger->info("merge {} partial results to: {}", opts.JobCount, (resolver.GetWorkDirectory() / saveName).u8string());
+  logger->info("done. render used time: {} ms", sw.ElapsedMilliseconds());
+}
+
+}  // namespace Rad
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <rad/core/types.h>
+#include <rad/offline/render/renderer.h>
+
+#include <filesystem>
+#include <string>
+
+namespace Rad {
+
+/**
+ * @brief 分布式渲染时如何把一帧拆成多个任务
+ */
+enum class DistributedSplit {
+  Tile,   //按行把渲染区域切成多个条带, 所有渲染器都支持
+  Sample  //把每个像素的样本索引切成多个区间, 只有 SampleRenderer 支持
+};
+
+DistributedSplit ParseDistributedSplit(const std::string& name);
+const char* DistributedSplitName(DistributedSplit split);
+
+/**
+ * @brief 工作进程领取第 job 个任务 (共 jobCount 个), 把渲染器限制在任务对应的区域或样本区间
+ */
+void ApplyDistributedJob(Renderer& renderer, DistributedSplit split, Int32 job, Int32 jobCount);
+
+struct DistributedOptions {
+  std::filesystem::path Executable;  //工作进程的可执行文件, 就是当前程序
+  std::filesystem::path ScenePath;
+  std::filesystem::path WorkDirectory;
+  std::string SaveName;
+  UInt64 SceneHash{0};
+  Int32 WorkerCount{1};
+  Int32 JobCount{1};
+  DistributedSplit Split{DistributedSplit::Tile};
+};
+
+/**
+ * @brief 协调者: 在本机启动 WorkerCount 个工作进程, 把 JobCount 个任务依次分给空闲的进程
+ * 每个任务结束后工作进程把未归一化的累加值写到工作目录, 全部完成后逐像素相加合并成最终的exr
+ * 样本只由 (种子, 像素, 样本索引) 决定, 所以合并结果与单进程渲染一致
+ */
+void RunCoordinator(const DistributedOptions& opts);
+
+}  // namespace Rad
@@ -5,67 +5,163 @@
 #include <rad/offline/build/build_context.h>
 #include <rad/offline/render/renderer.h>
 
+#include "convert.h"
+#include "distributed.h"
+
 int main(int argc, char** argv) {
   Rad::RadCoreInit();
+  int exitCode = 0;
   try {
     Rad::Unique<Rad::LocationResolver> resolver;
     Rad::Unique<Rad::Renderer> renderer;
+    //分布式渲染: 协调者带有 --workers, 它启动的工作进程带有 --worker-job 与 --partial
+    bool isCoordinator = false;
+    bool isWorker = false;
+    Rad::UInt64 sceneHash = 0;
+    std::string partialPath;
     {
       std::string scenePath;
+      std::string resumePath;
+      Rad::Int32 workerCount = 0;
+      Rad::Int32 jobCount = 0;
+      Rad::Int32 workerJob = -1;
+      Rad::DistributedSplit split = Rad::DistributedSplit::Tile;
+      std::string convertPath;
+      std::string outputPath;
+      bool isPreprocess = true;
       for (int i = 0; i < argc;) {
         std::string cmd(argv[i]);
-        if (cmd == "--scene") {
+        if (cmd == "--scene" && i + 1 < argc) {
           scenePath = std::string(argv[i + 1]);
           i += 2;
+        } else if (cmd == "--resume" && i + 1 < argc) {
+          resumePath = std::string(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--workers" && i + 1 < argc) {
+          workerCount = std::stoi(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--jobs" && i + 1 < argc) {
+          jobCount = std::stoi(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--split" && i + 1 < argc) {
+          split = Rad::ParseDistributedSplit(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--worker-job" && i + 1 < argc) {
+          workerJob = std::stoi(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--partial" && i + 1 < argc) {
+          partialPath = std::string(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--convert-obj" && i + 1 < argc) {
+          convertPath = std::string(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--output" && i + 1 < argc) {
+          outputPath = std::string(argv[i + 1]);
+          i += 2;
+        } else if (cmd == "--no-preprocess") {
+          isPreprocess = false;
+          i++;
         } else {
           i++;
         }
       }
-      if (scenePath.empty()) {
-        throw Rad::RadArgumentException("should input cmd like \"--scene <scene.json>\"");
-      }
-      std::filesystem::path p(scenePath);
-      if (!std::filesystem::exists(p)) {
-        std::filesystem::path work = std::filesystem::current_path() / p;
-        if (!std::filesystem::exists(work)) {
-          throw Rad::RadArgumentException("cannot open file: {}", scenePath);
+      if (!convertPath.empty()) {
+        //只转换模型格式, 不渲染
+        Rad::ConvertObjToModelBin(convertPath, outputPath, isPreprocess);
+      } else {
+        if (scenePath.empty()) {
+          throw Rad::RadArgumentException(
+              "should input cmd like \"--scene <scene.json> [--resume <checkpoint>] "
+              "[--workers <count> [--jobs <count>] [--split tile|sample]]\" "
+              "or \"--convert-obj <model.obj> [--output <model.radmesh>] [--no-preprocess]\"");
         }
-        p = work;
-      }
-      nlohmann::json cfg;
-      {
-        std::ifstream cfgStream(p);
-        if (!cfgStream.is_open()) {
-          throw Rad::RadArgumentException("cannot open file: {}", scenePath);
+        std::filesystem::path p(scenePath);
+        if (!std::filesystem::exists(p)) {
+          std::filesystem::path work = std::filesystem::current_path() / p;
+          if (!std::filesystem::exists(work)) {
+            throw Rad::RadArgumentException("cannot open file: {}", scenePath);
+          }
+          p = work;
+        }
+        nlohmann::json cfg;
+        {
+          std::ifstream cfgStream(p);
+          if (!cfgStream.is_open()) {
+            throw Rad::RadArgumentException("cannot open file: {}", scenePath);
+          }
+          cfg = nlohmann::json::parse(cfgStream);
+        }
+        sceneHash = Rad::RenderCheckpoint::HashSceneConfig(cfg);
+        isCoordinator = workerCount > 0;
+        isWorker = !isCoordinator && workerJob >= 0;
+        if (isCoordinator) {
+          Rad::DistributedOptions opts;
+          opts.Executable = std::filesystem::path(argv[0]);
+          if (opts.Executable.has_parent_path()) {
+            opts.Executable = std::filesystem::absolute(opts.Executable);
+          }
+          opts.ScenePath = std::filesystem::absolute(p);
+          opts.WorkDirectory = opts.ScenePath.parent_path();
+          opts.SaveName = p.filename().replace_extension().string();
+          opts.SceneHash = sceneHash;
+          opts.WorkerCount = workerCount;
+          opts.JobCount = jobCount > 0 ? jobCount : workerCount;
+          opts.Split = split;
+          Rad::RunCoordinator(opts);
+        } else {
+          Rad::BuildContext ctx{};
+          ctx.SetFromJson(cfg);
+          ctx.SetDefaultFactoryManager();
+          ctx.SetDefaultAssetManager(p.parent_path().string());
+          renderer = ctx.Build();
+          resolver = std::make_unique<Rad::LocationResolver>(ctx.GetAssetManager().GetLocationResolver());
+          resolver->SetSaveName(p.filename().replace_extension().string());
+          if (isWorker) {
+            if (partialPath.empty()) {
+              throw Rad::RadArgumentException("worker should input \"--partial <path>\"");
+            }
+            Rad::ApplyDistributedJob(*renderer, split, workerJob, jobCount);
+          } else {
+            //渲染器配置了 checkpoint_interval_ms 时才会真正写检查点
+            renderer->SetCheckpoint(resolver->GetWorkDirectory() / resolver->GetSaveName("checkpoint", "radckpt"), sceneHash);
+            if (!resumePath.empty()) {
+              renderer->Resume(resumePath, sceneHash);
+            }
+          }
         }
-        cfg = nlohmann::json::parse(cfgStream);
       }
-      Rad::BuildContext ctx{};
-      ctx.SetFromJson(cfg);
-      ctx.SetDefaultFactoryManager();
-      ctx.SetDefaultAssetManager(p.parent_path().string());
-      renderer = ctx.Build();
-      resolver = std::make_unique<Rad::LocationResolver>(ctx.GetAssetManager().GetLocationResolver());
-      resolver->SetSaveName(p.filename().replace_extension().string());
     }
-    Rad::Logger::Get()->info("start rendering...");
-    std::thread barThread([&renderer]() {
-      Rad::ConsoleProgressBar bar{};
-      while (!renderer->IsComplete()) {
-        bar.Draw(renderer->ElapsedTime(), renderer->AllTaskCount(), renderer->CompletedTaskCount());
-        std::this_thread::sleep_for(std::chrono::seconds(1));
-      }
-      std::cout << std::endl;
-    });
-    renderer->Start();
-    renderer->Wait();
-    renderer->SaveResult(*resolver);
-    barThread.join();
-    Rad::Logger::Get()->info("done. render used time: {} ms", renderer->ElapsedTime());
+    if (isWorker) {
+      //工作进程与协调者共用一个控制台, 不画进度条, 结果交给协调者合并
+      renderer->Start();
+      renderer->Wait();
+      Rad::RenderCheckpoint part;
+      renderer->GetPartialResult(part);
+      part.SceneHash = sceneHash;
+      Rad::RenderCheckpoint::Write(partialPath, part);
+    } else if (!isCoordinator && renderer != nullptr) {
+      Rad::Logger::Get()->info("start rendering...");
+      std::thread barThread([&renderer]() {
+        Rad::ConsoleProgressBar bar{};
+        while (!renderer->IsComplete()) {
+          bar.Draw(renderer->ElapsedTime(), renderer->AllTaskCount(), renderer->CompletedTaskCount());
+          std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+        std::cout << std::endl;
+      });
+      renderer->Start();
+      renderer->Wait();
+      renderer->SaveResult(*resolver);
+      barThread.join();
+      Rad::Logger::Get()->info("done. render used time: {} ms", renderer->ElapsedTime());
+    }
   } catch (const std::exception& e) {
     Rad::Logger::Get()->error("unhandled exception: {}", e.what());
+    exitCode = 1;
   } catch (...) {
     Rad::Logger::Get()->error("unknown exception");
+    exitCode = 1;
   }
   Rad::RadCoreShutdown();
+  return exitCode;
 }
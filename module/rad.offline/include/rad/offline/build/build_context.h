@@ -6,6 +6,9 @@
 #include <rad/offline/fwd.h>
 #include <rad/offline/types.h>
 
+#include <functional>
+#include <mutex>
+
 namespace Rad {
 
 class RadLoadAssetFailException : public RadException {
@@ -40,8 +43,30 @@ class RAD_EXPORT_API BuildContext {
 
   //建造
   Unique<Renderer> Build();
+  /**
+   * @brief 场景里有多少个 mesh 实体引用了这个模型, sub_model 为空表示整个模型. 在 Build 开始时统计
+   */
+  UInt32 GetMeshReferenceCount(const std::string& assetName, const std::string& subModel) const;
+  /**
+   * @brief 同一份顶点属性只压缩一次, 引用它的所有网格共享压缩结果. 可以在多个线程同时调用
+   *
+   * @param source 压缩前的数组, 作为查找的标识. 上下文会持有它, 避免释放后地址被其他数组重用
+   * @param pack 没有找到时调用它压缩, 调用时不持有锁
+   */
+  Share<UInt32[]> GetPackedAttribute(Share<const void> source, const std::function<Share<UInt32[]>()>& pack);
+  /**
+   * @brief 合并重复顶点并按空间局部性重排后的模型, 每个模型只处理一次. 可以在多个线程同时调用
+   * 处理时会复制整个模型, 网格的 preprocess 默认开启, 离线处理过的模型不会再经过这里
+   */
+  Share<TriangleModel> GetPreprocessedModel(const Share<TriangleModel>& model);
+  /**
+   * @brief 与 GetPackedAttribute 相同, 缓存的是网格的三角形记录
+   */
+  Share<MeshTriangleRecord[]> GetTriangleRecords(Share<const void> source, const std::function<Share<MeshTriangleRecord[]>()>& build);
 
  private:
+  void CountMeshReference(const ConfigNode& entityNode);
+
   AssetManager* _assetMngr{nullptr};
   FactoryManager* _factoryMngr{nullptr};
 
@@ -55,6 +80,13 @@ class RAD_EXPORT_API BuildContext {
   ConfigNode _rendererNode{};
   Unique<AssetManager> _defaultAssetMngr;
   Unique<FactoryManager> _defaultFactoryMngr;
+  std::map<std::pair<std::string, std::string>, UInt32> _meshRefCount;
+  std::map<const void*, std::pair<Share<const void>, Share<UInt32[]>>> _packedAttributes;
+  std::mutex _packedMutex;
+  std::map<const TriangleModel*, std::pair<Share<TriangleModel>, Share<TriangleModel>>> _preprocessedModels;
+  std::mutex _preprocessMutex;
+  std::map<const void*, std::pair<Share<const void>, Share<MeshTriangleRecord[]>>> _triangleRecords;
+  std::mutex _recordMutex;
 };
 
 }  // namespace Rad
@@ -16,6 +16,10 @@ class DiscreteDistribution1D {
   DiscreteDistribution1D() = default;
   DiscreteDistribution1D(const std::vector<Float>& data);
   DiscreteDistribution1D(const Float* data, size_t size);
+  /**
+   * @brief 直接接管数据, 不再复制一份
+   */
+  DiscreteDistribution1D(std::vector<Float>&& data);
 
   /**
    * @brief 随机变量总和
@@ -52,6 +56,8 @@ class DiscreteDistribution1D {
   std::pair<size_t, Float> SampleReuse(Float xi) const;
 
  private:
+  void BuildCdf();
+
   /**
    * @brief 概率质量函数
    */
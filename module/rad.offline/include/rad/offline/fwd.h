@@ -13,6 +13,7 @@ class Sampler;
 class Accel;
 class Renderer;
 class Scene;
+struct MeshTriangleRecord;
 class Volume;
 
 class TextureBase;
@@ -141,4 +141,62 @@ inline Float ErfInv(Float a) {
   return a * p;
 }
 
+/**
+ * @brief 八面体映射解码, 见 EncodeOctahedral
+ */
+inline Vector3 DecodeOctahedral(UInt32 packed) {
+  Float x = std::max(Float(Int16(packed & 0xffff)) / Float(32767), Float(-1));
+  Float y = std::max(Float(Int16(packed >> 16)) / Float(32767), Float(-1));
+  Vector3 n(x, y, 1 - std::abs(x) - std::abs(y));
+  Float t = std::max(-n.z(), Float(0));
+  n.x() += n.x() >= 0 ? -t : t;
+  n.y() += n.y() >= 0 ? -t : t;
+  return n.normalized();
+}
+/**
+ * @brief 八面体映射: 单位向量投影到八面体上再展开成正方形, 用两个16位定点数保存
+ * 量化时尝试相邻的四个格点, 选出解码后与原向量最接近的那个
+ * https://jcgt.org/published/0003/02/01/
+ */
+inline UInt32 EncodeOctahedral(const Eigen::Vector3f& n) {
+  float l1 = std::abs(n.x()) + std::abs(n.y()) + std::abs(n.z());
+  if (!(l1 > 0)) {
+    return 32767u << 16;  //退化的法线随便给一个方向 (0,1,0)
+  }
+  float px = n.x() / l1, py = n.y() / l1;
+  if (n.z() < 0) {
+    float ox = (1 - std::abs(py)) * (px >= 0 ? 1.f : -1.f);
+    float oy = (1 - std::abs(px)) * (py >= 0 ? 1.f : -1.f);
+    px = ox;
+    py = oy;
+  }
+  float fx = std::floor(std::clamp(px, -1.f, 1.f) * 32767), fy = std::floor(std::clamp(py, -1.f, 1.f) * 32767);
+  Vector3 ref = n.cast<Float>().normalized();
+  UInt32 best = 0;
+  Float bestDot = -2;
+  for (Int32 i = 0; i < 4; i++) {
+    Int32 qx = std::min(Int32(fx) + (i & 1), 32767), qy = std::min(Int32(fy) + (i >> 1), 32767);
+    UInt32 packed = UInt32(UInt16(Int16(qx))) | (UInt32(UInt16(Int16(qy))) << 16);
+    Float d = DecodeOctahedral(packed).dot(ref);
+    if (d > bestDot) {
+      bestDot = d;
+      best = packed;
+    }
+  }
+  return best;
+}
+/**
+ * @brief 两个 float 转成半精度浮点数打包进一个32位整数
+ */
+inline UInt32 PackHalf2(const Eigen::Vector2f& v) {
+  UInt16 x = Eigen::numext::bit_cast<UInt16>(Eigen::half(v.x()));
+  UInt16 y = Eigen::numext::bit_cast<UInt16>(Eigen::half(v.y()));
+  return UInt32(x) | (UInt32(y) << 16);
+}
+inline Vector2 UnpackHalf2(UInt32 packed) {
+  Eigen::half x = Eigen::numext::bit_cast<Eigen::half>(UInt16(packed & 0xffff));
+  Eigen::half y = Eigen::numext::bit_cast<Eigen::half>(UInt16(packed >> 16));
+  return Vector2(Float(float(x)), Float(float(y)));
+}
+
 }  // namespace Rad::Math
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "math_ext.h"
+
+namespace Rad {
+
+/**
+ * @brief PCG32 随机数发生器, 只有16字节的状态
+ * https://www.pcg-random.org/
+ */
+class Pcg32 {
+ public:
+  static constexpr UInt64 Mult = 0x5851f42d4c957f2d;
+
+  void Seed(UInt64 seqIndex, UInt64 offset) {
+    _state = 0;
+    _inc = (seqIndex << 1) | 1;
+    NextUInt32();
+    _state += offset;
+    NextUInt32();
+  }
+
+  UInt32 NextUInt32() {
+    UInt64 old = _state;
+    _state = old * Mult + _inc;
+    UInt32 xorShifted = UInt32(((old >> 18) ^ old) >> 27);
+    UInt32 rot = UInt32(old >> 59);
+    return (xorShifted >> rot) | (xorShifted << ((~rot + 1) & 31));
+  }
+
+  Float NextFloat() {
+    return std::min(Float(NextUInt32()) * Float(0x1p-32), Math::OneMinusEpsilon<Float>());
+  }
+
+  /**
+   * @brief 在 O(log delta) 时间内跳过 delta 个随机数
+   */
+  void Advance(UInt64 delta) {
+    UInt64 curMult = Mult, curPlus = _inc, accMult = 1, accPlus = 0;
+    while (delta > 0) {
+      if (delta & 1) {
+        accMult *= curMult;
+        accPlus = accPlus * curMult + curPlus;
+      }
+      curPlus = (curMult + 1) * curPlus;
+      curMult *= curMult;
+      delta /= 2;
+    }
+    _state = accMult * _state + accPlus;
+  }
+
+ private:
+  UInt64 _state{0x853c49e6748fea9b};
+  UInt64 _inc{0xda3e39cb94b95bdb};
+};
+
+}  // namespace Rad
@@ -15,6 +15,14 @@ class RAD_EXPORT_API Accel {
    * @brief 获取整个世界的包围盒
    */
   virtual BoundingBox3 GetWorldBound() const = 0;
+  /**
+   * @brief 构建加速结构花费的时间, 毫秒
+   */
+  Int64 BuildTime() const { return _buildTime; }
+  /**
+   * @brief 加速结构占用的内存, 字节. 不包括形状自己的数据
+   */
+  virtual size_t MemoryUsage() const { return 0; }
 
   /**
    * @brief shadow ray, 检查射线是否与场景中任何一个 shape 有交点
@@ -27,6 +35,31 @@ class RAD_EXPORT_API Accel {
    * @param hsr [out] 返回最近的物体的求交数据
    */
   virtual bool RayIntersectPreliminary(const Ray& ray, HitShapeRecord& hsr) const = 0;
+
+  /**
+   * @brief 批量 shadow ray, 结果与逐条调用 RayIntersect 相同
+   * 默认实现逐条求交, 加速结构可以用流式的求交内核覆盖它
+   *
+   * @param isHit [out] 每条光线是否有交点, 长度为 count
+   */
+  virtual void RayIntersect(const Ray* rays, UInt8* isHit, UInt32 count) const;
+  /**
+   * @brief 批量光线求交, 结果与逐条调用 RayIntersectPreliminary 相同
+   *
+   * @param hsrs [out] 每条光线最近的求交数据, 长度为 count
+   * @param isHit [out] 每条光线是否有交点, 长度为 count
+   */
+  virtual void RayIntersectPreliminary(const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit, UInt32 count) const;
+
+  /**
+   * @brief 包求交, 一次求交 width 条相干的光线, 比如相邻像素的相机光线. width 只能是 4、8 或 16
+   * valid 为0的光线不参与求交, 对应的 isHit 也是0. 默认实现逐条求交
+   */
+  virtual void RayIntersectPacket(UInt32 width, const Int32* valid, const Ray* rays, UInt8* isHit) const;
+  virtual void RayIntersectPreliminaryPacket(UInt32 width, const Int32* valid, const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit) const;
+
+ protected:
+  Int64 _buildTime{0};
 };
 
 }  // namespace Rad
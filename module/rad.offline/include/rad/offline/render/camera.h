@@ -26,7 +26,10 @@ class RAD_EXPORT_API Camera {
   /**
    * @brief 挂载一个采样器到相机上, 采样器的生命周期由相机管理
    */
-  void AttachSampler(Unique<Sampler> sampler) { _sampler = std::move(sampler); }
+  void AttachSampler(Unique<Sampler> sampler) {
+    _sampler = std::move(sampler);
+    _sampler->SetResolution(_resolution);
+  }
   const Sampler& GetSampler() const { return *_sampler; }
 
   /**
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <rad/core/config_node.h>
+#include <rad/offline/fwd.h>
+#include <rad/offline/types.h>
+#include <rad/offline/spectrum.h>
+
+#include <filesystem>
+
+namespace Rad {
+
+/**
+ * @brief 渲染检查点, 保存继续渲染所需的全部累加状态
+ * 样本只由 (种子, 像素, 样本索引, 维度) 决定, 所以采样器的状态就是种子与每个像素已完成的样本数
+ */
+struct RAD_EXPORT_API RenderCheckpoint {
+  UInt64 SceneHash{0};
+  UInt32 Seed{0};
+  UInt32 Pass{0};                 //已经完成的轮次
+  UInt64 TotalSampleCount{0};     //已经完成的样本总数, 粒子追踪用它记录粒子数
+  Int64 ElapsedTime{0};           //已经用掉的渲染时间, 毫秒
+  MatrixX<Spectrum> Accumulate;   //未归一化的累加值
+  MatrixX<UInt32> SampleCounts;   //每个像素已经完成的样本数
+  MatrixX<Float> LumMean;         //自适应采样的状态, 没有开启时为空
+  MatrixX<Float> LumM2;
+  MatrixX<UInt8> IsConverged;
+
+  /**
+   * @brief 先写到同目录的临时文件再重命名, 写到一半崩溃也不会破坏已有的检查点
+   */
+  static void Write(const std::filesystem::path& path, const RenderCheckpoint& ckpt);
+  static RenderCheckpoint Read(const std::filesystem::path& path);
+  /**
+   * @brief 场景配置的哈希, 用来确认检查点属于同一个场景
+   * 时间预算与检查点间隔不影响渲染结果, 不参与计算, 恢复时可以修改它们
+   */
+  static UInt64 HashSceneConfig(const nlohmann::json& cfg);
+};
+
+}  // namespace Rad
@@ -4,6 +4,18 @@
 
 namespace Rad {
 
+/**
+ * @brief 一个三角形着色时需要的全部顶点数据, 连续存放并按缓存行对齐, 求交后只需要读一条缓存行
+ * 法线与 uv 的编码和 compress_attributes 相同
+ */
+struct alignas(64) MeshTriangleRecord {
+  Eigen::Vector3f Position[3];
+  UInt32 Normal[3];
+  UInt32 UV[3];
+  UInt32 Flags;  //第0位表示有顶点法线, 第1位表示有顶点uv
+};
+static_assert(sizeof(MeshTriangleRecord) == 64, "triangle record must fill exactly one cache line");
+
 /**
  * @brief 三角形网格
  * 求交工作交给Embree了, 不过还是写一下原理
@@ -47,20 +59,77 @@ class RAD_EXPORT_API MeshBase : public Shape {
   PositionSampleResult SamplePosition(const Vector2& xi) const override;
   Float PdfPosition(const PositionSampleResult& psr) const override;
 
+  const void* GetInstanceKey() const override;
+  const Transform* GetInstanceTransform() const override;
+
+  UInt32 GetPrimitiveCount() const override { return _triangleCount; }
+  BoundingBox3 GetPrimitiveBound(UInt32 index) const override;
+  bool IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const override;
+  /**
+   * @brief 第 index 个三角形在世界空间的三个顶点
+   */
+  void GetWorldTriangle(UInt32 index, Vector3& p0, Vector3& p1, Vector3& p2) const;
+
   static Float TriangleArea(const Vector3& p0, const Vector3& p1, const Vector3& p2);
 
  protected:
+  /**
+   * @brief 着色用的一个三角形, 所有数据都在世界空间
+   */
+  struct ShadingTriangle {
+    Vector3 P[3];
+    Vector3 N[3];
+    Vector2 UV[3];
+    bool HasNormal;
+    bool HasUV;
+  };
+
   void UpdateDistibution();
+  /**
+   * @brief 取出第 index 个三角形着色需要的数据, 有三角形记录时只读记录
+   */
+  void FetchShadingTriangle(UInt32 index, ShadingTriangle& tri) const;
+  /**
+   * @brief 世界空间的顶点数据. 实例化时顶点保存在物体空间, 取出时再变换
+   */
+  Vector3 WorldPosition(UInt32 index) const;
+  Vector3 WorldNormal(UInt32 index) const;
+  Vector2 VertexUV(UInt32 index) const;
+  bool HasVertexNormal() const { return _normal != nullptr || _packedNormal != nullptr; }
+  bool HasVertexUV() const { return _uv != nullptr || _packedUV != nullptr; }
+  /**
+   * @brief 配置了 compress_attributes 时, 把法线压缩成八面体编码, uv 压缩成半精度浮点数, 并释放原来的数组
+   * 子类填好 _normal 和 _uv 之后调用
+   *
+   * @param isSharedNormal _normal 是否是模型的数组, 会被其他网格引用. 是的话压缩结果通过上下文共享
+   * @param isSharedUV _uv 是否是模型的数组
+   */
+  void CompressAttributes(BuildContext* ctx, bool isSharedNormal, bool isSharedUV);
+  /**
+   * @brief 把法线压缩成八面体编码, 并输出最大误差. toWorld 不为 nullptr 时压缩变换后的法线
+   */
+  static Share<UInt32[]> PackNormals(const Eigen::Vector3f* normal, UInt32 count, const Transform* toWorld = nullptr);
+  /**
+   * @brief 配置了 triangle_records 时, 为每个三角形生成一条 MeshTriangleRecord, 并释放顶点的法线与 uv
+   * 位置与索引还要提交给 embree 和计算面积, 不会释放. 在 CompressAttributes 之后调用
+   */
+  void BuildTriangleRecords(BuildContext* ctx, bool isSharedPosition);
 
   std::shared_ptr<Eigen::Vector3f[]> _position;
   std::shared_ptr<Eigen::Vector3f[]> _normal;
   std::shared_ptr<Eigen::Vector2f[]> _uv;
+  std::shared_ptr<UInt32[]> _packedNormal;  //两个16位定点数, 见 Math::EncodeOctahedral
+  std::shared_ptr<UInt32[]> _packedUV;      //两个半精度浮点数
   std::shared_ptr<UInt32[]> _indices;
+  std::shared_ptr<MeshTriangleRecord[]> _triangleRecords;
   UInt32 _vertexCount;
   UInt32 _indexCount;
   UInt32 _triangleCount;
 
   Transform _toWorld;
+  bool _isInstance{false};  //顶点是否保存在物体空间, 与其他实例共享
+  bool _isCompressAttribute{false};
+  bool _isTriangleRecord{false};
   DiscreteDistribution1D _dist;
 };
 
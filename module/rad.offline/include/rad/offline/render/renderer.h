@@ -7,6 +7,8 @@
 #include <rad/offline/types.h>
 #include <rad/offline/ray.h>
 #include <rad/offline/render/scene.h>
+#include <rad/offline/render/camera.h>
+#include <rad/offline/render/checkpoint.h>
 
 #include <thread>
 #include <atomic>
@@ -25,24 +27,89 @@ class RAD_EXPORT_API Renderer {
   UInt64 AllTaskCount() const { return _allTask; }
   UInt64 CompletedTaskCount() const { return _completeTask; }
   /**
-   * @brief 从开始渲染到现在已经经过的时间
+   * @brief 从开始渲染到现在已经经过的时间, 从检查点恢复时包括之前已经用掉的时间
    */
-  Int64 ElapsedTime() const { return _sw.ElapsedMilliseconds(); }
+  Int64 ElapsedTime() const { return _sw.ElapsedMilliseconds() + _elapsedOffset; }
   const Scene& GetScene() const { return *_scene; }
+  /**
+   * @brief 是否设置了时间预算. 有时间预算时渲染器按轮次不断增加样本, 直到用完时间
+   * 只会在两轮之间检查时间, 当前轮次总是完整结束, 所以结果的样本数是一致的
+   */
+  bool HasTimeBudget() const { return _timeBudget > 0; }
+  bool IsTimeBudgetExhausted() const { return HasTimeBudget() && ElapsedTime() >= Int64(_timeBudget); }
+  /**
+   * @brief 需要渲染的区域 [CropMin, CropMax), 没有设置 crop 时是整张图片
+   * 区域外的像素不会发射相机光线, 溅射到区域外的贡献也会被丢弃
+   */
+  bool HasCrop() const { return _cropMin != Vector2i::Zero() || _cropMax != _scene->GetCamera().Resolution(); }
+  const Vector2i& CropMin() const { return _cropMin; }
+  const Vector2i& CropMax() const { return _cropMax; }
+  UInt64 CropPixelCount() const { return UInt64(_cropMax.x() - _cropMin.x()) * UInt64(_cropMax.y() - _cropMin.y()); }
+  bool IsInCrop(Int32 x, Int32 y) const {
+    return x >= _cropMin.x() && y >= _cropMin.y() && x < _cropMax.x() && y < _cropMax.y();
+  }
+  /**
+   * @brief 设置需要渲染的区域 [min, max), 会被限制在图片内部. 需要在 Start 之前调用
+   */
+  void SetCrop(const Vector2i& min, const Vector2i& max);
 
   virtual void Start() = 0;
   virtual void Wait();
   virtual void Stop();
   virtual void SaveResult(const LocationResolver& resolver) const;
 
+  /**
+   * @brief 开启检查点. 渲染时在两轮之间检查, 每隔 checkpoint_interval_ms 把累加状态写到 path
+   */
+  void SetCheckpoint(const std::filesystem::path& path, UInt64 sceneHash);
+  /**
+   * @brief 从检查点继续累加, 需要在 Start 之前调用. 检查点与当前场景不一致时抛出异常
+   * 不支持检查点的渲染器抛出异常
+   */
+  virtual void Resume(const std::filesystem::path& path, UInt64 sceneHash);
+
+  /**
+   * @brief 只渲染每个像素第 [begin, end) 个样本, 需要在 Start 之前调用. 不支持的渲染器抛出异常
+   * 样本只由 (种子, 像素, 样本索引) 决定, 不相交的样本区间分别渲染再合并, 结果与一次渲染完整区间相同
+   */
+  virtual void SetSampleRange(UInt32 begin, UInt32 end);
+  /**
+   * @brief 取出未归一化的累加值与每个像素的权重, 区域外的像素权重为0
+   * 多个进程的部分结果逐像素相加后, 累加值除以权重就是合并后的图片
+   */
+  virtual void GetPartialResult(RenderCheckpoint& result) const;
+
  protected:
+  bool IsCheckpointEnabled() const { return !_checkpointPath.empty() && _checkpointInterval > 0; }
+  bool IsCheckpointDue() const { return IsCheckpointEnabled() && ElapsedTime() - _lastCheckpoint >= Int64(_checkpointInterval); }
+  /**
+   * @brief 子类填好累加状态后调用, 这里补上场景哈希、种子与时间再写入磁盘
+   */
+  void WriteCheckpoint(RenderCheckpoint& ckpt);
+
+  /**
+   * @brief 有时间预算时, 进度用已经经过的毫秒数表示
+   */
+  void UpdateTimeBudgetProgress();
+
   Share<spdlog::logger> _logger;
   Unique<Scene> _scene;
   Unique<std::thread> _renderThread;
   Int32 _threadCount;
+  UInt32 _sppPerPass;  //按轮次渲染时每一轮每个像素的样本数
+  UInt32 _timeBudget;  //时间预算, 单位毫秒, 0表示不限制
+  Vector2i _cropMin;
+  Vector2i _cropMax;
+  bool _isSaveDataWindow;  //设置了 crop 时是否只保存区域内的像素, 写成带数据窗口的exr
   UInt64 _allTask = 0;
   std::atomic_uint64_t _completeTask = 0;  // 已完成任务数量
   Stopwatch _sw{};
+  Int64 _elapsedOffset = 0;
+  UInt32 _checkpointInterval;  //检查点间隔, 单位毫秒, 0表示不写检查点
+  std::filesystem::path _checkpointPath;
+  UInt64 _sceneHash = 0;
+  Int64 _lastCheckpoint = 0;
+  Unique<RenderCheckpoint> _resume;  //Start 之前读取的检查点, 渲染开始时被子类取走
   bool _isComplete = false;
   bool _isStop = false;
 };
@@ -56,9 +123,56 @@ class RAD_EXPORT_API SampleRenderer : public Renderer {
   ~SampleRenderer() noexcept override;
 
   void Start() override;
+  void SaveResult(const LocationResolver& resolver) const override;
+  void SetSampleRange(UInt32 begin, UInt32 end) override;
+  void GetPartialResult(RenderCheckpoint& result) const override;
 
  protected:
   virtual Spectrum Li(const RayDifferential& ray, const Scene& scene, Sampler* sampler) const = 0;
+  /**
+   * @brief 相机光线的第一个交点已经求出时的 Li, 包求交使用它跳过第一次求交
+   * 默认实现忽略交点, 直接调用 Li
+   */
+  virtual Spectrum LiFromPrimaryHit(const RayDifferential& ray, SurfaceInteraction& si, bool anyHit, const Scene& scene, Sampler* sampler) const;
+  /**
+   * @brief 子类覆盖了 LiFromPrimaryHit 时返回true, 只有这样才会启用包求交
+   */
+  virtual bool HasPrimaryHitLi() const { return false; }
+
+ private:
+  void Render();
+  /**
+   * @brief 分块渲染, 每个块内的像素一次性采样到 SampleCount 再处理下一块
+   */
+  void RenderTiled();
+  /**
+   * @brief 与 RenderTiled 相同, 但是把相邻像素同一个样本索引的相机光线打成一个包求交
+   * 第一次求交之后仍然逐条光线着色, 样本与 RenderTiled 完全相同
+   */
+  void RenderTiledPacket();
+  /**
+   * @brief 渐进式渲染, 每一轮给整张图片的所有像素增加 _sppPerPass 个样本
+   * frame buffer 里始终是累加值除以已完成样本数的平均值, 随时可以停止并保存结果
+   *
+   * 开启自适应采样时, 用 Welford 算法在线估计每个像素亮度的均值与方差
+   * 相对误差低于阈值的像素停止采样, 省下来的样本预算留给还没收敛的像素
+   */
+  void RenderProgressive();
+
+  UInt32 _sampleBegin;            //只渲染每个像素第 [_sampleBegin, _sampleEnd) 个样本
+  UInt32 _sampleEnd;
+  UInt32 _packetSize;             //相机光线包的宽度, 0表示不使用包求交
+  bool _isProgressive;
+  bool _isAdaptive;
+  Float _adaptiveThreshold;       //相对误差阈值
+  UInt32 _adaptiveMinSpp;         //像素至少需要这么多样本才会判断是否收敛
+  UInt32 _adaptiveMaxSpp;         //单个像素最多的样本数
+  bool _isSaveSampleCount;        //是否额外保存每个像素样本数的AOV
+  MatrixX<Spectrum> _accumulate;  //未归一化的累加值
+  MatrixX<UInt32> _sampleCounts;  //每个像素已经完成的样本数
+  MatrixX<Float> _lumMean;        //亮度的均值
+  MatrixX<Float> _lumM2;          //亮度与均值之差的平方和
+  MatrixX<UInt8> _isConverged;    //像素是否已经收敛
 };
 
 }  // namespace Rad
@@ -9,7 +9,8 @@ namespace Rad {
 /**
  * @brief 采样器提供了生成随机样本的能力, 这些样本的范围在[0,1)内
  * 首先需要调用SetSeed来初始化采样器
- * 然后就可以获取样本了, 当每一轮采样完成后需要调用 Advance() 函数
+ * 每个样本开始前调用 StartPixelSample, 然后就可以获取样本了
+ * 取出的样本只由 (种子, 像素, 样本索引, 维度) 决定, 与线程数量、任务如何划分都无关
  */
 class RAD_EXPORT_API Sampler {
  public:
@@ -17,20 +18,63 @@ class RAD_EXPORT_API Sampler {
   virtual ~Sampler() noexcept = default;
 
   UInt32 SampleCount() const { return _sampleCount; }
+  /**
+   * @brief 相机挂载采样器时告诉它胶卷的分辨率, 需要在屏幕空间分布误差的采样器会用到
+   */
+  virtual void SetResolution(const Vector2i& resolution) { _resolution = resolution; }
 
   virtual Unique<Sampler> Clone(UInt32 seed) const = 0;
 
   UInt32 GetSeed() const { return _seed; }
   virtual void SetSeed(UInt32 seed) = 0;
 
+  /**
+   * @brief 开始生成像素 pixel 的第 sampleIndex 个样本, 维度从0开始计数
+   * 没有像素概念的渲染器 (比如粒子追踪) 可以使用固定的像素坐标
+   */
+  virtual void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex) = 0;
+  /**
+   * @brief 从第 dimension 维开始生成像素 pixel 的第 sampleIndex 个样本
+   * 波前式渲染器每次只推进一条路径的一次反弹, 用它在多条路径之间来回切换
+   * 默认实现从第0维开始逐个丢弃样本, 子类可以直接跳到需要的维度
+   */
+  virtual void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension);
+  /**
+   * @brief 当前样本已经取出了多少维
+   */
+  UInt32 GetDimension() const { return _dimension; }
+
   virtual Float Next1D() = 0;
   virtual Vector2 Next2D() = 0;
   virtual Vector3 Next3D() = 0;
+  /**
+   * @brief 一次取出 count 维样本, 热循环用它代替逐维的虚函数调用
+   * 相邻的 (samples[0], samples[1]), (samples[2], samples[3])... 是 Next2D 取出的二维样本
+   * 低差异采样器能保持它们的二维分层, 所以需要二维样本的地方要放在偶数下标上
+   */
+  virtual void NextArray(Float* samples, UInt32 count);
   inline virtual void Advance() {}
 
  protected:
+  /**
+   * @brief 将种子、像素坐标与样本索引混合成一个64位哈希
+   */
+  static UInt64 HashPixelSample(UInt32 seed, const Vector2i& pixel, UInt32 sampleIndex);
+  /**
+   * @brief 将种子、像素坐标与维度混合成一个64位哈希, 低差异序列用它给每个像素的每一维单独加扰
+   */
+  static UInt64 HashPixelDimension(UInt32 seed, const Vector2i& pixel, UInt32 dimension);
+  static UInt64 MixBits(UInt64 v);
+  /**
+   * @brief 由 seed 决定的 [0, n) 上的随机排列的第 i 个元素, 不需要额外的内存
+   * https://graphics.pixar.com/library/MultiJitteredSampling/paper.pdf
+   */
+  static UInt32 PermutationElement(UInt32 i, UInt32 n, UInt32 seed);
+
   UInt32 _sampleCount;
   UInt32 _seed;
+  UInt32 _dimension{0};
+  Vector2i _resolution{0, 0};
 };
 
 }  // namespace Rad
@@ -31,6 +31,7 @@ class RAD_EXPORT_API Scene {
   const Light* GetLight(UInt32 index) const { return _lights[index].get(); }
   Light* GetLight(UInt32 index) { return _lights[index].get(); }
   const Light* GetEnvLight() const { return _envLight; }
+  const Accel& GetAccel() const { return *_accel; }
   Light* GetEnvLight() { return _envLight; }
 
   /**
@@ -50,6 +51,26 @@ class RAD_EXPORT_API Scene {
    * @brief 检查参考点与目标点之间是否有遮挡
    */
   bool IsOcclude(const Interaction& ref, const Vector3& p) const;
+  /**
+   * @brief 批量光线求交, 结果与逐条调用 RayIntersect 相同
+   *
+   * @param records 调用者提供的临时空间, 至少 count 个, 反复调用时可以复用, 不需要每次分配
+   * @param sis [out] 每条光线的交点数据, 没有交点时只有 Wi 有效
+   * @param isHit [out] 每条光线是否有交点
+   */
+  void RayIntersect(const Ray* rays, HitShapeRecord* records, SurfaceInteraction* sis, UInt8* isHit, UInt32 count) const;
+  /**
+   * @brief 批量 shadow ray, 配合 SpawnShadowRay 可以一次检查多对点之间的遮挡
+   */
+  void RayIntersect(const Ray* rays, UInt8* isHit, UInt32 count) const;
+  /**
+   * @brief 包求交, 一次求交 width (4、8 或 16) 条相干的光线, valid 为0的光线不参与求交
+   */
+  void RayIntersectPacket(UInt32 width, const Int32* valid, const Ray* rays, SurfaceInteraction* sis, UInt8* isHit) const;
+  /**
+   * @brief 生成参考点到目标点的 shadow ray, 两点距离太近时返回false, 这时视为被遮挡
+   */
+  static bool SpawnShadowRay(const Interaction& ref, const Vector3& p, Ray& ray);
 
   /**
    * @brief 采样场景中的光源
@@ -29,6 +29,40 @@ class RAD_EXPORT_API Shape {
    * @param id 图元的唯一id
    */
   virtual void SubmitToEmbree(RTCDevice device, RTCScene scene, UInt32 id) const = 0;
+  /**
+   * @brief 实例化的形状返回物体空间几何数据的标识, 标识相同的形状共享同一个 embree 场景
+   * 此时 SubmitToEmbree 提交的是物体空间的几何, 加速结构再用 GetInstanceTransform 把它挂到顶层场景
+   * 返回 nullptr 表示不使用实例化
+   */
+  virtual const void* GetInstanceKey() const { return nullptr; }
+  /**
+   * @brief 实例从物体空间到世界空间的变换, 只有 GetInstanceKey 不为 nullptr 时才有意义
+   */
+  virtual const Transform* GetInstanceTransform() const { return nullptr; }
+  /**
+   * @brief 可以与其他形状合并成同一个 embree 几何的形状返回合并类别的标识, 返回 nullptr 表示单独提交
+   * 加速结构收集标识相同的形状, 交给其中第一个形状的 SubmitBatchToEmbree 一次提交
+   */
+  virtual const void* GetEmbreeBatchKey() const { return nullptr; }
+  /**
+   * @brief 把同一类别的形状合并成一个几何提交, 第 i 个图元对应 shapes[i]
+   *
+   * @param id 合并后几何的唯一id, 与任何形状的索引都不相同
+   */
+  virtual void SubmitBatchToEmbree(RTCDevice device, RTCScene scene, UInt32 id, const Shape* const* shapes, UInt32 count) const;
+  /**
+   * @brief 形状由多少个图元组成, 不使用 embree 的加速结构按图元建立层次结构
+   */
+  virtual UInt32 GetPrimitiveCount() const { return 1; }
+  /**
+   * @brief 第 index 个图元在世界空间的包围盒
+   */
+  virtual BoundingBox3 GetPrimitiveBound(UInt32 index) const;
+  /**
+   * @brief 与第 index 个图元求交, 只接受距离在 [ray.MinT, ray.MaxT] 之间的交点
+   * 成功时填写 rec 的距离、图元索引、图元参数坐标与几何法线, 与 embree 返回的数据含义相同
+   */
+  virtual bool IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const;
   /**
    * @brief 从求交结果计算表面交点数据
    *
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <rad/offline/fwd.h>
+#include <rad/offline/types.h>
+#include <rad/offline/spectrum.h>
+
+#include <atomic>
+#include <memory>
+
+namespace Rad {
+
+/**
+ * @brief 所有线程共享的溅射胶卷, 保存未归一化的累加值
+ * 光路连接到相机时可能贡献到任意像素, 每个分量用原子操作累加, 不需要每个线程都有一整张图
+ * 内存只与分辨率有关, 与线程数无关
+ */
+class RAD_EXPORT_API SplatFilm {
+ public:
+  SplatFilm(Int32 rows, Int32 cols);
+
+  Int32 Rows() const { return _rows; }
+  Int32 Cols() const { return _cols; }
+  /**
+   * @brief 占用的内存, 字节
+   */
+  size_t MemoryUsage() const { return size_t(_rows) * _cols * Spectrum::ComponentCount * sizeof(std::atomic<Float>); }
+
+  /**
+   * @brief 线程安全, 可以与其他线程同时溅射到同一个像素
+   */
+  void Add(Int32 x, Int32 y, const Spectrum& value) {
+    if (value.IsBlack()) {
+      return;
+    }
+    std::atomic<Float>* p = _data.get() + Index(x, y);
+    for (UInt32 i = 0; i < Spectrum::ComponentCount; i++) {
+      AtomicAdd(p[i], value[i]);
+    }
+  }
+  /**
+   * @brief 读取累加值, 调用时不能有其他线程正在溅射
+   */
+  Spectrum Get(Int32 x, Int32 y) const {
+    const std::atomic<Float>* p = _data.get() + Index(x, y);
+    Spectrum result;
+    for (UInt32 i = 0; i < Spectrum::ComponentCount; i++) {
+      result[i] = p[i].load(std::memory_order_relaxed);
+    }
+    return result;
+  }
+
+  void Clear();
+  /**
+   * @brief 用已有的累加值覆盖胶卷, 从检查点恢复时使用
+   */
+  void Set(const MatrixX<Spectrum>& accumulate);
+  MatrixX<Spectrum> ToMatrix() const;
+
+ private:
+  size_t Index(Int32 x, Int32 y) const { return (size_t(y) * _rows + x) * Spectrum::ComponentCount; }
+
+  static void AtomicAdd(std::atomic<Float>& target, Float value) {
+    // C++17 的浮点原子没有 fetch_add, 用 CAS 循环代替
+    Float old = target.load(std::memory_order_relaxed);
+    while (!target.compare_exchange_weak(old, old + value, std::memory_order_relaxed)) {
+    }
+  }
+
+  Int32 _rows;
+  Int32 _cols;
+  std::unique_ptr<std::atomic<Float>[]> _data;
+};
+
+}  // namespace Rad
@@ -0,0 +1,29 @@
+#include <rad/offline/render/accel.h>
+
+namespace Rad {
+
+void Accel::RayIntersect(const Ray* rays, UInt8* isHit, UInt32 count) const {
+  for (UInt32 i = 0; i < count; i++) {
+    isHit[i] = RayIntersect(rays[i]) ? 1 : 0;
+  }
+}
+
+void Accel::RayIntersectPreliminary(const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit, UInt32 count) const {
+  for (UInt32 i = 0; i < count; i++) {
+    isHit[i] = RayIntersectPreliminary(rays[i], hsrs[i]) ? 1 : 0;
+  }
+}
+
+void Accel::RayIntersectPacket(UInt32 width, const Int32* valid, const Ray* rays, UInt8* isHit) const {
+  for (UInt32 i = 0; i < width; i++) {
+    isHit[i] = valid[i] && RayIntersect(rays[i]) ? 1 : 0;
+  }
+}
+
+void Accel::RayIntersectPreliminaryPacket(UInt32 width, const Int32* valid, const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit) const {
+  for (UInt32 i = 0; i < width; i++) {
+    isHit[i] = valid[i] && RayIntersectPreliminary(rays[i], hsrs[i]) ? 1 : 0;
+  }
+}
+
+}  // namespace Rad
@@ -0,0 +1,572 @@
+#include <rad/offline/render/accel.h>
+
+#include <rad/core/config_node.h>
+#include <rad/core/logger.h>
+#include <rad/core/stop_watch.h>
+#include <rad/offline/build/build_context.h>
+#include <rad/offline/build/factory.h>
+#include <rad/offline/render/shape.h>
+#include <rad/offline/render/mesh_base.h>
+
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace Rad {
+
+/**
+ * @brief 加速结构里的图元
+ * 三角形直接保存世界空间的一个顶点和两条边, 求交时不需要再访问网格的索引与顶点
+ * 其他形状只记录索引, 求交时调用 Shape::IntersectPrimitive
+ */
+struct BvhPrimitive {
+  Eigen::Vector3f V0;
+  Eigen::Vector3f E0;
+  Eigen::Vector3f E1;
+  UInt32 ShapeIndex;
+  UInt32 PrimIndex;
+  bool IsTriangle;
+};
+
+/**
+ * @brief 构建时每个图元的包围盒与中心, 只在构建期间存在
+ */
+struct BvhBuildPrimitive {
+  BoundingBox3f Bound;
+  Eigen::Vector3f Centroid;
+};
+
+/**
+ * @brief 构建时的二叉树节点, 构建完成后会被压缩成多叉树
+ */
+struct BvhBuildNode {
+  BoundingBox3f Bound;
+  std::unique_ptr<BvhBuildNode> Children[2];
+  UInt32 First = 0;
+  UInt32 Count = 0;  //大于0表示叶子
+
+  bool IsLeaf() const { return Count > 0; }
+};
+
+/**
+ * @brief 多叉树节点, 子节点的包围盒按 SoA 排列, 一次和所有子节点的包围盒求交
+ * 内部节点的 Child 是子节点索引, 叶子的 Child 是第一个图元的索引, Count 是图元数量
+ */
+template <UInt32 Width>
+struct alignas(64) BvhWideNode {
+  static constexpr UInt32 Invalid = std::numeric_limits<UInt32>::max();
+
+  Float32 LowerX[Width];
+  Float32 UpperX[Width];
+  Float32 LowerY[Width];
+  Float32 UpperY[Width];
+  Float32 LowerZ[Width];
+  Float32 UpperZ[Width];
+  UInt32 Child[Width];
+  UInt32 Count[Width];
+};
+
+/**
+ * @brief 分桶的 SAH 统计, 三个轴各一组桶
+ */
+struct BvhSahBins {
+  static constexpr UInt32 Count = 32;
+
+  BoundingBox3f Bounds[3][Count];
+  UInt32 PrimCount[3][Count];
+
+  BvhSahBins() {
+    std::fill(&PrimCount[0][0], &PrimCount[0][0] + 3 * Count, 0);
+  }
+
+  void Merge(const BvhSahBins& other) {
+    for (UInt32 axis = 0; axis < 3; axis++) {
+      for (UInt32 i = 0; i < Count; i++) {
+        Bounds[axis][i].extend(other.Bounds[axis][i]);
+        PrimCount[axis][i] += other.PrimCount[axis][i];
+      }
+    }
+  }
+};
+
+/**
+ * @brief 不依赖 embree 的 BVH, 用分桶 SAH 自顶向下构建, 再压缩成 Width 叉树
+ * 图元数量多的节点并行分桶, 子树用 TBB 并行构建
+ * 遍历时一次测试一个节点的所有子节点包围盒, 循环是定长的 SoA 运算, 交给编译器向量化
+ */
+template <UInt32 Width>
+class Bvh final : public Accel {
+ public:
+  using Node = BvhWideNode<Width>;
+  static constexpr UInt32 MaxLeafSize = 8;
+  static constexpr UInt32 MaxSahDepth = 48;
+  static constexpr UInt32 StackSize = 96 * Width;
+  static constexpr UInt32 ParallelThreshold = 4096;
+  static constexpr Float32 TraversalCost = 1.0f;
+
+  Bvh(BuildContext* ctx, std::vector<Unique<Shape>> shapes, const ConfigNode& cfg) {
+    _shapes = std::move(shapes);
+    if (_shapes.size() >= std::numeric_limits<UInt32>::max()) {
+      throw RadArgumentException("shape count out of max");
+    }
+    _maxLeafSize = cfg.ReadOrDefault("max_leaf_size", MaxLeafSize);
+    if (_maxLeafSize == 0) {
+      throw RadArgumentException("max_leaf_size must be greater than 0");
+    }
+    Logger::GetCategory("bvh")->info("start build accel");
+    Stopwatch sw;
+    sw.Start();
+    std::vector<BvhBuildPrimitive> buildPrims = CollectPrimitives();
+    if (!buildPrims.empty()) {
+      _refs.resize(buildPrims.size());
+      for (UInt32 i = 0; i < _refs.size(); i++) {
+        _refs[i] = i;
+      }
+      std::atomic<UInt32> nodeCount{0};
+      Unique<BvhBuildNode> root = BuildRecursive(buildPrims, 0, static_cast<UInt32>(_refs.size()), 0, nodeCount);
+      _worldBound = root->Bound;
+      _nodes.reserve(nodeCount.load() / (Width / 2) + 1);
+      Flatten(root.get());
+      //按叶子的顺序重排图元, 叶子里的图元是连续的
+      std::vector<BvhPrimitive> ordered(_prims.size());
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, _refs.size()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i != r.end(); i++) {
+          ordered[i] = _prims[_refs[i]];
+        }
+      });
+      _prims = std::move(ordered);
+    }
+    _refs = std::vector<UInt32>();
+    sw.Stop();
+    _buildTime = sw.ElapsedMilliseconds();
+    Logger::GetCategory("bvh")->info(
+        "build done. {} ms, {} primitives, {} nodes, {:.2f} MB",
+        _buildTime, _prims.size(), _nodes.size(), MemoryUsage() / (1024.0 * 1024.0));
+  }
+  ~Bvh() noexcept override = default;
+
+  BoundingBox3 GetWorldBound() const override {
+    return _worldBound.cast<Float>();
+  }
+
+  size_t MemoryUsage() const override {
+    return _nodes.size() * sizeof(Node) + _prims.size() * sizeof(BvhPrimitive);
+  }
+
+  bool RayIntersect(const Ray& ray) const override {
+    return Traverse<true>(ray, nullptr);
+  }
+
+  bool RayIntersectPreliminary(const Ray& ray, HitShapeRecord& hsr) const override {
+    HitShapeRecord rec{};
+    bool anyHit = Traverse<false>(ray, &rec);
+    hsr = rec;
+    return anyHit;
+  }
+
+ private:
+  std::vector<BvhBuildPrimitive> CollectPrimitives() {
+    std::vector<UInt32> offsets(_shapes.size() + 1, 0);
+    for (size_t i = 0; i < _shapes.size(); i++) {
+      offsets[i + 1] = offsets[i] + _shapes[i]->GetPrimitiveCount();
+    }
+    std::vector<BvhBuildPrimitive> buildPrims(offsets.back());
+    _prims.resize(offsets.back());
+    tbb::parallel_for(size_t(0), _shapes.size(), [&](size_t i) {
+      const Shape* shape = _shapes[i].get();
+      const MeshBase* mesh = dynamic_cast<const MeshBase*>(shape);
+      UInt32 count = offsets[i + 1] - offsets[i];
+      tbb::parallel_for(tbb::blocked_range<UInt32>(0, count), [&](const tbb::blocked_range<UInt32>& r) {
+        for (UInt32 j = r.begin(); j != r.end(); j++) {
+          BvhPrimitive& prim = _prims[offsets[i] + j];
+          BvhBuildPrimitive& build = buildPrims[offsets[i] + j];
+          prim.ShapeIndex = static_cast<UInt32>(i);
+          prim.PrimIndex = j;
+          if (mesh != nullptr) {
+            Vector3 p0, p1, p2;
+            mesh->GetWorldTriangle(j, p0, p1, p2);
+            Eigen::Vector3f v0 = p0.cast<Float32>(), v1 = p1.cast<Float32>(), v2 = p2.cast<Float32>();
+            prim.V0 = v0;
+            prim.E0 = v1 - v0;
+            prim.E1 = v2 - v0;
+            prim.IsTriangle = true;
+            build.Bound = BoundingBox3f(v0, v0);
+            build.Bound.extend(v1);
+            build.Bound.extend(v2);
+          } else {
+            prim.V0 = prim.E0 = prim.E1 = Eigen::Vector3f::Zero();
+            prim.IsTriangle = false;
+            build.Bound = shape->GetPrimitiveBound(j).template cast<Float32>();
+          }
+          build.Centroid = build.Bound.center();
+        }
+      });
+    });
+    return buildPrims;
+  }
+
+  template <typename T, typename Func, typename Join>
+  T Reduce(UInt32 begin, UInt32 end, const T& identity, Func&& func, Join&& join) const {
+    if (end - begin < ParallelThreshold * 4) {
+      T result = identity;
+      func(begin, end, result);
+      return result;
+    }
+    return tbb::parallel_reduce(
+        tbb::blocked_range<UInt32>(begin, end, ParallelThreshold), identity,
+        [&](const tbb::blocked_range<UInt32>& r, T acc) {
+          func(r.begin(), r.end(), acc);
+          return acc;
+        },
+        [&](T a, const T& b) {
+          join(a, b);
+          return a;
+        });
+  }
+
+  Unique<BvhBuildNode> BuildRecursive(
+      const std::vector<BvhBuildPrimitive>& prims,
+      UInt32 begin, UInt32 end, UInt32 depth,
+      std::atomic<UInt32>& nodeCount) {
+    nodeCount.fetch_add(1, std::memory_order_relaxed);
+    auto node = std::make_unique<BvhBuildNode>();
+    UInt32 count = end - begin;
+    using BoundPair = std::pair<BoundingBox3f, BoundingBox3f>;
+    BoundPair bounds = Reduce(
+        begin, end, BoundPair{},
+        [&](UInt32 b, UInt32 e, BoundPair& acc) {
+          for (UInt32 i = b; i < e; i++) {
+            const BvhBuildPrimitive& p = prims[_refs[i]];
+            acc.first.extend(p.Bound);
+            acc.second.extend(p.Centroid);
+          }
+        },
+        [](BoundPair& a, const BoundPair& b) {
+          a.first.extend(b.first);
+          a.second.extend(b.second);
+        });
+    node->Bound = bounds.first;
+    const BoundingBox3f& centroidBound = bounds.second;
+    auto makeLeaf = [&]() {
+      node->First = begin;
+      node->Count = count;
+      return std::move(node);
+    };
+    if (count == 1) {
+      return makeLeaf();
+    }
+    //分桶统计每个轴上的图元数量与包围盒
+    Eigen::Vector3f extent = centroidBound.sizes();
+    Eigen::Vector3f scale;
+    for (UInt32 axis = 0; axis < 3; axis++) {
+      scale[axis] = extent[axis] > 0 ? BvhSahBins::Count * (1 - 1e-5f) / extent[axis] : 0;
+    }
+    auto binIndex = [&](const Eigen::Vector3f& c, UInt32 axis) {
+      UInt32 b = static_cast<UInt32>((c[axis] - centroidBound.min()[axis]) * scale[axis]);
+      return std::min(b, BvhSahBins::Count - 1);
+    };
+    BvhSahBins bins = Reduce(
+        begin, end, BvhSahBins(),
+        [&](UInt32 b, UInt32 e, BvhSahBins& acc) {
+          for (UInt32 i = b; i < e; i++) {
+            const BvhBuildPrimitive& p = prims[_refs[i]];
+            for (UInt32 axis = 0; axis < 3; axis++) {
+              UInt32 idx = binIndex(p.Centroid, axis);
+              acc.Bounds[axis][idx].extend(p.Bound);
+              acc.PrimCount[axis][idx]++;
+            }
+          }
+        },
+        [](BvhSahBins& a, const BvhSahBins& b) { a.Merge(b); });
+    //从两边扫描, 计算每个分割位置的代价
+    Float32 nodeArea = SurfaceArea(node->Bound);
+    Float32 bestCost = std::numeric_limits<Float32>::infinity();
+    Int32 bestAxis = -1;
+    UInt32 bestSplit = 0;
+    for (UInt32 axis = 0; axis < 3; axis++) {
+      if (extent[axis] <= 0) {
+        continue;
+      }
+      Float32 rightCost[BvhSahBins::Count];
+      BoundingBox3f rightBound;
+      UInt32 rightCount = 0;
+      for (UInt32 i = BvhSahBins::Count - 1; i > 0; i--) {
+        rightBound.extend(bins.Bounds[axis][i]);
+        rightCount += bins.PrimCount[axis][i];
+        rightCost[i] = rightCount == 0 ? 0 : SurfaceArea(rightBound) * rightCount;
+      }
+      BoundingBox3f leftBound;
+      UInt32 leftCount = 0;
+      for (UInt32 i = 0; i < BvhSahBins::Count - 1; i++) {
+        leftBound.extend(bins.Bounds[axis][i]);
+        leftCount += bins.PrimCount[axis][i];
+        if (leftCount == 0 || leftCount == count) {
+          continue;
+        }
+        Float32 cost = TraversalCost + (SurfaceArea(leftBound) * leftCount + rightCost[i + 1]) / nodeArea;
+        if (cost < bestCost) {
+          bestCost = cost;
+          bestAxis = static_cast<Int32>(axis);
+          bestSplit = i;
+        }
+      }
+    }
+    if (count <= _maxLeafSize && (bestAxis < 0 || Float32(count) <= bestCost)) {
+      return makeLeaf();
+    }
+    UInt32 mid;
+    if (bestAxis >= 0 && depth < MaxSahDepth) {
+      auto midIter = std::partition(_refs.begin() + begin, _refs.begin() + end, [&](UInt32 ref) {
+        return binIndex(prims[ref].Centroid, static_cast<UInt32>(bestAxis)) <= bestSplit;
+      });
+      mid = static_cast<UInt32>(midIter - _refs.begin());
+    } else {
+      //图元中心重合时没法按位置分割, 树太深时也不再用 SAH, 直接对半分保证遍历栈够用
+      mid = begin + count / 2;
+    }
+    if (mid == begin || mid == end) {
+      mid = begin + count / 2;
+    }
+    auto buildLeft = [&]() { node->Children[0] = BuildRecursive(prims, begin, mid, depth + 1, nodeCount); };
+    auto buildRight = [&]() { node->Children[1] = BuildRecursive(prims, mid, end, depth + 1, nodeCount); };
+    if (count > ParallelThreshold) {
+      tbb::parallel_invoke(buildLeft, buildRight);
+    } else {
+      buildLeft();
+      buildRight();
+    }
+    return node;
+  }
+
+  /**
+   * @brief 把二叉树压缩成 Width 叉树: 不断展开表面积最大的内部子节点, 直到子节点数量达到 Width
+   */
+  UInt32 Flatten(const BvhBuildNode* root) {
+    const BvhBuildNode* children[Width];
+    UInt32 childCount = 0;
+    if (root->IsLeaf()) {
+      children[childCount++] = root;
+    } else {
+      children[childCount++] = root->Children[0].get();
+      children[childCount++] = root->Children[1].get();
+    }
+    while (childCount < Width) {
+      Int32 best = -1;
+      Float32 bestArea = -1;
+      for (UInt32 i = 0; i < childCount; i++) {
+        if (children[i]->IsLeaf()) {
+          continue;
+        }
+        Float32 area = SurfaceArea(children[i]->Bound);
+        if (area > bestArea) {
+          bestArea = area;
+          best = static_cast<Int32>(i);
+        }
+      }
+      if (best < 0) {
+        break;
+      }
+      const BvhBuildNode* expand = children[best];
+      children[best] = expand->Children[0].get();
+      children[childCount++] = expand->Children[1].get();
+    }
+    UInt32 index = static_cast<UInt32>(_nodes.size());
+    _nodes.emplace_back();
+    Node& node = _nodes.back();
+    for (UInt32 i = 0; i < Width; i++) {
+      node.LowerX[i] = node.LowerY[i] = node.LowerZ[i] = 0;
+      node.UpperX[i] = node.UpperY[i] = node.UpperZ[i] = 0;
+      node.Child[i] = Node::Invalid;
+      node.Count[i] = 0;
+    }
+    for (UInt32 i = 0; i < childCount; i++) {
+      const BoundingBox3f& bound = children[i]->Bound;
+      node.LowerX[i] = bound.min().x();
+      node.LowerY[i] = bound.min().y();
+      node.LowerZ[i] = bound.min().z();
+      node.UpperX[i] = bound.max().x();
+      node.UpperY[i] = bound.max().y();
+      node.UpperZ[i] = bound.max().z();
+    }
+    for (UInt32 i = 0; i < childCount; i++) {
+      const BvhBuildNode* child = children[i];
+      if (child->IsLeaf()) {
+        _nodes[index].Child[i] = child->First;
+        _nodes[index].Count[i] = child->Count;
+      } else {
+        //递归时 _nodes 可能扩容, 不能持有节点的引用
+        UInt32 childIndex = Flatten(child);
+        _nodes[index].Child[i] = childIndex;
+      }
+    }
+    return index;
+  }
+
+  static Float32 SurfaceArea(const BoundingBox3f& bound) {
+    if (bound.isEmpty()) {
+      return 0;
+    }
+    Eigen::Vector3f d = bound.sizes();
+    return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+  }
+
+  template <bool IsAnyHit>
+  bool Traverse(const Ray& ray, HitShapeRecord* hsr) const {
+    if (_nodes.empty()) {
+      return false;
+    }
+    //float 的包围盒求交带一点余量, 避免光线擦过包围盒边缘时漏掉交点
+    constexpr Float32 robust = 1 + 2 * 3 * std::numeric_limits<Float32>::epsilon();
+    const Eigen::Vector3f o = ray.O.cast<Float32>();
+    const Eigen::Vector3f d = ray.D.cast<Float32>();
+    const Eigen::Vector3f invD(1 / d.x(), 1 / d.y(), 1 / d.z());
+    const Float32 tNear = Float32(ray.MinT);
+    Float32 tFar = Float32(ray.MaxT);
+    struct StackEntry {
+      UInt32 Node;
+      Float32 Dist;
+    };
+    StackEntry stack[StackSize];
+    UInt32 stackSize = 0;
+    stack[stackSize++] = {0, tNear};
+    bool anyHit = false;
+    while (stackSize > 0) {
+      StackEntry entry = stack[--stackSize];
+      if (entry.Dist > tFar) {
+        continue;
+      }
+      const Node& node = _nodes[entry.Node];
+      Float32 dist[Width];
+      for (UInt32 i = 0; i < Width; i++) {
+        Float32 tx0 = (node.LowerX[i] - o.x()) * invD.x();
+        Float32 tx1 = (node.UpperX[i] - o.x()) * invD.x();
+        Float32 ty0 = (node.LowerY[i] - o.y()) * invD.y();
+        Float32 ty1 = (node.UpperY[i] - o.y()) * invD.y();
+        Float32 tz0 = (node.LowerZ[i] - o.z()) * invD.z();
+        Float32 tz1 = (node.UpperZ[i] - o.z()) * invD.z();
+        Float32 tMin = std::max(std::max(std::min(tx0, tx1), std::min(ty0, ty1)), std::max(std::min(tz0, tz1), tNear));
+        Float32 tMax = std::min(std::min(std::max(tx0, tx1), std::max(ty0, ty1)), std::max(tz0, tz1)) * robust;
+        dist[i] = tMin <= std::min(tMax, tFar) ? tMin : std::numeric_limits<Float32>::infinity();
+      }
+      StackEntry inner[Width];
+      UInt32 innerCount = 0;
+      for (UInt32 i = 0; i < Width; i++) {
+        if (node.Child[i] == Node::Invalid || dist[i] > tFar) {
+          continue;
+        }
+        if (node.Count[i] == 0) {
+          inner[innerCount++] = {node.Child[i], dist[i]};
+          continue;
+        }
+        //叶子直接求交, 缩短 tFar 后可以剔除更多的子节点
+        if (IntersectLeaf<IsAnyHit>(ray, o, d, node.Child[i], node.Count[i], tNear, tFar, hsr)) {
+          anyHit = true;
+          if constexpr (IsAnyHit) {
+            return true;
+          }
+        }
+      }
+      //远的先入栈, 近的子节点先遍历
+      std::sort(inner, inner + innerCount, [](const StackEntry& a, const StackEntry& b) { return a.Dist > b.Dist; });
+      for (UInt32 i = 0; i < innerCount; i++) {
+        stack[stackSize++] = inner[i];
+      }
+    }
+    return anyHit;
+  }
+
+  template <bool IsAnyHit>
+  bool IntersectLeaf(
+      const Ray& ray, const Eigen::Vector3f& o, const Eigen::Vector3f& d,
+      UInt32 first, UInt32 count,
+      Float32 tNear, Float32& tFar,
+      HitShapeRecord* hsr) const {
+    bool anyHit = false;
+    for (UInt32 i = first; i < first + count; i++) {
+      const BvhPrimitive& prim = _prims[i];
+      if (prim.IsTriangle) {
+        //与 MeshBase::IntersectPrimitive 相同的 Moller Trumbore, 只是用 float 计算
+        Eigen::Vector3f pvec = d.cross(prim.E1);
+        Float32 det = prim.E0.dot(pvec);
+        if (det == 0) {
+          continue;
+        }
+        Float32 invDet = 1 / det;
+        Eigen::Vector3f tvec = o - prim.V0;
+        Float32 b1 = tvec.dot(pvec) * invDet;
+        if (b1 < 0 || b1 > 1) {
+          continue;
+        }
+        Eigen::Vector3f qvec = tvec.cross(prim.E0);
+        Float32 b2 = d.dot(qvec) * invDet;
+        if (b2 < 0 || b1 + b2 > 1) {
+          continue;
+        }
+        Float32 t = prim.E1.dot(qvec) * invDet;
+        if (t < tNear || t > tFar) {
+          continue;
+        }
+        anyHit = true;
+        if constexpr (IsAnyHit) {
+          return true;
+        }
+        tFar = t;
+        hsr->T = t;
+        hsr->PrimitiveIndex = prim.PrimIndex;
+        hsr->PrimitiveUV = Vector2(b1, b2);
+        hsr->GeometryNormal = prim.E0.cross(prim.E1).cast<Float>();
+      } else {
+        Ray shapeRay = ray;
+        shapeRay.MaxT = tFar;
+        HitShapeRecord rec{};
+        if (!_shapes[prim.ShapeIndex]->IntersectPrimitive(shapeRay, prim.PrimIndex, rec)) {
+          continue;
+        }
+        anyHit = true;
+        if constexpr (IsAnyHit) {
+          return true;
+        }
+        tFar = Float32(rec.T);
+        *hsr = rec;
+      }
+      hsr->ShapePtr = _shapes[prim.ShapeIndex].get();
+      hsr->ShapeIndex = prim.ShapeIndex;
+    }
+    return anyHit;
+  }
+
+  std::vector<Unique<Shape>> _shapes;
+  std::vector<BvhPrimitive> _prims;
+  std::vector<UInt32> _refs;
+  std::vector<Node> _nodes;
+  BoundingBox3f _worldBound;
+  UInt32 _maxLeafSize;
+};
+
+class BvhFactory final : public AccelFactory {
+ public:
+  BvhFactory() : AccelFactory("bvh") {}
+  ~BvhFactory() noexcept override = default;
+  Unique<Accel> Create(BuildContext* ctx, std::vector<Unique<Shape>> shapes, const ConfigNode& cfg) const override {
+    UInt32 width = cfg.ReadOrDefault("width", UInt32(4));
+    switch (width) {
+      case 4:
+        return std::make_unique<Bvh<4>>(ctx, std::move(shapes), cfg);
+      case 8:
+        return std::make_unique<Bvh<8>>(ctx, std::move(shapes), cfg);
+      default:
+        throw RadArgumentException("bvh width must be 4 or 8, but {}", width);
+    }
+  }
+};
+
+Unique<AccelFactory> _FactoryCreateBvhFunc_() {
+  return std::make_unique<BvhFactory>();
+}
+
+}  // namespace Rad
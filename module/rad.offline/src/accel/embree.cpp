@@ -7,12 +7,34 @@
 #include <rad/offline/build/factory.h>
 #include <rad/offline/render/shape.h>
 
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+
 namespace Rad {
 
 static void EmbreeErrCallback(void* userPtr, enum RTCError error, const char* str) {
   Logger::GetCategory("embree")->error("embree log error: {}, {}", error, str);
 }
 
+static bool EmbreeMemoryMonitor(void* userPtr, ssize_t bytes, bool post) {
+  std::atomic<Int64>* memory = static_cast<std::atomic<Int64>*>(userPtr);
+  memory->fetch_add(bytes, std::memory_order_relaxed);
+  return true;
+}
+
+static RTCBuildQuality ParseBuildQuality(const std::string& name) {
+  if (name == "low") {
+    return RTC_BUILD_QUALITY_LOW;
+  } else if (name == "medium") {
+    return RTC_BUILD_QUALITY_MEDIUM;
+  } else if (name == "high") {
+    return RTC_BUILD_QUALITY_HIGH;
+  } else {
+    throw RadArgumentException("unknown embree build quality: {}, should be low, medium or high", name);
+  }
+}
+
 class Embree final : public Accel {
  public:
   Embree(BuildContext* ctx, std::vector<Unique<Shape>> shapes, const ConfigNode& cfg) {
@@ -24,28 +46,93 @@ class Embree final : public Accel {
       throw RadInvalidOperationException("embree error {}, cannot create device", err);
     }
     rtcSetDeviceErrorFunction(_device, EmbreeErrCallback, NULL);
+    rtcSetDeviceMemoryMonitorFunction(_device, EmbreeMemoryMonitor, &_memory);
+    //low 与 medium 构建更快, 遍历稍慢, 适合反复调整场景. compact 更省内存, robust 避免相邻三角形之间漏光
+    RTCBuildQuality quality = ParseBuildQuality(cfg.ReadOrDefault("build_quality", std::string("high")));
+    int flags = RTC_SCENE_FLAG_NONE;
+    if (cfg.ReadOrDefault("compact", false)) {
+      flags |= RTC_SCENE_FLAG_COMPACT;
+    }
+    if (cfg.ReadOrDefault("robust", false)) {
+      flags |= RTC_SCENE_FLAG_ROBUST;
+    }
     _scene = rtcNewScene(_device);
-    rtcSetSceneBuildQuality(_scene, RTC_BUILD_QUALITY_HIGH);
-    rtcSetSceneFlags(_scene, RTC_SCENE_FLAG_NONE);
+    rtcSetSceneBuildQuality(_scene, quality);
+    rtcSetSceneFlags(_scene, static_cast<RTCSceneFlags>(flags));
     // build
-    if (_shapes.size() >= std::numeric_limits<UInt32>::max()) {
+    if (_shapes.size() * 2 >= std::numeric_limits<UInt32>::max()) {
       throw RadArgumentException("shape count out of max");
     }
-    for (size_t i = 0; i < _shapes.size(); i++) {
-      _shapes[i]->SubmitToEmbree(_device, _scene, static_cast<UInt32>(i));
-    }
+    //计时从提交几何开始, 实例原型和合并几何的 BLAS 都在循环里提交, 要算进构建时间
     Logger::GetCategory("embree")->info("start build accel");
     Stopwatch sw;
     sw.Start();
+    //实例化的形状共享同一个物体空间的场景 (原型), 顶层场景里只挂一个带变换的实例
+    std::unordered_map<const void*, RTCScene> prototypes;
+    std::unordered_map<const void*, size_t> batchIndices;
+    for (size_t i = 0; i < _shapes.size(); i++) {
+      const Shape* shape = _shapes[i].get();
+      const void* key = shape->GetInstanceKey();
+      if (key == nullptr) {
+        const void* batchKey = shape->GetEmbreeBatchKey();
+        if (batchKey == nullptr) {
+          shape->SubmitToEmbree(_device, _scene, static_cast<UInt32>(i));
+        } else {
+          auto batchIter = batchIndices.find(batchKey);
+          if (batchIter == batchIndices.end()) {
+            batchIter = batchIndices.emplace(batchKey, _batches.size()).first;
+            _batches.emplace_back();
+          }
+          _batches[batchIter->second].emplace_back(static_cast<UInt32>(i));
+        }
+        continue;
+      }
+      auto iter = prototypes.find(key);
+      if (iter == prototypes.end()) {
+        RTCScene prototype = rtcNewScene(_device);
+        rtcSetSceneBuildQuality(prototype, quality);
+        rtcSetSceneFlags(prototype, static_cast<RTCSceneFlags>(flags));
+        shape->SubmitToEmbree(_device, prototype, 0);
+        rtcCommitScene(prototype);
+        iter = prototypes.emplace(key, prototype).first;
+        _prototypes.emplace_back(prototype);
+      }
+      Eigen::Matrix4f toWorld = shape->GetInstanceTransform()->ToWorld.cast<float>();
+      RTCGeometry instance = rtcNewGeometry(_device, RTC_GEOMETRY_TYPE_INSTANCE);
+      rtcSetGeometryInstancedScene(instance, iter->second);
+      rtcSetGeometryTransform(instance, 0, RTC_FORMAT_FLOAT4X4_COLUMN_MAJOR, toWorld.data());
+      rtcCommitGeometry(instance);
+      rtcAttachGeometryByID(_scene, instance, static_cast<UInt32>(i));
+      rtcReleaseGeometry(instance);
+    }
+    //合并的几何排在所有形状之后, id 不会和形状的索引冲突
+    for (size_t i = 0; i < _batches.size(); i++) {
+      const std::vector<UInt32>& batch = _batches[i];
+      std::vector<const Shape*> batchShapes(batch.size());
+      for (size_t j = 0; j < batch.size(); j++) {
+        batchShapes[j] = _shapes[batch[j]].get();
+      }
+      UInt32 id = static_cast<UInt32>(_shapes.size() + i);
+      batchShapes[0]->SubmitBatchToEmbree(_device, _scene, id, batchShapes.data(), static_cast<UInt32>(batchShapes.size()));
+      Logger::GetCategory("embree")->info("batch {} native primitives into one geometry", batch.size());
+    }
+    if (!_prototypes.empty()) {
+      Logger::GetCategory("embree")->info("{} prototypes shared by instances", _prototypes.size());
+    }
     rtcCommitScene(_scene);
     sw.Stop();
-    Logger::GetCategory("embree")->info("build done. {} ms", sw.ElapsedMilliseconds());
+    _buildTime = sw.ElapsedMilliseconds();
+    Logger::GetCategory("embree")->info("build done. {} ms, {:.2f} MB", _buildTime, MemoryUsage() / (1024.0 * 1024.0));
   }
   ~Embree() noexcept override {
     if (_scene != nullptr) {
       rtcReleaseScene(_scene);
       _scene = nullptr;
     }
+    for (RTCScene prototype : _prototypes) {
+      rtcReleaseScene(prototype);
+    }
+    _prototypes.clear();
     if (_device != nullptr) {
       rtcReleaseDevice(_device);
       _device = nullptr;
@@ -67,6 +154,10 @@ class Embree final : public Accel {
     return rtcray;
   }
 
+  size_t MemoryUsage() const override {
+    return static_cast<size_t>(std::max(_memory.load(std::memory_order_relaxed), Int64(0)));
+  }
+
   BoundingBox3 GetWorldBound() const override {
     struct RTCBounds rtcBound;
     rtcGetSceneBounds(_scene, &rtcBound);
@@ -90,18 +181,169 @@ class Embree final : public Accel {
     struct RTCRayHit rayhit;
     rayhit.ray = ToEmbreeRay(ray);
     rayhit.hit.geomID = RTC_INVALID_GEOMETRY_ID;
+    rayhit.hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
     rtcIntersect1(_scene, &context, &rayhit);
+    return ToHitShapeRecord(ray, rayhit, hsr);
+  }
+
+  void RayIntersect(const Ray* rays, UInt8* isHit, UInt32 count) const override {
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    std::vector<RTCRay> rtcrays(count);
+    for (UInt32 i = 0; i < count; i++) {
+      rtcrays[i] = ToEmbreeRay(rays[i]);
+    }
+    //流式接口, embree会在内部把光线重新打包成SIMD宽度的组
+    rtcOccluded1M(_scene, &context, rtcrays.data(), count, sizeof(RTCRay));
+    for (UInt32 i = 0; i < count; i++) {
+      isHit[i] = rtcrays[i].tfar != float(rays[i].MaxT) ? 1 : 0;
+    }
+  }
+
+  void RayIntersectPreliminary(const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit, UInt32 count) const override {
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    std::vector<RTCRayHit> rayhits(count);
+    for (UInt32 i = 0; i < count; i++) {
+      rayhits[i].ray = ToEmbreeRay(rays[i]);
+      rayhits[i].hit.geomID = RTC_INVALID_GEOMETRY_ID;
+      rayhits[i].hit.instID[0] = RTC_INVALID_GEOMETRY_ID;
+    }
+    rtcIntersect1M(_scene, &context, rayhits.data(), count, sizeof(RTCRayHit));
+    for (UInt32 i = 0; i < count; i++) {
+      isHit[i] = ToHitShapeRecord(rays[i], rayhits[i], hsrs[i]) ? 1 : 0;
+    }
+  }
+
+  void RayIntersectPacket(UInt32 width, const Int32* valid, const Ray* rays, UInt8* isHit) const override {
+    switch (width) {
+      case 4:
+        OccludedPacket<4, RTCRay4>(rtcOccluded4, valid, rays, isHit);
+        break;
+      case 8:
+        OccludedPacket<8, RTCRay8>(rtcOccluded8, valid, rays, isHit);
+        break;
+      case 16:
+        OccludedPacket<16, RTCRay16>(rtcOccluded16, valid, rays, isHit);
+        break;
+      default:
+        Accel::RayIntersectPacket(width, valid, rays, isHit);
+        break;
+    }
+  }
+
+  void RayIntersectPreliminaryPacket(UInt32 width, const Int32* valid, const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit) const override {
+    switch (width) {
+      case 4:
+        IntersectPacket<4, RTCRayHit4>(rtcIntersect4, valid, rays, hsrs, isHit);
+        break;
+      case 8:
+        IntersectPacket<8, RTCRayHit8>(rtcIntersect8, valid, rays, hsrs, isHit);
+        break;
+      case 16:
+        IntersectPacket<16, RTCRayHit16>(rtcIntersect16, valid, rays, hsrs, isHit);
+        break;
+      default:
+        Accel::RayIntersectPreliminaryPacket(width, valid, rays, hsrs, isHit);
+        break;
+    }
+  }
+
+ private:
+  /**
+   * @brief 把光线写到包的第 i 条, 无效的光线 tnear > tfar, embree 不会求交
+   */
+  template <typename RayK>
+  static void ToEmbreePacketRay(const Int32* valid, const Ray* rays, UInt32 i, RayK& rtcray) {
+    if (!valid[i]) {
+      rtcray.tnear[i] = 0.0f;
+      rtcray.tfar[i] = -std::numeric_limits<float>::infinity();
+      return;
+    }
+    const Ray& ray = rays[i];
+    rtcray.org_x[i] = float(ray.O.x());
+    rtcray.org_y[i] = float(ray.O.y());
+    rtcray.org_z[i] = float(ray.O.z());
+    rtcray.dir_x[i] = float(ray.D.x());
+    rtcray.dir_y[i] = float(ray.D.y());
+    rtcray.dir_z[i] = float(ray.D.z());
+    rtcray.tnear[i] = float(ray.MinT);
+    rtcray.tfar[i] = float(ray.MaxT);
+    rtcray.time[i] = 0.0f;
+    rtcray.mask[i] = 0;
+    rtcray.flags[i] = 0;
+  }
+
+  template <UInt32 Width, typename RayK, typename Func>
+  void OccludedPacket(Func&& occluded, const Int32* valid, const Ray* rays, UInt8* isHit) const {
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+    RayK rtcray;
+    for (UInt32 i = 0; i < Width; i++) {
+      ToEmbreePacketRay(valid, rays, i, rtcray);
+    }
+    occluded(reinterpret_cast<const int*>(valid), _scene, &context, &rtcray);
+    for (UInt32 i = 0; i < Width; i++) {
+      isHit[i] = valid[i] && rtcray.tfar[i] != float(rays[i].MaxT) ? 1 : 0;
+    }
+  }
+
+  template <UInt32 Width, typename RayHitK, typename Func>
+  void IntersectPacket(Func&& intersect, const Int32* valid, const Ray* rays, HitShapeRecord* hsrs, UInt8* isHit) const {
+    struct RTCIntersectContext context;
+    rtcInitIntersectContext(&context);
+    context.flags = RTC_INTERSECT_CONTEXT_FLAG_COHERENT;
+    RayHitK rayhit;
+    for (UInt32 i = 0; i < Width; i++) {
+      ToEmbreePacketRay(valid, rays, i, rayhit.ray);
+      rayhit.hit.geomID[i] = RTC_INVALID_GEOMETRY_ID;
+      rayhit.hit.instID[0][i] = RTC_INVALID_GEOMETRY_ID;
+    }
+    intersect(reinterpret_cast<const int*>(valid), _scene, &context, &rayhit);
+    for (UInt32 i = 0; i < Width; i++) {
+      if (!valid[i]) {
+        hsrs[i] = {};
+        isHit[i] = 0;
+        continue;
+      }
+      //取出第 i 条光线的结果, 与单条光线共用转换代码
+      struct RTCRayHit single;
+      single.ray.tfar = rayhit.ray.tfar[i];
+      single.hit.geomID = rayhit.hit.geomID[i];
+      single.hit.instID[0] = rayhit.hit.instID[0][i];
+      single.hit.primID = rayhit.hit.primID[i];
+      single.hit.u = rayhit.hit.u[i];
+      single.hit.v = rayhit.hit.v[i];
+      single.hit.Ng_x = rayhit.hit.Ng_x[i];
+      single.hit.Ng_y = rayhit.hit.Ng_y[i];
+      single.hit.Ng_z = rayhit.hit.Ng_z[i];
+      isHit[i] = ToHitShapeRecord(rays[i], single, hsrs[i]) ? 1 : 0;
+    }
+  }
+
+  bool ToHitShapeRecord(const Ray& ray, const RTCRayHit& rayhit, HitShapeRecord& hsr) const {
     HitShapeRecord rec{};
     bool anyHit;
     if (rayhit.ray.tfar != float(ray.MaxT)) {  // hit
-      uint32_t shapeIndex = rayhit.hit.geomID;
+      //击中实例时 geomID 是原型场景里的几何, 顶层场景里的形状要看 instID
+      bool isInstance = rayhit.hit.instID[0] != RTC_INVALID_GEOMETRY_ID;
+      uint32_t shapeIndex = isInstance ? rayhit.hit.instID[0] : rayhit.hit.geomID;
       uint32_t primIndex = rayhit.hit.primID;
+      if (!isInstance && shapeIndex >= _shapes.size()) {
+        //合并的几何里每个图元都是一个完整的形状
+        shapeIndex = _batches[shapeIndex - _shapes.size()][primIndex];
+        primIndex = 0;
+      }
       rec.ShapePtr = _shapes[shapeIndex].get();
       rec.PrimitiveIndex = primIndex;
       rec.T = rayhit.ray.tfar;
       rec.PrimitiveUV = Vector2(rayhit.hit.u, rayhit.hit.v);
       rec.ShapeIndex = shapeIndex;
       rec.GeometryNormal = Vector3(rayhit.hit.Ng_x, rayhit.hit.Ng_y, rayhit.hit.Ng_z);
+      if (isInstance) {
+        rec.GeometryNormal = rec.ShapePtr->GetInstanceTransform()->ApplyNormalToWorld(rec.GeometryNormal);
+      }
       anyHit = true;
     } else {
       anyHit = false;
@@ -110,8 +352,10 @@ class Embree final : public Accel {
     return anyHit;
   }
 
- private:
   std::vector<Unique<Shape>> _shapes;
+  std::vector<RTCScene> _prototypes;
+  std::vector<std::vector<UInt32>> _batches;
+  std::atomic<Int64> _memory{0};  //embree 内部分配的字节数, 由内存监视回调统计
   RTCDevice _device;
   RTCScene _scene;
 };
@@ -8,9 +8,15 @@
 #include <rad/offline/render/bsdf.h>
 #include <rad/offline/render/light.h>
 #include <rad/offline/render/shape.h>
+#include <rad/offline/render/mesh_base.h>
 #include <rad/offline/render/renderer.h>
 #include <rad/offline/render/scene.h>
 
+#include <rad/core/logger.h>
+#include <rad/core/stop_watch.h>
+
+#include <tbb/parallel_for.h>
+
 #include <queue>
 
 namespace Rad {
@@ -26,9 +32,7 @@ void BuildContext::SetDefaultAssetManager(const std::filesystem::path& workDir)
   _defaultAssetMngr->SetWorkDirectory(workDir);
   _defaultAssetMngr->SetImageStorageIsBlockBased(true);
   if (_assetNode.GetData() != nullptr) {
-    for (auto&& i : _assetNode.As<std::vector<ConfigNode>>()) {
-      _defaultAssetMngr->Load(i);
-    }
+    _defaultAssetMngr->LoadBatch(_assetNode.As<std::vector<ConfigNode>>());
   }
   SetAssetManager(*_defaultAssetMngr);
 }
@@ -80,11 +84,104 @@ static std::string GetTypeFromConfig(ConfigNode cfg) {
   return type;
 }
 
+UInt32 BuildContext::GetMeshReferenceCount(const std::string& assetName, const std::string& subModel) const {
+  auto iter = _meshRefCount.find({assetName, subModel});
+  return iter == _meshRefCount.end() ? 0 : iter->second;
+}
+
+Share<UInt32[]> BuildContext::GetPackedAttribute(Share<const void> source, const std::function<Share<UInt32[]>()>& pack) {
+  const void* key = source.get();
+  {
+    std::lock_guard<std::mutex> lock(_packedMutex);
+    auto iter = _packedAttributes.find(key);
+    if (iter != _packedAttributes.end()) {
+      return iter->second.second;
+    }
+  }
+  //压缩内部会用 TBB 并行, 持有锁时等待并行任务可能让同一个线程再次尝试加锁, 所以在锁外压缩
+  Share<UInt32[]> packed = pack();
+  std::lock_guard<std::mutex> lock(_packedMutex);
+  auto [iter, isInsert] = _packedAttributes.emplace(key, std::make_pair(std::move(source), std::move(packed)));
+  return iter->second.second;
+}
+
+Share<TriangleModel> BuildContext::GetPreprocessedModel(const Share<TriangleModel>& model) {
+  {
+    std::lock_guard<std::mutex> lock(_preprocessMutex);
+    auto iter = _preprocessedModels.find(model.get());
+    if (iter != _preprocessedModels.end()) {
+      return iter->second.second;
+    }
+  }
+  Stopwatch sw;
+  sw.Start();
+  TriangleModel welded = model->WeldVertices();
+  sw.Stop();
+  Int64 weldTime = sw.ElapsedMilliseconds();
+  sw.Start();
+  auto result = std::make_shared<TriangleModel>(welded.ReorderForLocality());
+  sw.Stop();
+  Logger::Get()->info(
+      "preprocess model: vertices {} -> {}, ACMR {:.3f} -> {:.3f}, weld {} ms, reorder {} ms",
+      model->VertexCount(), result->VertexCount(),
+      model->AverageCacheMissRatio(), result->AverageCacheMissRatio(),
+      weldTime, sw.ElapsedMilliseconds());
+  std::lock_guard<std::mutex> lock(_preprocessMutex);
+  auto [iter, isInsert] = _preprocessedModels.emplace(model.get(), std::make_pair(model, std::move(result)));
+  return iter->second.second;
+}
+
+Share<MeshTriangleRecord[]> BuildContext::GetTriangleRecords(
+    Share<const void> source,
+    const std::function<Share<MeshTriangleRecord[]>()>& build) {
+  const void* key = source.get();
+  {
+    std::lock_guard<std::mutex> lock(_recordMutex);
+    auto iter = _triangleRecords.find(key);
+    if (iter != _triangleRecords.end()) {
+      return iter->second.second;
+    }
+  }
+  Share<MeshTriangleRecord[]> records = build();
+  std::lock_guard<std::mutex> lock(_recordMutex);
+  auto [iter, isInsert] = _triangleRecords.emplace(key, std::make_pair(std::move(source), std::move(records)));
+  return iter->second.second;
+}
+
+void BuildContext::CountMeshReference(const ConfigNode& entityNode) {
+  ConfigNode shapeNode;
+  if (entityNode.TryRead("shape", shapeNode) && GetTypeFromConfig(shapeNode) == "mesh") {
+    std::string assetName = shapeNode.Read<std::string>("asset_name");
+    std::string subModel;
+    shapeNode.TryRead<std::string>("sub_model", subModel);
+    _meshRefCount[{assetName, subModel}]++;
+  }
+  ConfigNode childrenNodes;
+  if (entityNode.TryRead("children", childrenNodes)) {
+    for (const ConfigNode& childNode : childrenNodes.As<std::vector<ConfigNode>>()) {
+      CountMeshReference(childNode);
+    }
+  }
+}
+
 struct EntityConfig {
   ConfigNode Config;
   Matrix4 ToWorld = Matrix4::Identity();
 };
 
+/**
+ * @brief 一个实体创建出的所有实例, 组装之前暂存在这里
+ */
+struct EntityInstance {
+  Unique<Shape> ShapeInstance;
+  Unique<Light> LightInstance;
+  Unique<Bsdf> BsdfInstance;
+  Bsdf* BsdfRef = nullptr;
+  Unique<Medium> MediumInsideInstance;
+  Unique<Medium> MediumOutsideInstance;
+  bool IsMediumOutsideUseGlobal = true;
+};
+
 Unique<Renderer> BuildContext::Build() {
   //创建相机
   Unique<Camera> mainCamera;
@@ -126,6 +223,11 @@ Unique<Renderer> BuildContext::Build() {
       }
     }
   }
+  //统计模型被引用的次数, 被多次引用的 mesh 会实例化
+  _meshRefCount.clear();
+  for (auto&& entityNode : _sceneNode.As<std::vector<ConfigNode>>()) {
+    CountMeshReference(entityNode);
+  }
   //创建形状
   std::vector<Unique<Bsdf>> bsdfs;
   std::vector<Unique<Shape>> shapes;
@@ -134,6 +236,8 @@ Unique<Renderer> BuildContext::Build() {
   {
     //形状存在子形状，因此需要BFS来遍历
     //遍历过程中计算Model矩阵，将形状变换到世界空间
+    //遍历本身很快, 先把所有实体按BFS顺序展开, 真正耗时的创建再并行
+    std::vector<EntityConfig> entities;
     std::queue<EntityConfig> q;
     for (auto&& entityNode : _sceneNode.As<std::vector<ConfigNode>>()) {
       EntityConfig ecfg;
@@ -165,30 +269,35 @@ Unique<Renderer> BuildContext::Build() {
           }
         }
       }
+      entities.emplace_back(ecfg);
+    }
+    //实体之间互不依赖, 只会读取资产和已经创建好的BSDF变量, 所以可以同时创建
+    //结果按BFS顺序保存, 之后按顺序组装, 得到的场景与逐个创建时完全相同
+    std::vector<EntityInstance> instances(entities.size());
+    tbb::parallel_for(size_t(0), entities.size(), [&](size_t index) {
+      const EntityConfig& ecfg = entities[index];
+      const ConfigNode& entityNode = ecfg.Config;
+      EntityInstance& ins = instances[index];
       //尝试读取形状
-      Unique<Shape> shapeInstance;
       {
         ConfigNode shapeNode;
         if (entityNode.TryRead("shape", shapeNode)) {
           std::string type = GetTypeFromConfig(shapeNode);
           ShapeFactory* factory = _factoryMngr->GetFactory<ShapeFactory>(type);
-          shapeInstance = factory->Create(this, ecfg.ToWorld, shapeNode);
+          ins.ShapeInstance = factory->Create(this, ecfg.ToWorld, shapeNode);
         }
       }
       //尝试读取光源
-      Unique<Light> lightInstance;
       {
         ConfigNode lightNode;
         if (entityNode.TryRead("light", lightNode)) {
           std::string type = GetTypeFromConfig(lightNode);
           LightFactory* factory = _factoryMngr->GetFactory<LightFactory>(type);
-          lightInstance = factory->Create(this, ecfg.ToWorld, lightNode);
+          ins.LightInstance = factory->Create(this, ecfg.ToWorld, lightNode);
         }
       }
       //尝试读取BSDF
       //可能引用创建的BSDF遍历
-      Unique<Bsdf> bsdfInstance;
-      Bsdf* bsdfRef = nullptr;
       {
         ConfigNode bsdfNode;
         if (entityNode.TryRead("bsdf", bsdfNode)) {
@@ -199,35 +308,41 @@ Unique<Renderer> BuildContext::Build() {
             if (findBsdfRefIter == bsdfVariables.end()) {
               throw RadArgumentException("unknown bsdf var: {}", bsdfRefName);
             }
-            bsdfRef = findBsdfRefIter->second.get();
+            ins.BsdfRef = findBsdfRefIter->second.get();
           } else {
             std::string type = GetTypeFromConfig(bsdfNode);
             BsdfFactory* factory = _factoryMngr->GetFactory<BsdfFactory>(type);
-            bsdfInstance = factory->Create(this, bsdfNode);
+            ins.BsdfInstance = factory->Create(this, bsdfNode);
           }
         }
       }
       //尝试创建参与介质
       //如果没有定义外部介质，则默认使用全局的介质。如果不想使用则需声明is_global字段
-      Unique<Medium> mediumInsideInstance;
-      Unique<Medium> mediumOutsideInstance;
-      bool isMediumOutsideUseGlobal = true;
       {
         ConfigNode inMediumNode;
         if (entityNode.TryRead("in_medium", inMediumNode)) {
           std::string type = GetTypeFromConfig(inMediumNode);
           MediumFactory* factory = _factoryMngr->GetFactory<MediumFactory>(type);
-          mediumInsideInstance = factory->Create(this, ecfg.ToWorld, inMediumNode);
+          ins.MediumInsideInstance = factory->Create(this, ecfg.ToWorld, inMediumNode);
         }
         ConfigNode outMediumNode;
         if (entityNode.TryRead("out_medium", outMediumNode)) {
-          if (!outMediumNode.TryRead("is_global", isMediumOutsideUseGlobal)) {
+          if (!outMediumNode.TryRead("is_global", ins.IsMediumOutsideUseGlobal)) {
             std::string type = GetTypeFromConfig(outMediumNode);
             MediumFactory* factory = _factoryMngr->GetFactory<MediumFactory>(type);
-            mediumOutsideInstance = factory->Create(this, ecfg.ToWorld, outMediumNode);
+            ins.MediumOutsideInstance = factory->Create(this, ecfg.ToWorld, outMediumNode);
           }
         }
       }
+    });
+    for (EntityInstance& ins : instances) {
+      Unique<Shape> shapeInstance = std::move(ins.ShapeInstance);
+      Unique<Light> lightInstance = std::move(ins.LightInstance);
+      Unique<Bsdf> bsdfInstance = std::move(ins.BsdfInstance);
+      Bsdf* bsdfRef = ins.BsdfRef;
+      Unique<Medium> mediumInsideInstance = std::move(ins.MediumInsideInstance);
+      Unique<Medium> mediumOutsideInstance = std::move(ins.MediumOutsideInstance);
+      bool isMediumOutsideUseGlobal = ins.IsMediumOutsideUseGlobal;
       //开始组装实体
       //如果形状附加了光源，但是没定义BSDF，就加上漫反射材质以免报错
       if (lightInstance != nullptr && shapeInstance != nullptr && bsdfInstance == nullptr) {
@@ -3,9 +3,14 @@
 namespace Rad {
 
 Unique<SamplerFactory> _FactoryCreateIndependentFunc_();
+Unique<SamplerFactory> _FactoryCreateSobolFunc_();
+Unique<SamplerFactory> _FactoryCreateZSobolFunc_();
+Unique<SamplerFactory> _FactoryCreateHaltonFunc_();
+Unique<SamplerFactory> _FactoryCreatePcgFunc_();
 Unique<TextureFactory> _FactoryCreateBitmapFunc_();
 Unique<TextureFactory> _FactoryCreateChessboardFunc_();
 Unique<AccelFactory> _FactoryCreateEmbreeFunc_();
+Unique<AccelFactory> _FactoryCreateBvhFunc_();
 Unique<ShapeFactory> _FactoryCreateCubeFunc_();
 Unique<ShapeFactory> _FactoryCreateRectangleFunc_();
 Unique<ShapeFactory> _FactoryCreateSphereFunc_();
@@ -29,6 +34,7 @@ Unique<RendererFactory> _FactoryCreateAOFunc_();
 Unique<RendererFactory> _FactoryCreateBdptFunc_();
 Unique<RendererFactory> _FactoryCreatePTracerFunc_();
 Unique<RendererFactory> _FactoryCreateVolPathFunc_();
+Unique<RendererFactory> _FactoryCreateWavefrontPathFunc_();
 Unique<CameraFactory> _FactoryCreatePerspectiveFunc_();
 Unique<PhaseFunctionFactory> _FactoryCreateIsotropicPhaseFunc_();
 Unique<PhaseFunctionFactory> _FactoryCreateHenyeyGreensteinFunc_();
@@ -39,9 +45,14 @@ Unique<VolumeFactory> _FactoryCreateVolumeGridFunc_();
 std::vector<std::function<Unique<Factory>(void)>> GetRadOfflineFactories() {
   return {
       _FactoryCreateIndependentFunc_,
+      _FactoryCreateSobolFunc_,
+      _FactoryCreateZSobolFunc_,
+      _FactoryCreateHaltonFunc_,
+      _FactoryCreatePcgFunc_,
       _FactoryCreateBitmapFunc_,
       _FactoryCreateChessboardFunc_,
       _FactoryCreateEmbreeFunc_,
+      _FactoryCreateBvhFunc_,
       _FactoryCreateCubeFunc_,
       _FactoryCreateRectangleFunc_,
       _FactoryCreateSphereFunc_,
@@ -65,6 +76,7 @@ std::vector<std::function<Unique<Factory>(void)>> GetRadOfflineFactories() {
       _FactoryCreateBdptFunc_,
       _FactoryCreatePTracerFunc_,
       _FactoryCreateVolPathFunc_,
+      _FactoryCreateWavefrontPathFunc_,
       _FactoryCreatePerspectiveFunc_,
       _FactoryCreateIsotropicPhaseFunc_,
       _FactoryCreateHenyeyGreensteinFunc_,
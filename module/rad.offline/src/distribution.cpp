@@ -18,10 +18,23 @@ size_t DiscreteDistribution1D::Count() const {
 
 DiscreteDistribution1D::DiscreteDistribution1D(const Float* pmf, size_t size) {
   _pmf = std::vector<Float>(pmf, pmf + size);
+  BuildCdf();
+}
+
+DiscreteDistribution1D::DiscreteDistribution1D(const std::vector<Float>& data)
+    : DiscreteDistribution1D(data.data(), data.size()) {}
+
+DiscreteDistribution1D::DiscreteDistribution1D(std::vector<Float>&& data) {
+  _pmf = std::move(data);
+  BuildCdf();
+}
+
+void DiscreteDistribution1D::BuildCdf() {
+  size_t size = _pmf.size();
   _cdf.resize(size);
   Float64 sum = 0;
   for (size_t i = 0; i < size; i++) {
-    double value = (double)*pmf++;
+    double value = (double)_pmf[i];
     sum += value;
     _cdf[i] = (Float)sum;
   }
@@ -29,9 +42,6 @@ DiscreteDistribution1D::DiscreteDistribution1D(const Float* pmf, size_t size) {
   _normalization = Float(1.0 / sum);
 }
 
-DiscreteDistribution1D::DiscreteDistribution1D(const std::vector<Float>& data)
-    : DiscreteDistribution1D(data.data(), data.size()) {}
-
 size_t DiscreteDistribution1D::Sample(Float xi) const {
   Float value = xi * _sum;
   // lower_bound 返回大于等于value的迭代器(理论上不可能取到等于), 如果找不到(也就是比最大的还要大), 则返回end()
@@ -21,7 +21,14 @@ class AO final : public SampleRenderer {
 
   Spectrum Li(const RayDifferential& ray, const Scene& scene, Sampler* sampler) const override {
     SurfaceInteraction si;
-    if (!scene.RayIntersect(ray, si)) {
+    bool anyHit = scene.RayIntersect(ray, si);
+    return LiFromPrimaryHit(ray, si, anyHit, scene, sampler);
+  }
+
+  bool HasPrimaryHitLi() const override { return true; }
+
+  Spectrum LiFromPrimaryHit(const RayDifferential& ray, SurfaceInteraction& si, bool anyHit, const Scene& scene, Sampler* sampler) const override {
+    if (!anyHit) {
       return Spectrum(0);
     }
     Vector3 wo = Warp::SquareToCosineHemisphere(sampler->Next2D());
@@ -6,14 +6,13 @@
 #include <rad/offline/render/interaction.h>
 #include <rad/offline/render/scene.h>
 #include <rad/offline/render/shape.h>
+#include <rad/offline/render/splat_film.h>
 
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
 #include <tbb/global_control.h>
 #include <tbb/enumerable_thread_specific.h>
 
-#include <random>
-
 using namespace Rad::Math;
 
 namespace Rad {
@@ -227,11 +226,8 @@ class BDPT final : public Renderer {
   }
 
   struct BdptTlsData {
-    BdptTlsData(MatrixX<Spectrum>::Index x, MatrixX<Spectrum>::Index y) : TempFb(x, y) {}
-
     std::vector<PathVertex> LightPath{};
     std::vector<PathVertex> CameraPath{};
-    MatrixX<Spectrum> TempFb;
   };
 
   void Render() {
@@ -239,70 +235,123 @@ class BDPT final : public Renderer {
     Camera& camera = scene.GetCamera();
     const Sampler& sampler = camera.GetSampler();
     MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
-    _allTask = frameBuffer.cols() * frameBuffer.rows();
+    UInt32 spp = sampler.SampleCount();
+    //没有时间预算和检查点时只有一轮, 每个像素一次采样到 SampleCount
+    UInt32 sppPerPass = (HasTimeBudget() || IsCheckpointEnabled()) ? _sppPerPass : spp;
+    UInt64 pixelCount = CropPixelCount();
+    //每个像素样本都会生成一条光路径, 只渲染部分区域时光路径变少了, t=1 策略落在每个像素上的样本数只有原来的 ratio 倍
+    //溅射的贡献按 1/ratio 放大保持无偏, 同时 MISWeight 把样本数算进权重, 让其他策略承担大部分贡献, 方差不会随区域变小而增大
+    _lightSampleRatio = Float(pixelCount) / Float(frameBuffer.size());
+    _splatScale = 1 / _lightSampleRatio;
+    if (HasTimeBudget()) {
+      UpdateTimeBudgetProgress();
+    } else {
+      _allTask = pixelCount * spp;
+    }
     tbb::affinity_partitioner part;
     std::unique_ptr<tbb::global_control> ctrl;
     if (_threadCount > 0) {
       ctrl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, _threadCount);
     }
     tbb::blocked_range2d<UInt32> block(
-        0, camera.Resolution().x(),
-        0, camera.Resolution().y());
-    std::mutex mutex;
-    tbb::enumerable_thread_specific<BdptTlsData> tlsData(frameBuffer.rows(), frameBuffer.cols());
+        _cropMin.x(), _cropMax.x(),
+        _cropMin.y(), _cropMax.y());
+    tbb::enumerable_thread_specific<BdptTlsData> tlsData;
+    tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+    //光路连接到相机时会贡献到任意像素, 所以累加整张图的未归一化结果, 每轮结束后再除以样本数
+    //所有线程直接原子累加到同一张胶卷上, 不再为每个线程准备一整张图
+    SplatFilm film(Int32(frameBuffer.rows()), Int32(frameBuffer.cols()));
+    _logger->debug("splat film uses {} MB", film.MemoryUsage() / (1024 * 1024));
+    UInt32 sampleIndex = 0;  //已经完成的轮次里每个像素的样本数
+    UInt32 pass = 0;
+    if (_resume != nullptr) {
+      film.Set(_resume->Accumulate);
+      sampleIndex = UInt32(_resume->TotalSampleCount);
+      pass = _resume->Pass;
+      _resume.reset();
+      if (sampleIndex > 0) {
+        Float coeff = Float(1) / sampleIndex;
+        for (UInt32 y = 0; y < frameBuffer.cols(); y++) {
+          for (UInt32 x = 0; x < frameBuffer.rows(); x++) {
+            frameBuffer(x, y) = Spectrum(film.Get(x, y) * coeff);
+          }
+        }
+      }
+      if (!HasTimeBudget()) {
+        _completeTask = std::min(pixelCount * sampleIndex, _allTask);
+      }
+    }
     _sw.Start();
-    tbb::parallel_for(
-        block, [&](const tbb::blocked_range2d<UInt32>& r) {
-          auto& tls = tlsData.local();
-          UInt32 seed = r.rows().begin() * camera.Resolution().x() + r.cols().begin();
-          std::mt19937 rng(seed);
-          std::vector<PathVertex>& lightPath = tls.LightPath;
-          std::vector<PathVertex>& cameraPath = tls.CameraPath;
-          MatrixX<Spectrum>& tempFb = tls.TempFb;
-          std::uniform_real_distribution<Float> dist;
-          Unique<Sampler> localSampler = sampler.Clone(sampler.GetSeed() + seed);
-          tempFb.setZero();
-          for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
-            for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
-              Spectrum radiance(0);
-              for (UInt32 i = 0; i < sampler.SampleCount(); i++) {
+    for (; !_isStop; pass++) {
+      if (HasTimeBudget() ? (pass > 0 && IsTimeBudgetExhausted()) : sampleIndex >= spp) {
+        break;
+      }
+      UInt32 passSpp = HasTimeBudget() ? sppPerPass : std::min(sppPerPass, spp - sampleIndex);
+      tbb::parallel_for(
+          block, [&](const tbb::blocked_range2d<UInt32>& r) {
+            auto& tls = tlsData.local();
+            std::vector<PathVertex>& lightPath = tls.LightPath;
+            std::vector<PathVertex>& cameraPath = tls.CameraPath;
+            Sampler* localSampler = samplers.local().get();
+            for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
+              for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
+                Spectrum radiance(0);
+                for (UInt32 i = 0; i < passSpp; i++) {
+                  if (_isStop) {
+                    break;
+                  }
+                  localSampler->StartPixelSample(Vector2i(x, y), sampleIndex + i);
+                  lightPath.clear();
+                  cameraPath.clear();
+                  Vector2 scrPos = Vector2(x, y) + localSampler->Next2D();
+                  Ray ray = camera.SampleRay(scrPos);
+                  Spectrum li = Li(ray, scene, camera, *localSampler, film, lightPath, cameraPath, Vector2(x, y));
+                  if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
+                    _logger->warn("invalid spectrum {}", li);
+                  } else {
+                    radiance += li;
+                  }
+                }
+                film.Add(x, y, radiance);
                 if (_isStop) {
                   break;
                 }
-                localSampler->Advance();
-                lightPath.clear();
-                cameraPath.clear();
-                Vector2 scrPos(x + dist(rng), y + dist(rng));
-                Ray ray = camera.SampleRay(scrPos);
-                Spectrum li = Li(ray, scene, camera, *localSampler, tempFb, lightPath, cameraPath, Vector2(x, y));
-                if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
-                  _logger->warn("invalid spectrum {}", li);
-                } else {
-                  radiance += li;
-                }
               }
-              tempFb(x, y) += radiance;
               if (_isStop) {
                 break;
               }
             }
-            if (_isStop) {
-              break;
+            if (!HasTimeBudget()) {
+              _completeTask += r.cols().size() * r.rows().size() * passSpp;
             }
-          }
-          Float coeff = Float(1) / sampler.SampleCount();
-          for (UInt32 y = 0; y < tempFb.rows(); y++) {
-            for (UInt32 x = 0; x < tempFb.cols(); x++) {
-              tempFb(y, x) *= coeff;
-            }
-          }
-          {
-            std::lock_guard<std::mutex> lock(mutex);
-            frameBuffer += tempFb;
-          }
-          _completeTask += r.cols().size() * r.rows().size();
-        },
-        part);
+          },
+          part);
+      //中途停止的轮次不完整, frame buffer 保留上一轮的结果
+      if (_isStop && (HasTimeBudget() || IsCheckpointEnabled()) && sampleIndex > 0) {
+        break;
+      }
+      sampleIndex += passSpp;
+      Float coeff = Float(1) / sampleIndex;
+      for (UInt32 y = 0; y < frameBuffer.cols(); y++) {
+        for (UInt32 x = 0; x < frameBuffer.rows(); x++) {
+          frameBuffer(x, y) = Spectrum(film.Get(x, y) * coeff);
+        }
+      }
+      if (HasTimeBudget()) {
+        UpdateTimeBudgetProgress();
+      }
+      if (!_isStop && IsCheckpointDue()) {
+        RenderCheckpoint ckpt;
+        ckpt.Pass = pass + 1;
+        ckpt.TotalSampleCount = sampleIndex;
+        ckpt.Accumulate = film.ToMatrix();
+        ckpt.SampleCounts = MatrixX<UInt32>::Constant(frameBuffer.rows(), frameBuffer.cols(), sampleIndex);
+        WriteCheckpoint(ckpt);
+      }
+    }
+    if (HasTimeBudget()) {
+      _logger->info("time budget {} ms done. spp: {}, elapsed: {} ms", _timeBudget, sampleIndex, ElapsedTime());
+    }
     _sw.Stop();
     _isComplete = true;
   }
@@ -312,7 +361,7 @@ class BDPT final : public Renderer {
       const Scene& scene,
       const Camera& camera,
       Sampler& sampler,
-      MatrixX<Spectrum>& img,
+      SplatFilm& img,
       std::vector<PathVertex>& lightPath,
       std::vector<PathVertex>& cameraPath,
       const Vector2& scrPos) {
@@ -330,7 +379,9 @@ class BDPT final : public Renderer {
         Vector2 screenPos = scrPos;
         Spectrum pathL = ConnectBdpt(scene, camera, sampler, lightPath, cameraPath, s, t, screenPos);
         if (t == 1) {
-          img((int)screenPos.x(), (int)screenPos.y()) += pathL;
+          if (IsInCrop((int)screenPos.x(), (int)screenPos.y())) {
+            img.Add((int)screenPos.x(), (int)screenPos.y(), Spectrum(pathL * _splatScale));
+          }
         } else {
           l += pathL;
         }
@@ -601,12 +652,14 @@ class BDPT final : public Renderer {
       if (qsMinus) a7 = {&qsMinus->PdfRev, qs->Pdf(scene, pt, *qsMinus)};
 
       // Consider hypothetical connection strategies along the camera subpath
+      //Veach 多样本 MIS: 每个策略的概率密度还要乘上它的样本数, t=1 策略的样本数是 _lightSampleRatio, 其他都是 1
+      Float ownCount = t == 1 ? _lightSampleRatio : 1;
       Float ri = 1;
       for (int i = t - 1; i > 0; --i) {
         ri *=
             remap0(cameraVertices[i].PdfRev) / remap0(cameraVertices[i].PdfFwd);
         if (!cameraVertices[i].IsDelta && !cameraVertices[i - 1].IsDelta)
-          sumRi += ri;
+          sumRi += ri * (i == 1 ? _lightSampleRatio : 1) / ownCount;
       }
 
       // Consider hypothetical connection strategies along the light subpath
@@ -615,19 +668,21 @@ class BDPT final : public Renderer {
         ri *= remap0(lightVertices[i].PdfRev) / remap0(lightVertices[i].PdfFwd);
         bool deltaLightvertex = i > 0 ? lightVertices[i - 1].IsDelta
                                       : lightVertices[0].IsDelta;
-        if (!lightVertices[i].IsDelta && !deltaLightvertex) sumRi += ri;
+        if (!lightVertices[i].IsDelta && !deltaLightvertex) sumRi += ri / ownCount;
       }
       return 1 / (1 + sumRi);
     } else {
+      //不用 MIS 时按样本数平均分配权重
+      Float ownCount = t == 1 ? _lightSampleRatio : 1;
       Float sumRi = 0;
       for (int i = t - 1; i > 0; --i) {
         if (!cameraVertices[i].IsDelta && !cameraVertices[i - 1].IsDelta)
-          sumRi++;
+          sumRi += (i == 1 ? _lightSampleRatio : 1) / ownCount;
       }
       for (int i = s - 1; i >= 0; --i) {
         bool deltaLightvertex = i > 0 ? lightVertices[i - 1].IsDelta
                                       : lightVertices[0].IsDelta;
-        if (!lightVertices[i].IsDelta && !deltaLightvertex) sumRi++;
+        if (!lightVertices[i].IsDelta && !deltaLightvertex) sumRi += 1 / ownCount;
       }
       return 1 / (1 + sumRi);
     }
@@ -665,6 +720,8 @@ class BDPT final : public Renderer {
   Int32 _maxDepth;
   Int32 _rrDepth;
   bool _useMis;
+  Float _splatScale{1};        //t=1 策略溅射到图片上的贡献的缩放
+  Float _lightSampleRatio{1};  //t=1 策略每个像素的样本数相对于其他策略的比例, 只渲染部分区域时小于1
 };
 
 class BdptFactory final : public RendererFactory {
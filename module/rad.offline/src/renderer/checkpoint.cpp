@@ -0,0 +1,125 @@
+#include <rad/offline/render/checkpoint.h>
+
+#include <fstream>
+#include <cstring>
+
+namespace Rad {
+
+static constexpr char CheckpointMagic[8] = {'R', 'A', 'D', 'C', 'K', 'P', 'T', '\0'};
+static constexpr UInt32 CheckpointVersion = 1;
+
+static_assert(sizeof(Spectrum) == sizeof(Float) * Spectrum::ComponentCount, "spectrum must be tightly packed");
+
+template <typename T>
+static void WritePod(std::ostream& stream, const T& value) {
+  stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+static T ReadPod(std::istream& stream) {
+  T value{};
+  stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+  if (!stream) {
+    throw RadInvalidOperationException("checkpoint is truncated");
+  }
+  return value;
+}
+
+template <typename T>
+static void WriteMatrix(std::ostream& stream, const MatrixX<T>& mat) {
+  WritePod(stream, UInt64(mat.rows()));
+  WritePod(stream, UInt64(mat.cols()));
+  stream.write(reinterpret_cast<const char*>(mat.data()), sizeof(T) * mat.size());
+}
+
+template <typename T>
+static void ReadMatrix(std::istream& stream, MatrixX<T>& mat) {
+  UInt64 rows = ReadPod<UInt64>(stream);
+  UInt64 cols = ReadPod<UInt64>(stream);
+  mat.resize(rows, cols);
+  stream.read(reinterpret_cast<char*>(mat.data()), sizeof(T) * mat.size());
+  if (!stream) {
+    throw RadInvalidOperationException("checkpoint is truncated");
+  }
+}
+
+void RenderCheckpoint::Write(const std::filesystem::path& path, const RenderCheckpoint& ckpt) {
+  std::filesystem::path temp = path;
+  temp += ".tmp";
+  {
+    std::ofstream stream(temp, std::ios::binary | std::ios::out | std::ios::trunc);
+    if (!stream.is_open()) {
+      throw RadInvalidOperationException("cannot write checkpoint: {}", temp.u8string());
+    }
+    stream.write(CheckpointMagic, sizeof(CheckpointMagic));
+    WritePod(stream, CheckpointVersion);
+    WritePod(stream, UInt32(sizeof(Float)));
+    WritePod(stream, ckpt.SceneHash);
+    WritePod(stream, ckpt.Seed);
+    WritePod(stream, ckpt.Pass);
+    WritePod(stream, ckpt.TotalSampleCount);
+    WritePod(stream, ckpt.ElapsedTime);
+    WriteMatrix(stream, ckpt.Accumulate);
+    WriteMatrix(stream, ckpt.SampleCounts);
+    WriteMatrix(stream, ckpt.LumMean);
+    WriteMatrix(stream, ckpt.LumM2);
+    WriteMatrix(stream, ckpt.IsConverged);
+    stream.flush();
+    if (!stream) {
+      throw RadInvalidOperationException("fail to write checkpoint: {}", temp.u8string());
+    }
+  }
+  //同一个文件系统内的重命名是原子的, 旧的检查点要么完整保留要么被完整替换
+  std::filesystem::rename(temp, path);
+}
+
+RenderCheckpoint RenderCheckpoint::Read(const std::filesystem::path& path) {
+  std::ifstream stream(path, std::ios::binary | std::ios::in);
+  if (!stream.is_open()) {
+    throw RadFileNotFoundException("cannot open checkpoint: {}", path.u8string());
+  }
+  char magic[sizeof(CheckpointMagic)]{};
+  stream.read(magic, sizeof(magic));
+  if (!stream || std::memcmp(magic, CheckpointMagic, sizeof(magic)) != 0) {
+    throw RadInvalidOperationException("not a checkpoint file: {}", path.u8string());
+  }
+  UInt32 version = ReadPod<UInt32>(stream);
+  if (version != CheckpointVersion) {
+    throw RadNotSupportedException("unsupported checkpoint version: {}", version);
+  }
+  UInt32 floatSize = ReadPod<UInt32>(stream);
+  if (floatSize != sizeof(Float)) {
+    throw RadNotSupportedException("checkpoint float size {} mismatch, current is {}", floatSize, sizeof(Float));
+  }
+  RenderCheckpoint ckpt;
+  ckpt.SceneHash = ReadPod<UInt64>(stream);
+  ckpt.Seed = ReadPod<UInt32>(stream);
+  ckpt.Pass = ReadPod<UInt32>(stream);
+  ckpt.TotalSampleCount = ReadPod<UInt64>(stream);
+  ckpt.ElapsedTime = ReadPod<Int64>(stream);
+  ReadMatrix(stream, ckpt.Accumulate);
+  ReadMatrix(stream, ckpt.SampleCounts);
+  ReadMatrix(stream, ckpt.LumMean);
+  ReadMatrix(stream, ckpt.LumM2);
+  ReadMatrix(stream, ckpt.IsConverged);
+  return ckpt;
+}
+
+UInt64 RenderCheckpoint::HashSceneConfig(const nlohmann::json& cfg) {
+  nlohmann::json copy = cfg;
+  auto renderer = copy.find("renderer");
+  if (renderer != copy.end() && renderer->is_object()) {
+    renderer->erase("time_budget_ms");
+    renderer->erase("checkpoint_interval_ms");
+  }
+  // FNV-1a, 结果不依赖标准库实现, 不同平台编译的程序可以互相恢复
+  std::string str = copy.dump();
+  UInt64 hash = 14695981039346656037ULL;
+  for (char c : str) {
+    hash ^= UInt8(c);
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+}  // namespace Rad
@@ -6,6 +6,7 @@
 #include <rad/offline/render/interaction.h>
 #include <rad/offline/render/scene.h>
 #include <rad/offline/render/shape.h>
+#include <rad/offline/render/splat_film.h>
 
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
@@ -24,6 +25,7 @@ class ParticleTracer final : public Renderer {
   ParticleTracer(BuildContext* ctx, Unique<Scene> scene, const ConfigNode& cfg) : Renderer(ctx, std::move(scene), cfg) {
     _maxDepth = cfg.ReadOrDefault("max_depth", -1);
     _rrDepth = cfg.ReadOrDefault("rr_depth", 3);
+    _particlesPerPass = cfg.ReadOrDefault("particles_per_pass", UInt32(0));
   }
   ~ParticleTracer() noexcept override = default;
 
@@ -51,32 +53,91 @@ class ParticleTracer final : public Renderer {
       actualThreadCount = (UInt32)_threadCount;
     }
     UInt32 spp = sampler.SampleCount();
-    _allTask = spp;
-    Float sampleScale = frameBuffer.size() / ((Float)spp);
-    UInt64 grainSize = std::max((UInt64)actualThreadCount / (4 * _allTask), UInt64(1));
-    tbb::blocked_range<UInt32> block(0, spp, grainSize);
-    std::mutex mutex;
-    tbb::enumerable_thread_specific<MatrixX<Spectrum>> tlsData(frameBuffer.rows(), frameBuffer.cols());
-    _sw.Start();
-    tbb::parallel_for(
-        block, [&](const tbb::blocked_range<UInt32>& r) {
-          MatrixX<Spectrum>& tempFb = tlsData.local();
-          UInt64 completeCount = 0;
-          tempFb.setZero();
-          completeCount = 0;
-          Unique<Sampler> localSampler = sampler.Clone(sampler.GetSeed() + r.begin());
-          for (UInt32 i = r.begin(); i < r.end(); i++) {
-            Sample(scene, camera, localSampler.get(), tempFb, sampleScale);
-            localSampler->Advance();
-            completeCount++;
-          }
-          {
-            std::lock_guard<std::mutex> lock(mutex);
-            frameBuffer += tempFb;
+    //粒子会落在整张图片的任意位置, 只渲染部分区域时也要追踪同样多的粒子, 区域内的噪声才和渲染整张图片时一样
+    //区域外的溅射直接丢弃, 省下的只有写入胶卷的开销
+    UInt64 particleBudget = spp;
+    //每一轮追踪的粒子数. 没有时间预算时一共追踪 particleBudget 个粒子, 有时间预算时一直追踪到用完时间
+    UInt32 perPass = _particlesPerPass == 0 ? UInt32(particleBudget) : UInt32(std::min(UInt64(_particlesPerPass), particleBudget));
+    if (HasTimeBudget()) {
+      UpdateTimeBudgetProgress();
+    } else {
+      _allTask = particleBudget;
+    }
+    //每个粒子的贡献先不除以粒子数, 每轮结束后再按实际追踪的粒子总数归一化
+    Float sampleScale = Float(frameBuffer.size());
+    UInt64 grainSize = std::max((UInt64)actualThreadCount / (4 * (UInt64)perPass), UInt64(1));
+    //粒子会溅射到任意像素, 所有线程直接原子累加到同一张胶卷上
+    SplatFilm film(Int32(frameBuffer.rows()), Int32(frameBuffer.cols()));
+    _logger->debug("splat film uses {} MB", film.MemoryUsage() / (1024 * 1024));
+    tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+    UInt64 particleCount = 0;
+    UInt32 pass = 0;
+    if (_resume != nullptr) {
+      film.Set(_resume->Accumulate);
+      particleCount = _resume->TotalSampleCount;
+      pass = _resume->Pass;
+      _resume.reset();
+      if (particleCount > 0) {
+        Float coeff = Float(1) / Float(particleCount);
+        for (UInt32 y = 0; y < frameBuffer.cols(); y++) {
+          for (UInt32 x = 0; x < frameBuffer.rows(); x++) {
+            frameBuffer(x, y) = Spectrum(film.Get(x, y) * coeff);
           }
-          _completeTask += completeCount;
-        },
-        part);
+        }
+      }
+      if (!HasTimeBudget()) {
+        _completeTask = std::min(particleCount, _allTask);
+      }
+    }
+    _sw.Start();
+    for (; !_isStop; pass++) {
+      if (HasTimeBudget() ? (pass > 0 && IsTimeBudgetExhausted()) : particleCount >= particleBudget) {
+        break;
+      }
+      UInt32 passCount = HasTimeBudget() ? perPass : UInt32(std::min(UInt64(perPass), particleBudget - particleCount));
+      tbb::blocked_range<UInt32> block(0, passCount, grainSize);
+      tbb::parallel_for(
+          block, [&](const tbb::blocked_range<UInt32>& r) {
+            UInt64 completeCount = 0;
+            Sampler* localSampler = samplers.local().get();
+            for (UInt32 i = r.begin(); i < r.end(); i++) {
+              //粒子追踪没有像素的概念, 用全局粒子索引区分每条光路
+              //每 SampleCount 个粒子换一个像素坐标, 这样轮次怎么划分都不影响结果
+              UInt64 index = particleCount + i;
+              localSampler->StartPixelSample(Vector2i(Int32(index / spp), 0), UInt32(index % spp));
+              Sample(scene, camera, localSampler, film, sampleScale);
+              completeCount++;
+            }
+            if (!HasTimeBudget()) {
+              _completeTask += completeCount;
+            }
+          },
+          part);
+      if (_isStop && (HasTimeBudget() || IsCheckpointEnabled()) && particleCount > 0) {
+        break;
+      }
+      particleCount += passCount;
+      Float coeff = Float(1) / Float(particleCount);
+      for (UInt32 y = 0; y < frameBuffer.cols(); y++) {
+        for (UInt32 x = 0; x < frameBuffer.rows(); x++) {
+          frameBuffer(x, y) = Spectrum(film.Get(x, y) * coeff);
+        }
+      }
+      if (HasTimeBudget()) {
+        UpdateTimeBudgetProgress();
+      }
+      if (!_isStop && IsCheckpointDue()) {
+        RenderCheckpoint ckpt;
+        ckpt.Pass = pass + 1;
+        ckpt.TotalSampleCount = particleCount;
+        ckpt.Accumulate = film.ToMatrix();
+        ckpt.SampleCounts = MatrixX<UInt32>::Zero(frameBuffer.rows(), frameBuffer.cols());
+        WriteCheckpoint(ckpt);
+      }
+    }
+    if (HasTimeBudget()) {
+      _logger->info("time budget {} ms done. particle: {}, elapsed: {} ms", _timeBudget, particleCount, ElapsedTime());
+    }
     _sw.Stop();
     _isComplete = true;
   }
@@ -85,7 +146,7 @@ class ParticleTracer final : public Renderer {
       const Scene& scene,
       const Camera& camera,
       Sampler* sampler,
-      MatrixX<Spectrum>& image,
+      SplatFilm& image,
       Float sampleScale) {
     if (_maxDepth != 0) {
       SampleLight(scene, camera, sampler, image, sampleScale);
@@ -100,7 +161,7 @@ class ParticleTracer final : public Renderer {
       const Scene& scene,
       const Camera& camera,
       Sampler* sampler,
-      MatrixX<Spectrum>& image,
+      SplatFilm& image,
       Float sampleScale) {
     auto [lightIndex, lightPdf] = scene.SampleLight(sampler->Next1D());
     const Light* light = scene.GetLight(lightIndex);
@@ -135,7 +196,7 @@ class ParticleTracer final : public Renderer {
       const DirectionSampleResult& cameraSample,
       const Bsdf* bsdf,
       const Spectrum& weight,
-      MatrixX<Spectrum>& image,
+      SplatFilm& image,
       Float sampleScale) {
     if (cameraSample.Pdf <= 0 || weight.IsBlack()) {
       return;
@@ -167,8 +228,11 @@ class ParticleTracer final : public Renderer {
         }
       }
     }
+    if (!IsInCrop((int)cameraSample.UV.x(), (int)cameraSample.UV.y())) {
+      return;
+    }
     auto ij = weight.cwiseProduct(fs) * sampleScale;
-    image((int)cameraSample.UV.x(), (int)cameraSample.UV.y()) += Spectrum(ij);
+    image.Add((int)cameraSample.UV.x(), (int)cameraSample.UV.y(), Spectrum(ij));
   }
 
   void TraceLightRay(
@@ -177,7 +241,7 @@ class ParticleTracer final : public Renderer {
       const Camera& camera,
       Sampler* sampler,
       Spectrum throughput,
-      MatrixX<Spectrum>& image,
+      SplatFilm& image,
       Float sampleScale) {
     Float eta(1);
     Int32 depth = 1;
@@ -228,6 +292,7 @@ class ParticleTracer final : public Renderer {
 
   Int32 _maxDepth;
   Int32 _rrDepth;
+  UInt32 _particlesPerPass;  //每一轮追踪的粒子数, 0表示一轮追踪 SampleCount 个
 };
 
 class PTracerFactory final : public RendererFactory {
@@ -28,7 +28,15 @@ class Path final : public SampleRenderer {
     _rrDepth = cfg.ReadOrDefault("rr_depth", 3);
   }
 
-  Spectrum Li(const RayDifferential& ray_, const Scene& scene, Sampler* sampler) const override {
+  Spectrum Li(const RayDifferential& ray, const Scene& scene, Sampler* sampler) const override {
+    SurfaceInteraction si{};
+    bool anyHit = scene.RayIntersect(ray, si);
+    return LiFromPrimaryHit(ray, si, anyHit, scene, sampler);
+  }
+
+  bool HasPrimaryHitLi() const override { return true; }
+
+  Spectrum LiFromPrimaryHit(const RayDifferential& ray_, SurfaceInteraction& primarySi, bool primaryHit, const Scene& scene, Sampler* sampler) const override {
 #if 0
     Ray ray = ray_;
     Spectrum throughput(1);
@@ -140,7 +148,13 @@ class Path final : public SampleRenderer {
     BsdfContext ctx{};
     for (;; depth++) {
       SurfaceInteraction si{};
-      bool anyHit = scene.RayIntersect(ray, si);
+      bool anyHit;
+      if (depth == 0) {  //相机光线的交点已经由调用者求出
+        si = primarySi;
+        anyHit = primaryHit;
+      } else {
+        anyHit = scene.RayIntersect(ray, si);
+      }
       std::optional<Light*> hitLight = scene.GetLight(si);
       //直接光照, 随机游走的路径直连光源
       if (hitLight) {
@@ -170,8 +184,11 @@ class Path final : public SampleRenderer {
         break;
       }
       Bsdf* bsdf = si.BSDF(ray);
+      //每次反弹一次性取出所有样本, 无论是否用到都消耗相同的维度: 光源位置, BSDF方向, 光源选择, BSDF lobe, 轮盘赌
+      Float u[7];
+      sampler->NextArray(u, 7);
       if (bsdf->HasAnyTypeExceptDelta()) {  // BSDF只有delta的lobe就不启用光源采样了
-        auto [l, dsr, li] = scene.SampleLightDirection(si, sampler->Next1D(), sampler->Next2D());
+        auto [l, dsr, li] = scene.SampleLightDirection(si, u[4], Vector2(u[0], u[1]));
         if (dsr.Pdf > 0) {
           Vector3 wo = si.ToLocal(dsr.Dir);
           Spectrum f = bsdf->Eval(ctx, si, wo);
@@ -191,7 +208,7 @@ class Path final : public SampleRenderer {
       }
       {
         //采样下一条路径
-        auto [bsr, f] = bsdf->Sample(ctx, si, sampler->Next1D(), sampler->Next2D());
+        auto [bsr, f] = bsdf->Sample(ctx, si, u[5], Vector2(u[2], u[3]));
         if (bsr.Pdf <= 0) {
           break;
         } else {
@@ -212,7 +229,7 @@ class Path final : public SampleRenderer {
       if (depth >= _rrDepth) {
         Float maxThroughput = throughput.MaxComponent();
         Float rr = std::min(maxThroughput * Math::Sqr(eta), Float(0.95));
-        if (sampler->Next1D() > rr) {
+        if (u[6] > rr) {
           break;
         }
         throughput *= Math::Rcp(rr);
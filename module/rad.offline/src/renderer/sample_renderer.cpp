@@ -10,8 +10,9 @@
 #include <tbb/blocked_range2d.h>
 #include <tbb/parallel_for.h>
 #include <tbb/global_control.h>
+#include <tbb/enumerable_thread_specific.h>
 
-#include <random>
+#include <limits>
 
 namespace Rad {
 
@@ -19,6 +20,19 @@ Renderer::Renderer(BuildContext* ctx, Unique<Scene> scene, const ConfigNode& cfg
   _logger = Logger::GetCategory("renderer");
   _scene = std::move(scene);
   _threadCount = cfg.ReadOrDefault("thread_count", -1);
+  _sppPerPass = std::max(cfg.ReadOrDefault("spp_per_pass", UInt32(1)), UInt32(1));
+  _timeBudget = cfg.ReadOrDefault("time_budget_ms", UInt32(0));
+  _checkpointInterval = cfg.ReadOrDefault("checkpoint_interval_ms", UInt32(0));
+  Vector2i resolution = _scene->GetCamera().Resolution();
+  _cropMin = Vector2i::Zero();
+  _cropMax = resolution;
+  ConfigNode cropNode;
+  if (cfg.TryRead("crop", cropNode)) {
+    Vector2i offset = cropNode.ReadOrDefault("offset", Vector2i(0, 0));
+    Vector2i size = cropNode.Read<Vector2i>("size");
+    SetCrop(offset, offset + size);
+  }
+  _isSaveDataWindow = cfg.ReadOrDefault("crop_data_window", false);
 }
 
 void Renderer::Wait() {
@@ -31,17 +45,106 @@ void Renderer::Stop() {
   _isStop = true;
 }
 
-void Renderer::SaveResult(const LocationResolver& resolver) const {
-  auto&& fb = _scene->GetCamera().GetFrameBuffer();
-  MatrixX<Color24f> tmp(fb.rows(), fb.cols());
-  for (UInt32 y = 0; y < tmp.cols(); y++) {
-    for (UInt32 x = 0; x < tmp.rows(); x++) {
-      tmp.coeffRef(x, y) = fb.coeff(x, y).cast<Float32>();
+void Renderer::SetCrop(const Vector2i& min, const Vector2i& max) {
+  if (_renderThread != nullptr) {
+    throw RadInvalidOperationException("cannot change crop after render started");
+  }
+  Vector2i resolution = _scene->GetCamera().Resolution();
+  _cropMin = min.cwiseMax(0).cwiseMin(resolution);
+  _cropMax = max.cwiseMax(_cropMin).cwiseMin(resolution);
+  if (CropPixelCount() == 0) {
+    throw RadArgumentException("crop window is empty. min: ({}, {}), max: ({}, {})", min.x(), min.y(), max.x(), max.y());
+  }
+}
+
+void Renderer::SetSampleRange(UInt32 begin, UInt32 end) {
+  throw RadNotSupportedException("this renderer cannot render a sample range");
+}
+
+void Renderer::GetPartialResult(RenderCheckpoint& result) const {
+  //渲染器只留下了归一化之后的结果, 所以区域内每个像素的权重都是1
+  const MatrixX<Spectrum>& fb = _scene->GetCamera().GetFrameBuffer();
+  result.Accumulate = MatrixX<Spectrum>::Constant(fb.rows(), fb.cols(), Spectrum(0));
+  result.SampleCounts = MatrixX<UInt32>::Zero(fb.rows(), fb.cols());
+  for (Int32 y = _cropMin.y(); y < _cropMax.y(); y++) {
+    for (Int32 x = _cropMin.x(); x < _cropMax.x(); x++) {
+      result.Accumulate(x, y) = fb(x, y);
+      result.SampleCounts(x, y) = 1;
     }
   }
+  result.Seed = _scene->GetCamera().GetSampler().GetSeed();
+  result.ElapsedTime = ElapsedTime();
+}
+
+void Renderer::UpdateTimeBudgetProgress() {
+  _allTask = _timeBudget;
+  _completeTask = std::min(UInt64(std::max(ElapsedTime(), Int64(0))), _allTask);
+}
+
+void Renderer::SetCheckpoint(const std::filesystem::path& path, UInt64 sceneHash) {
+  _checkpointPath = path;
+  _sceneHash = sceneHash;
+}
+
+void Renderer::Resume(const std::filesystem::path& path, UInt64 sceneHash) {
+  if (_renderThread != nullptr) {
+    throw RadInvalidOperationException("cannot resume after render started");
+  }
+  auto ckpt = std::make_unique<RenderCheckpoint>(RenderCheckpoint::Read(path));
+  if (ckpt->SceneHash != sceneHash) {
+    throw RadArgumentException("checkpoint {} does not belong to current scene", path.u8string());
+  }
+  const Camera& camera = _scene->GetCamera();
+  const MatrixX<Spectrum>& fb = camera.GetFrameBuffer();
+  if (ckpt->Accumulate.rows() != fb.rows() || ckpt->Accumulate.cols() != fb.cols() ||
+      ckpt->SampleCounts.rows() != fb.rows() || ckpt->SampleCounts.cols() != fb.cols()) {
+    throw RadArgumentException("checkpoint resolution mismatch");
+  }
+  if (ckpt->Seed != camera.GetSampler().GetSeed()) {
+    throw RadArgumentException("checkpoint seed {} mismatch, current is {}", ckpt->Seed, camera.GetSampler().GetSeed());
+  }
+  _elapsedOffset = ckpt->ElapsedTime;
+  _lastCheckpoint = ckpt->ElapsedTime;
+  _logger->info("resume from checkpoint {}. pass: {}, elapsed: {} ms", path.u8string(), ckpt->Pass, ckpt->ElapsedTime);
+  _resume = std::move(ckpt);
+}
+
+void Renderer::WriteCheckpoint(RenderCheckpoint& ckpt) {
+  ckpt.SceneHash = _sceneHash;
+  ckpt.Seed = _scene->GetCamera().GetSampler().GetSeed();
+  ckpt.ElapsedTime = ElapsedTime();
+  try {
+    RenderCheckpoint::Write(_checkpointPath, ckpt);
+    _logger->info("write checkpoint: {}", _checkpointPath.u8string());
+  } catch (const std::exception& e) {
+    //检查点写失败不应该中断渲染
+    _logger->error("fail to write checkpoint: {}", e.what());
+  }
+  _lastCheckpoint = ckpt.ElapsedTime;
+}
+
+void Renderer::SaveResult(const LocationResolver& resolver) const {
+  auto&& fb = _scene->GetCamera().GetFrameBuffer();
   auto saveName = resolver.GetSaveName("exr");
   auto stream = resolver.WriteStream(saveName, std::ios::binary | std::ios::out);
-  ImageReader::WriteExr(*stream, tmp);
+  if (HasCrop() && _isSaveDataWindow) {
+    Vector2i size = _cropMax - _cropMin;
+    MatrixX<Color24f> tmp(size.x(), size.y());
+    for (UInt32 y = 0; y < tmp.cols(); y++) {
+      for (UInt32 x = 0; x < tmp.rows(); x++) {
+        tmp.coeffRef(x, y) = fb.coeff(x + _cropMin.x(), y + _cropMin.y()).cast<Float32>();
+      }
+    }
+    ImageReader::WriteExr(*stream, tmp, _scene->GetCamera().Resolution(), _cropMin);
+  } else {
+    MatrixX<Color24f> tmp(fb.rows(), fb.cols());
+    for (UInt32 y = 0; y < tmp.cols(); y++) {
+      for (UInt32 x = 0; x < tmp.rows(); x++) {
+        tmp.coeffRef(x, y) = fb.coeff(x, y).cast<Float32>();
+      }
+    }
+    ImageReader::WriteExr(*stream, tmp);
+  }
   _logger->info("save result to: {}", (resolver.GetWorkDirectory() / saveName).u8string());
 }
 
@@ -49,7 +152,24 @@ SampleRenderer::SampleRenderer(
     BuildContext* ctx,
     Unique<Scene> scene,
     const ConfigNode& cfg)
-    : Renderer(ctx, std::move(scene), cfg) {}
+    : Renderer(ctx, std::move(scene), cfg) {
+  _sampleBegin = 0;
+  _sampleEnd = _scene->GetCamera().GetSampler().SampleCount();
+  _packetSize = cfg.ReadOrDefault("packet_size", UInt32(0));
+  if (_packetSize != 0 && _packetSize != 4 && _packetSize != 8 && _packetSize != 16) {
+    throw RadArgumentException("packet_size should be 0, 4, 8 or 16, but is {}", _packetSize);
+  }
+  _isProgressive = cfg.ReadOrDefault("progressive", false);
+  _isAdaptive = cfg.ReadOrDefault("adaptive", false);
+  _adaptiveThreshold = cfg.ReadOrDefault("adaptive_threshold", Float(0.01));
+  _adaptiveMinSpp = cfg.ReadOrDefault("adaptive_min_spp", UInt32(16));
+  _adaptiveMaxSpp = cfg.ReadOrDefault("adaptive_max_spp", _scene->GetCamera().GetSampler().SampleCount() * 4);
+  _isSaveSampleCount = cfg.ReadOrDefault("save_sample_count", _isAdaptive);
+  //自适应采样和时间预算都需要按轮次分配样本, 只能在渐进式模式下工作
+  if (_isAdaptive || HasTimeBudget()) {
+    _isProgressive = true;
+  }
+}
 
 SampleRenderer::~SampleRenderer() noexcept {
   if (_renderThread->joinable()) {
@@ -61,27 +181,257 @@ void SampleRenderer::Start() {
   if (_renderThread != nullptr) {
     return;
   }
-  std::thread renderThread([&]() {
-    Scene& scene = *_scene;
-    Camera& camera = scene.GetCamera();
-    const Sampler& sampler = camera.GetSampler();
-    MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
-    _allTask = frameBuffer.cols() * frameBuffer.rows();
-    tbb::affinity_partitioner part;
-    std::unique_ptr<tbb::global_control> ctrl;
-    if (_threadCount > 0) {
-      ctrl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, _threadCount);
+  std::thread renderThread([&]() { Render(); });
+  _renderThread = std::make_unique<std::thread>(std::move(renderThread));
+}
+
+void SampleRenderer::SetSampleRange(UInt32 begin, UInt32 end) {
+  if (_renderThread != nullptr) {
+    throw RadInvalidOperationException("cannot change sample range after render started");
+  }
+  if (begin >= end) {
+    throw RadArgumentException("sample range is empty. begin: {}, end: {}", begin, end);
+  }
+  //时间预算与自适应采样会让每个像素的样本数超出区间, 与其他区间的样本索引重叠
+  if (HasTimeBudget() || _isAdaptive) {
+    throw RadInvalidOperationException("cannot render a sample range with time budget or adaptive sampling");
+  }
+  _sampleBegin = begin;
+  _sampleEnd = end;
+}
+
+void SampleRenderer::GetPartialResult(RenderCheckpoint& result) const {
+  if (_sampleCounts.size() == 0) {
+    //分块渲染完成后每个像素都恰好有 _sampleEnd - _sampleBegin 个样本
+    Renderer::GetPartialResult(result);
+    UInt32 spp = _sampleEnd - _sampleBegin;
+    for (Int32 y = _cropMin.y(); y < _cropMax.y(); y++) {
+      for (Int32 x = _cropMin.x(); x < _cropMax.x(); x++) {
+        result.Accumulate(x, y) = Spectrum(result.Accumulate(x, y) * Float(spp));
+        result.SampleCounts(x, y) = spp;
+      }
+    }
+  } else {
+    result.Accumulate = _accumulate;
+    result.SampleCounts = _sampleCounts;
+    result.Seed = _scene->GetCamera().GetSampler().GetSeed();
+    result.ElapsedTime = ElapsedTime();
+  }
+}
+
+void SampleRenderer::Render() {
+  std::unique_ptr<tbb::global_control> ctrl;
+  if (_threadCount > 0) {
+    ctrl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, _threadCount);
+  }
+  _sw.Start();
+  //检查点只能在两轮之间写, 所以也需要渐进式渲染
+  if (_isProgressive || IsCheckpointEnabled() || _resume != nullptr) {
+    RenderProgressive();
+  } else if (_packetSize > 0 && HasPrimaryHitLi()) {
+    RenderTiledPacket();
+  } else {
+    RenderTiled();
+  }
+  _sw.Stop();
+  _isComplete = true;
+}
+
+void SampleRenderer::RenderTiled() {
+  Scene& scene = *_scene;
+  Camera& camera = scene.GetCamera();
+  const Sampler& sampler = camera.GetSampler();
+  MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
+  _allTask = CropPixelCount();
+  //每个线程只克隆一次采样器, 样本只由 (像素, 样本索引, 维度) 决定, 复用不会改变结果
+  tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+  tbb::affinity_partitioner part;
+  tbb::blocked_range2d<UInt32> block(
+      _cropMin.x(), _cropMax.x(),
+      _cropMin.y(), _cropMax.y());
+  tbb::parallel_for(
+      block, [&](const tbb::blocked_range2d<UInt32>& r) {
+        Sampler* localSampler = samplers.local().get();
+        for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
+          if (_isStop) {
+            break;
+          }
+          for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
+            if (_isStop) {
+              break;
+            }
+            for (UInt32 i = _sampleBegin; i < _sampleEnd; i++) {
+              if (_isStop) {
+                break;
+              }
+              localSampler->StartPixelSample(Vector2i(x, y), i);
+              Vector2 scrPos = Vector2(x, y) + localSampler->Next2D();
+              RayDifferential ray = camera.SampleRayDifferential(scrPos);
+              Spectrum li = Li(ray, scene, localSampler);
+              if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
+                _logger->warn("invalid spectrum {}", li);
+              } else {
+                frameBuffer(x, y) += li;
+              }
+            }
+          }
+        }
+        Float32 coeff = 1.0f / (_sampleEnd - _sampleBegin);
+        for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
+          for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
+            frameBuffer(x, y) *= coeff;
+          }
+        }
+        _completeTask += r.cols().size() * r.rows().size();
+      },
+      part);
+}
+
+void SampleRenderer::RenderTiledPacket() {
+  Scene& scene = *_scene;
+  Camera& camera = scene.GetCamera();
+  const Sampler& sampler = camera.GetSampler();
+  MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
+  //包内的光线来自一小块相邻的像素: 4 -> 2x2, 8 -> 4x2, 16 -> 4x4
+  UInt32 packetWidth = _packetSize == 4 ? 2 : 4;
+  UInt32 packetHeight = _packetSize / packetWidth;
+  _allTask = CropPixelCount();
+  tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+  tbb::affinity_partitioner part;
+  tbb::blocked_range2d<UInt32> block(
+      _cropMin.x(), _cropMax.x(),
+      _cropMin.y(), _cropMax.y());
+  tbb::parallel_for(
+      block, [&](const tbb::blocked_range2d<UInt32>& r) {
+        Sampler* localSampler = samplers.local().get();
+        Vector2i pixels[16];
+        RayDifferential rays[16];
+        Ray packet[16];
+        Int32 valid[16];
+        UInt32 dims[16];
+        SurfaceInteraction sis[16];
+        UInt8 isHit[16];
+        for (UInt32 by = r.cols().begin(); by < r.cols().end(); by += packetHeight) {
+          if (_isStop) {
+            break;
+          }
+          for (UInt32 bx = r.rows().begin(); bx < r.rows().end(); bx += packetWidth) {
+            if (_isStop) {
+              break;
+            }
+            for (UInt32 i = _sampleBegin; i < _sampleEnd; i++) {
+              if (_isStop) {
+                break;
+              }
+              for (UInt32 lane = 0; lane < _packetSize; lane++) {
+                UInt32 x = bx + lane % packetWidth;
+                UInt32 y = by + lane / packetWidth;
+                valid[lane] = x < r.rows().end() && y < r.cols().end() ? -1 : 0;
+                if (!valid[lane]) {
+                  continue;
+                }
+                pixels[lane] = Vector2i(x, y);
+                localSampler->StartPixelSample(pixels[lane], i);
+                Vector2 scrPos = Vector2(x, y) + localSampler->Next2D();
+                rays[lane] = camera.SampleRayDifferential(scrPos);
+                packet[lane] = rays[lane];
+                dims[lane] = localSampler->GetDimension();
+              }
+              scene.RayIntersectPacket(_packetSize, valid, packet, sis, isHit);
+              for (UInt32 lane = 0; lane < _packetSize; lane++) {
+                if (!valid[lane]) {
+                  continue;
+                }
+                //接着生成相机光线之后的维度继续采样, 结果与逐条求交一致
+                localSampler->StartPixelSample(pixels[lane], i, dims[lane]);
+                Spectrum li = LiFromPrimaryHit(rays[lane], sis[lane], isHit[lane] != 0, scene, localSampler);
+                if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
+                  _logger->warn("invalid spectrum {}", li);
+                } else {
+                  frameBuffer(pixels[lane].x(), pixels[lane].y()) += li;
+                }
+              }
+            }
+          }
+        }
+        Float32 coeff = 1.0f / (_sampleEnd - _sampleBegin);
+        for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
+          for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
+            frameBuffer(x, y) *= coeff;
+          }
+        }
+        _completeTask += r.cols().size() * r.rows().size();
+      },
+      part);
+}
+
+void SampleRenderer::RenderProgressive() {
+  Scene& scene = *_scene;
+  Camera& camera = scene.GetCamera();
+  const Sampler& sampler = camera.GetSampler();
+  MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
+  UInt32 spp = _sampleEnd - _sampleBegin;
+  UInt64 pixelCount = CropPixelCount();
+  UInt64 budget = pixelCount * spp;  //整张图片的样本预算
+  UInt32 maxSpp = _isAdaptive ? std::max(_adaptiveMaxSpp, spp) : spp;
+  if (HasTimeBudget()) {
+    //有时间预算时样本数由时间决定, 只保留自适应采样的单像素上限
+    maxSpp = _isAdaptive ? std::max(_adaptiveMaxSpp, _sppPerPass) : std::numeric_limits<UInt32>::max();
+    UpdateTimeBudgetProgress();
+  } else {
+    _allTask = budget;
+  }
+  _accumulate = MatrixX<Spectrum>::Constant(frameBuffer.rows(), frameBuffer.cols(), Spectrum(0));
+  _sampleCounts = MatrixX<UInt32>::Zero(frameBuffer.rows(), frameBuffer.cols());
+  if (_isAdaptive) {
+    _lumMean = MatrixX<Float>::Zero(frameBuffer.rows(), frameBuffer.cols());
+    _lumM2 = MatrixX<Float>::Zero(frameBuffer.rows(), frameBuffer.cols());
+    _isConverged = MatrixX<UInt8>::Zero(frameBuffer.rows(), frameBuffer.cols());
+  }
+  std::atomic_uint64_t spent = 0;
+  std::atomic_uint64_t activeCount = pixelCount;
+  UInt32 pass = 0;
+  if (_resume != nullptr) {
+    _accumulate = std::move(_resume->Accumulate);
+    _sampleCounts = std::move(_resume->SampleCounts);
+    if (_isAdaptive && _resume->IsConverged.size() == _sampleCounts.size()) {
+      _lumMean = std::move(_resume->LumMean);
+      _lumM2 = std::move(_resume->LumM2);
+      _isConverged = std::move(_resume->IsConverged);
+      activeCount = pixelCount - _isConverged.cast<UInt64>().sum();
+    }
+    spent = _resume->TotalSampleCount;
+    pass = _resume->Pass;
+    _resume.reset();
+    for (UInt32 y = 0; y < frameBuffer.cols(); y++) {
+      for (UInt32 x = 0; x < frameBuffer.rows(); x++) {
+        UInt32 n = _sampleCounts(x, y);
+        frameBuffer(x, y) = n == 0 ? Spectrum(0) : Spectrum(_accumulate(x, y) / Float(n));
+      }
+    }
+    if (!HasTimeBudget()) {
+      _completeTask = std::min(UInt64(spent), _allTask);
+    }
+  }
+  tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+  tbb::affinity_partitioner part;
+  tbb::blocked_range2d<UInt32> block(
+      _cropMin.x(), _cropMax.x(),
+      _cropMin.y(), _cropMax.y());
+  for (; !_isStop; pass++) {
+    //预算是按轮次检查的, 最后一轮可能会稍微超出一点
+    UInt32 passBegin = pass * _sppPerPass;
+    if (passBegin >= maxSpp || activeCount == 0) {
+      break;
+    }
+    if (HasTimeBudget() ? (pass > 0 && IsTimeBudgetExhausted()) : spent >= budget) {
+      break;
     }
-    tbb::blocked_range2d<UInt32> block(
-        0, camera.Resolution().x(),
-        0, camera.Resolution().y());
-    _sw.Start();
+    UInt32 passSpp = std::min(_sppPerPass, maxSpp - passBegin);
     tbb::parallel_for(
         block, [&](const tbb::blocked_range2d<UInt32>& r) {
-          UInt32 seed = r.rows().begin() * camera.Resolution().x() + r.cols().begin();
-          std::mt19937 rng(seed);
-          std::uniform_real_distribution<Float> dist;
-          Unique<Sampler> localSampler = sampler.Clone(sampler.GetSeed() + seed);
+          Sampler* localSampler = samplers.local().get();
+          UInt64 blockSpent = 0;
           for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
             if (_isStop) {
               break;
@@ -90,35 +440,105 @@ void SampleRenderer::Start() {
               if (_isStop) {
                 break;
               }
-              for (UInt32 i = 0; i < sampler.SampleCount(); i++) {
-                if (_isStop) {
-                  break;
-                }
-                localSampler->Advance();
-                Vector2 scrPos(x + dist(rng), y + dist(rng));
+              if (_isAdaptive && _isConverged(x, y)) {
+                continue;
+              }
+              Spectrum sum(0);
+              UInt32 n = _sampleCounts(x, y);
+              Float mean = _isAdaptive ? _lumMean(x, y) : 0;
+              Float m2 = _isAdaptive ? _lumM2(x, y) : 0;
+              for (UInt32 i = 0; i < passSpp; i++) {
+                //样本索引是这个像素的全局索引, 与每轮采样多少个无关
+                localSampler->StartPixelSample(Vector2i(x, y), _sampleBegin + n);
+                Vector2 scrPos = Vector2(x, y) + localSampler->Next2D();
                 RayDifferential ray = camera.SampleRayDifferential(scrPos);
-                Spectrum li = Li(ray, scene, localSampler.get());
+                Spectrum li = Li(ray, scene, localSampler);
+                Float lum = 0;
                 if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
                   _logger->warn("invalid spectrum {}", li);
                 } else {
-                  frameBuffer(x, y) += li;
+                  sum += li;
+                  lum = li.Luminance();
+                }
+                n++;
+                if (_isAdaptive) {
+                  Float delta = lum - mean;
+                  mean += delta / n;
+                  m2 += delta * (lum - mean);
+                }
+              }
+              _accumulate(x, y) += sum;
+              _sampleCounts(x, y) = n;
+              frameBuffer(x, y) = Spectrum(_accumulate(x, y) / Float(n));
+              blockSpent += passSpp;
+              if (_isAdaptive) {
+                _lumMean(x, y) = mean;
+                _lumM2(x, y) = m2;
+                if (n >= _adaptiveMinSpp && n > 1) {
+                  //均值的标准误差除以均值, 加一个小量避免纯黑像素除零
+                  Float variance = m2 / (n - 1);
+                  Float relError = std::sqrt(variance / n) / (mean + Float(1e-4));
+                  if (relError < _adaptiveThreshold) {
+                    _isConverged(x, y) = 1;
+                    activeCount--;
+                  }
                 }
               }
             }
           }
-          Float32 coeff = 1.0f / sampler.SampleCount();
-          for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
-            for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
-              frameBuffer(x, y) *= coeff;
-            }
+          spent += blockSpent;
+          if (!HasTimeBudget()) {
+            _completeTask += blockSpent;
           }
-          _completeTask += r.cols().size() * r.rows().size();
         },
         part);
-    _sw.Stop();
-    _isComplete = true;
-  });
-  _renderThread = std::make_unique<std::thread>(std::move(renderThread));
+    if (HasTimeBudget()) {
+      UpdateTimeBudgetProgress();
+    }
+    //只在完整结束的轮次之后写检查点, 保证每个像素的样本索引是连续的
+    if (!_isStop && IsCheckpointDue()) {
+      RenderCheckpoint ckpt;
+      ckpt.Pass = pass + 1;
+      ckpt.TotalSampleCount = spent;
+      ckpt.Accumulate = _accumulate;
+      ckpt.SampleCounts = _sampleCounts;
+      if (_isAdaptive) {
+        ckpt.LumMean = _lumMean;
+        ckpt.LumM2 = _lumM2;
+        ckpt.IsConverged = _isConverged;
+      }
+      WriteCheckpoint(ckpt);
+    }
+  }
+  if (HasTimeBudget()) {
+    _logger->info("time budget {} ms done. pass: {}, elapsed: {} ms, average spp: {:.2f}",
+                  _timeBudget, pass, ElapsedTime(), spent / Float(pixelCount));
+  }
+  if (_isAdaptive) {
+    _logger->info("adaptive sampling done. converged pixel: {}/{}, average spp: {:.2f}",
+                  pixelCount - activeCount, pixelCount, spent / Float(pixelCount));
+  }
+}
+
+Spectrum SampleRenderer::LiFromPrimaryHit(const RayDifferential& ray, SurfaceInteraction& si, bool anyHit, const Scene& scene, Sampler* sampler) const {
+  return Li(ray, scene, sampler);
+}
+
+void SampleRenderer::SaveResult(const LocationResolver& resolver) const {
+  Renderer::SaveResult(resolver);
+  if (!_isSaveSampleCount || _sampleCounts.size() == 0) {
+    return;
+  }
+  MatrixX<Color24f> tmp(_sampleCounts.rows(), _sampleCounts.cols());
+  for (UInt32 y = 0; y < tmp.cols(); y++) {
+    for (UInt32 x = 0; x < tmp.rows(); x++) {
+      tmp.coeffRef(x, y) = Color24f(Float32(_sampleCounts.coeff(x, y)));
+    }
+  }
+  auto saveName = resolver.GetSaveName("spp", "exr");
+  auto stream = resolver.WriteStream(saveName, std::ios::binary | std::ios::out);
+  ImageReader::WriteExr(*stream, tmp);
+  _logger->info("save sample count to: {}", (resolver.GetWorkDirectory() / saveName).u8string());
 }
 
 }  // namespace Rad
@@ -0,0 +1,46 @@
+#include <rad/offline/render/splat_film.h>
+
+namespace Rad {
+
+SplatFilm::SplatFilm(Int32 rows, Int32 cols) : _rows(rows), _cols(cols) {
+  if (rows <= 0 || cols <= 0) {
+    throw RadArgumentException("invalid splat film size {} x {}", rows, cols);
+  }
+  _data = std::make_unique<std::atomic<Float>[]>(size_t(rows) * cols * Spectrum::ComponentCount);
+  Clear();
+}
+
+void SplatFilm::Clear() {
+  size_t count = size_t(_rows) * _cols * Spectrum::ComponentCount;
+  for (size_t i = 0; i < count; i++) {
+    _data[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void SplatFilm::Set(const MatrixX<Spectrum>& accumulate) {
+  if (accumulate.rows() != _rows || accumulate.cols() != _cols) {
+    throw RadArgumentException("accumulate size {} x {} mismatch splat film {} x {}",
+                               accumulate.rows(), accumulate.cols(), _rows, _cols);
+  }
+  for (Int32 y = 0; y < _cols; y++) {
+    for (Int32 x = 0; x < _rows; x++) {
+      std::atomic<Float>* p = _data.get() + Index(x, y);
+      const Spectrum& v = accumulate(x, y);
+      for (UInt32 i = 0; i < Spectrum::ComponentCount; i++) {
+        p[i].store(v[i], std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+MatrixX<Spectrum> SplatFilm::ToMatrix() const {
+  MatrixX<Spectrum> result(_rows, _cols);
+  for (Int32 y = 0; y < _cols; y++) {
+    for (Int32 x = 0; x < _rows; x++) {
+      result(x, y) = Get(x, y);
+    }
+  }
+  return result;
+}
+
+}  // namespace Rad
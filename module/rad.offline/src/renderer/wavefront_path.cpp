@@ -0,0 +1,314 @@
+#include <rad/offline/render/renderer.h>
+
+#include <rad/offline/build/factory.h>
+#include <rad/offline/spectrum.h>
+#include <rad/offline/render/interaction.h>
+#include <rad/offline/render/scene.h>
+#include <rad/offline/render/shape.h>
+#include <rad/offline/render/sampler.h>
+
+#include <tbb/blocked_range2d.h>
+#include <tbb/parallel_for.h>
+#include <tbb/global_control.h>
+#include <tbb/enumerable_thread_specific.h>
+
+namespace Rad {
+
+/**
+ * @brief 波前式路径追踪, 光照计算与 Path 相同
+ * Path 每次只追踪一条路径, 求交、着色、可见性测试交替进行
+ * 这里每个线程一次拿出一批路径, 每次反弹分成几个阶段, 每个阶段处理完整批路径再进入下一个阶段:
+ * 生成相机光线 -> 批量求交 -> 着色并采样下一条光线 -> 批量可见性测试
+ * 批量求交可以用上 embree 的流式内核, 同一阶段的数据在内存里连续, 缓存也更友好
+ *
+ * 只支持按块一次渲染完成, 不支持渐进式、时间预算与检查点, 配置了这些选项时构造会抛出异常
+ */
+class WavefrontPath final : public Renderer {
+ public:
+  /**
+   * @brief 一个线程内正在游走的一批路径, 每个字段单独存成数组 (SoA)
+   */
+  struct WaveQueue {
+    //路径状态, 用路径在这一批里的编号索引
+    std::vector<Vector2i> Pixel;
+    std::vector<UInt32> SampleIndex;
+    std::vector<UInt32> Dimension;  //采样器已经用掉的维度, 下一次着色时从这里继续
+    std::vector<RayDifferential> Rays;
+    std::vector<Spectrum> Throughput;
+    std::vector<Spectrum> Result;
+    std::vector<Float> Eta;
+    std::vector<UInt8> IsSpecular;
+    std::vector<Float> PrevBsdfPdf;
+    std::vector<SurfaceInteraction> PrevSi;
+    //还活着的路径编号, 求交结果与它一一对应
+    std::vector<UInt32> Active;
+    std::vector<UInt32> NextActive;
+    std::vector<Ray> HitRays;
+    std::vector<HitShapeRecord> HitRecords;  //批量求交的临时空间, 每次反弹复用
+    std::vector<SurfaceInteraction> Hits;
+    std::vector<UInt8> IsHit;
+    //直接光照的 shadow ray, 通过可见性测试后把贡献加到所属的路径上
+    std::vector<Ray> ShadowRays;
+    std::vector<Spectrum> ShadowLe;
+    std::vector<UInt32> ShadowOwner;
+    std::vector<UInt8> IsOcclude;
+
+    void Resize(UInt32 size) {
+      Pixel.resize(size);
+      SampleIndex.resize(size);
+      Dimension.resize(size);
+      Rays.resize(size);
+      Throughput.resize(size);
+      Result.resize(size);
+      Eta.resize(size);
+      IsSpecular.resize(size);
+      PrevBsdfPdf.resize(size);
+      PrevSi.resize(size);
+    }
+  };
+
+  WavefrontPath(BuildContext* ctx, Unique<Scene> scene, const ConfigNode& cfg) : Renderer(ctx, std::move(scene), cfg) {
+    _maxDepth = cfg.ReadOrDefault("max_depth", -1);
+    _rrDepth = cfg.ReadOrDefault("rr_depth", 3);
+    _waveSize = std::max(cfg.ReadOrDefault("wave_size", UInt32(4096)), UInt32(1));
+    //静默忽略这些选项会让用户以为渲染是按轮次进行的, 直接报错
+    if (HasTimeBudget()) {
+      throw RadNotSupportedException("wavefront_path does not support time_budget_ms");
+    }
+    if (_checkpointInterval > 0) {
+      throw RadNotSupportedException("wavefront_path does not support checkpoint_interval_ms");
+    }
+    if (_sppPerPass > 1) {
+      throw RadNotSupportedException("wavefront_path does not support spp_per_pass");
+    }
+  }
+  ~WavefrontPath() noexcept override = default;
+
+  void Resume(const std::filesystem::path& path, UInt64 sceneHash) override {
+    throw RadNotSupportedException("wavefront_path cannot resume from checkpoint");
+  }
+
+  void Start() override {
+    if (_renderThread != nullptr) {
+      return;
+    }
+    std::thread renderThread([&]() { Render(); });
+    _renderThread = std::make_unique<std::thread>(std::move(renderThread));
+  }
+
+  void Render() {
+    std::unique_ptr<tbb::global_control> ctrl;
+    if (_threadCount > 0) {
+      ctrl = std::make_unique<tbb::global_control>(tbb::global_control::max_allowed_parallelism, _threadCount);
+    }
+    Scene& scene = *_scene;
+    Camera& camera = scene.GetCamera();
+    const Sampler& sampler = camera.GetSampler();
+    MatrixX<Spectrum>& frameBuffer = camera.GetFrameBuffer();
+    UInt32 spp = sampler.SampleCount();
+    _allTask = CropPixelCount();
+    _sw.Start();
+    tbb::enumerable_thread_specific<WaveQueue> queues;
+    tbb::enumerable_thread_specific<Unique<Sampler>> samplers([&]() { return sampler.Clone(sampler.GetSeed()); });
+    tbb::affinity_partitioner part;
+    tbb::blocked_range2d<UInt32> block(
+        _cropMin.x(), _cropMax.x(),
+        _cropMin.y(), _cropMax.y());
+    tbb::parallel_for(
+        block, [&](const tbb::blocked_range2d<UInt32>& r) {
+          WaveQueue& q = queues.local();
+          Sampler* localSampler = samplers.local().get();
+          UInt64 pathCount = UInt64(r.rows().size()) * UInt64(r.cols().size()) * spp;
+          for (UInt64 begin = 0; begin < pathCount && !_isStop; begin += _waveSize) {
+            UInt32 count = UInt32(std::min(UInt64(_waveSize), pathCount - begin));
+            Generate(q, r, begin, count, localSampler);
+            for (Int32 depth = 0; !q.Active.empty() && !_isStop; depth++) {
+              Intersect(q);
+              Shade(q, depth, localSampler);
+              Occlude(q);
+              std::swap(q.Active, q.NextActive);
+            }
+            for (UInt32 i = 0; i < count; i++) {
+              const Spectrum& li = q.Result[i];
+              if (li.HasNaN() || li.HasInfinity() || li.HasNegative()) {
+                _logger->warn("invalid spectrum {}", li);
+              } else {
+                frameBuffer(q.Pixel[i].x(), q.Pixel[i].y()) += li;
+              }
+            }
+          }
+          Float32 coeff = 1.0f / spp;
+          for (UInt32 y = r.cols().begin(); y != r.cols().end(); y++) {
+            for (UInt32 x = r.rows().begin(); x != r.rows().end(); x++) {
+              frameBuffer(x, y) *= coeff;
+            }
+          }
+          _completeTask += r.cols().size() * r.rows().size();
+        },
+        part);
+    _sw.Stop();
+    _isComplete = true;
+  }
+
+  /**
+   * @brief 生成第 [begin, begin + count) 条路径的相机光线
+   * 同一个像素的样本编号是连续的, 路径编号 = 像素编号 * spp + 样本索引
+   */
+  void Generate(WaveQueue& q, const tbb::blocked_range2d<UInt32>& r, UInt64 begin, UInt32 count, Sampler* sampler) const {
+    const Camera& camera = _scene->GetCamera();
+    UInt32 spp = camera.GetSampler().SampleCount();
+    UInt32 width = UInt32(r.rows().size());
+    q.Resize(count);
+    q.Active.clear();
+    for (UInt32 i = 0; i < count; i++) {
+      UInt64 index = begin + i;
+      UInt32 pixelIndex = UInt32(index / spp);
+      Vector2i pixel(r.rows().begin() + pixelIndex % width, r.cols().begin() + pixelIndex / width);
+      UInt32 sampleIndex = UInt32(index % spp);
+      sampler->StartPixelSample(pixel, sampleIndex);
+      Vector2 scrPos = Vector2(pixel.x(), pixel.y()) + sampler->Next2D();
+      q.Pixel[i] = pixel;
+      q.SampleIndex[i] = sampleIndex;
+      q.Rays[i] = camera.SampleRayDifferential(scrPos);
+      q.Dimension[i] = sampler->GetDimension();
+      q.Throughput[i] = Spectrum(1);
+      q.Result[i] = Spectrum(0);
+      q.Eta[i] = 1;
+      q.IsSpecular[i] = 1;
+      q.PrevBsdfPdf[i] = 1;
+      q.PrevSi[i] = {};
+      q.Active.emplace_back(i);
+    }
+  }
+
+  void Intersect(WaveQueue& q) const {
+    UInt32 count = UInt32(q.Active.size());
+    q.HitRays.resize(count);
+    q.HitRecords.resize(count);
+    q.Hits.resize(count);
+    q.IsHit.resize(count);
+    for (UInt32 k = 0; k < count; k++) {
+      q.HitRays[k] = q.Rays[q.Active[k]];
+    }
+    _scene->RayIntersect(q.HitRays.data(), q.HitRecords.data(), q.Hits.data(), q.IsHit.data(), count);
+  }
+
+  /**
+   * @brief 与 Path::Li 一次循环的内容相同, 只是可见性测试被推迟到 Occlude 里统一进行
+   * 每次反弹消耗的维度也与 Path 相同, 同一个种子两个渲染器得到同样的样本
+   */
+  void Shade(WaveQueue& q, Int32 depth, Sampler* sampler) const {
+    const Scene& scene = *_scene;
+    BsdfContext ctx{};
+    q.NextActive.clear();
+    q.ShadowRays.clear();
+    q.ShadowLe.clear();
+    q.ShadowOwner.clear();
+    for (UInt32 k = 0; k < q.Active.size(); k++) {
+      UInt32 p = q.Active[k];
+      SurfaceInteraction& si = q.Hits[k];
+      bool anyHit = q.IsHit[k] != 0;
+      Spectrum& throughput = q.Throughput[p];
+      std::optional<Light*> hitLight = scene.GetLight(si);
+      if (hitLight) {
+        Float weight;
+        if (q.IsSpecular[p]) {
+          weight = 1;
+        } else {
+          DirectionSampleResult dsr = si.ToDsr(q.PrevSi[p]);
+          Float lightPdf = scene.PdfLightDirection(*hitLight, q.PrevSi[p], dsr);
+          weight = MisWeight(q.PrevBsdfPdf[p], lightPdf);
+        }
+        Spectrum li = (*hitLight)->Eval(si);
+        q.Result[p] += Spectrum(throughput.cwiseProduct(li) * weight);
+      }
+      if (!anyHit || (_maxDepth >= 0 && depth + 1 >= _maxDepth)) {
+        continue;
+      }
+      if (si.Shape->IsLight()) {
+        continue;
+      }
+      sampler->StartPixelSample(q.Pixel[p], q.SampleIndex[p], q.Dimension[p]);
+      Bsdf* bsdf = si.BSDF(q.Rays[p]);
+      //与 Path 一样一次性取出这次反弹的所有样本: 光源位置, BSDF方向, 光源选择, BSDF lobe, 轮盘赌
+      Float u[7];
+      sampler->NextArray(u, 7);
+      if (bsdf->HasAnyTypeExceptDelta()) {
+        auto [l, dsr, li] = scene.SampleLightDirection(si, u[4], Vector2(u[0], u[1]));
+        Ray shadowRay;
+        //两点太近时与 Scene::IsOcclude 一样视为被遮挡
+        if (dsr.Pdf > 0 && Scene::SpawnShadowRay(si, dsr.P, shadowRay)) {
+          Vector3 wo = si.ToLocal(dsr.Dir);
+          Spectrum f = bsdf->Eval(ctx, si, wo);
+          Float bsdfPdf = bsdf->Pdf(ctx, si, wo);
+          Float weight = dsr.IsDelta ? 1 : MisWeight(dsr.Pdf, bsdfPdf);
+          q.ShadowRays.emplace_back(shadowRay);
+          q.ShadowLe.emplace_back(Spectrum(throughput.cwiseProduct(f).cwiseProduct(li) * weight / dsr.Pdf));
+          q.ShadowOwner.emplace_back(p);
+        }
+      }
+      auto [bsr, f] = bsdf->Sample(ctx, si, u[5], Vector2(u[2], u[3]));
+      if (bsr.Pdf <= 0) {
+        continue;
+      }
+      throughput = Spectrum(throughput.cwiseProduct(f) / bsr.Pdf);
+      q.Eta[p] *= bsr.Eta;
+      q.Rays[p] = si.SpawnRay(si.ToWorld(bsr.Wo));
+      q.PrevBsdfPdf[p] = bsr.Pdf;
+      q.PrevSi[p] = si;
+      q.IsSpecular[p] = bsr.HasType(BsdfType::Delta) ? 1 : 0;
+      if (depth >= _rrDepth) {
+        Float maxThroughput = throughput.MaxComponent();
+        Float rr = std::min(maxThroughput * Math::Sqr(q.Eta[p]), Float(0.95));
+        if (u[6] > rr) {
+          continue;
+        }
+        throughput *= Math::Rcp(rr);
+      }
+      q.Dimension[p] = sampler->GetDimension();
+      q.NextActive.emplace_back(p);
+    }
+  }
+
+  void Occlude(WaveQueue& q) const {
+    UInt32 count = UInt32(q.ShadowRays.size());
+    if (count == 0) {
+      return;
+    }
+    q.IsOcclude.resize(count);
+    _scene->RayIntersect(q.ShadowRays.data(), q.IsOcclude.data(), count);
+    for (UInt32 k = 0; k < count; k++) {
+      if (!q.IsOcclude[k]) {
+        q.Result[q.ShadowOwner[k]] += q.ShadowLe[k];
+      }
+    }
+  }
+
+  // power heuristic
+  Float MisWeight(Float a, Float b) const {
+    a *= a;
+    b *= b;
+    Float w = a / (a + b);
+    return std::isfinite(w) ? w : 0;
+  }
+
+ private:
+  Int32 _maxDepth;
+  Int32 _rrDepth;
+  UInt32 _waveSize;  //每个线程一批同时游走的路径数量
+};
+
+class WavefrontPathFactory final : public RendererFactory {
+ public:
+  WavefrontPathFactory() : RendererFactory("wavefront_path") {}
+  ~WavefrontPathFactory() noexcept override = default;
+  Unique<Renderer> Create(BuildContext* ctx, Unique<Scene> scene, const ConfigNode& cfg) const override {
+    return std::make_unique<WavefrontPath>(ctx, std::move(scene), cfg);
+  }
+};
+
+Unique<RendererFactory> _FactoryCreateWavefrontPathFunc_() {
+  return std::make_unique<WavefrontPathFactory>();
+}
+
+}  // namespace Rad
@@ -6,4 +6,78 @@ Sampler::Sampler(BuildContext* ctx, const ConfigNode& cfg) {
   _sampleCount = cfg.ReadOrDefault("sample_count", 16);
 }
 
+// https://github.com/mmp/pbrt-v4/blob/master/src/pbrt/util/hash.h MixBits
+UInt64 Sampler::MixBits(UInt64 v) {
+  v ^= (v >> 31);
+  v *= 0x7fb5d329728ea185;
+  v ^= (v >> 27);
+  v *= 0x81dadef4bc2dd44d;
+  v ^= (v >> 33);
+  return v;
+}
+
+void Sampler::StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension) {
+  StartPixelSample(pixel, sampleIndex);
+  while (_dimension < dimension) {
+    Next1D();
+  }
+}
+
+void Sampler::NextArray(Float* samples, UInt32 count) {
+  UInt32 i = 0;
+  for (; i + 1 < count; i += 2) {
+    Vector2 s = Next2D();
+    samples[i] = s.x();
+    samples[i + 1] = s.y();
+  }
+  if (i < count) {
+    samples[i] = Next1D();
+  }
+}
+
+UInt64 Sampler::HashPixelSample(UInt32 seed, const Vector2i& pixel, UInt32 sampleIndex) {
+  UInt64 h = MixBits(UInt64(seed) ^ 0x9e3779b97f4a7c15);
+  h = MixBits(h ^ ((UInt64(UInt32(pixel.x())) << 32) | UInt64(UInt32(pixel.y()))));
+  h = MixBits(h ^ UInt64(sampleIndex));
+  return h;
+}
+
+UInt64 Sampler::HashPixelDimension(UInt32 seed, const Vector2i& pixel, UInt32 dimension) {
+  UInt64 h = MixBits(UInt64(seed) ^ 0xd1b54a32d192ed03);
+  h = MixBits(h ^ ((UInt64(UInt32(pixel.x())) << 32) | UInt64(UInt32(pixel.y()))));
+  h = MixBits(h ^ UInt64(dimension));
+  return h;
+}
+
+UInt32 Sampler::PermutationElement(UInt32 i, UInt32 n, UInt32 seed) {
+  UInt32 w = n - 1;
+  w |= w >> 1;
+  w |= w >> 2;
+  w |= w >> 4;
+  w |= w >> 8;
+  w |= w >> 16;
+  //在能覆盖 n 的2的幂次范围内做可逆的哈希, 落在 [n, w] 里就再哈希一次
+  do {
+    i ^= seed;
+    i *= 0xe170893d;
+    i ^= seed >> 16;
+    i ^= (i & w) >> 4;
+    i ^= seed >> 8;
+    i *= 0x0929eb3f;
+    i ^= seed >> 23;
+    i ^= (i & w) >> 1;
+    i *= 1 | seed >> 27;
+    i *= 0x6935fa69;
+    i ^= (i & w) >> 11;
+    i *= 0x74dcb303;
+    i ^= (i & w) >> 2;
+    i *= 0x9e501cc3;
+    i ^= (i & w) >> 2;
+    i *= 0xc860a3df;
+    i &= w;
+    i ^= i >> 5;
+  } while (i >= n);
+  return (i + seed) % n;
+}
+
 }  // namespace Rad
@@ -0,0 +1,128 @@
+#include <rad/offline/render/sampler.h>
+
+#include <rad/offline/build/factory.h>
+#include <rad/offline/math_ext.h>
+
+#include <vector>
+
+namespace Rad {
+
+static constexpr UInt32 HaltonPrimeCount = 256;
+
+static std::vector<UInt32> BuildPrimes(UInt32 count) {
+  std::vector<UInt32> primes;
+  primes.reserve(count);
+  for (UInt32 n = 2; primes.size() < count; n++) {
+    bool isPrime = true;
+    for (UInt32 p : primes) {
+      if (p * p > n) {
+        break;
+      }
+      if (n % p == 0) {
+        isPrime = false;
+        break;
+      }
+    }
+    if (isPrime) {
+      primes.emplace_back(n);
+    }
+  }
+  return primes;
+}
+
+static const std::vector<UInt32> HaltonPrimes = BuildPrimes(HaltonPrimeCount);
+
+/**
+ * @brief Halton 序列, 第 d 维是以第 d 个素数为底的根式反演
+ * 每个像素的每一维都做 Owen 加扰: 每一位数字用由更高位数字决定的随机排列替换, 不破坏分层
+ * 素数表用完之后从头复用, 但是加扰的哈希里带着真实的维度, 所以仍然互不相关
+ */
+class Halton final : public Sampler {
+ public:
+  Halton(BuildContext* ctx, const ConfigNode& cfg) : Sampler(ctx, cfg) {
+    _seed = cfg.ReadOrDefault("seed", UInt32(0));
+  }
+  ~Halton() noexcept override = default;
+
+  Unique<Sampler> Clone(UInt32 seed) const override {
+    auto result = std::make_unique<Halton>(*this);
+    result->SetSeed(seed);
+    return std::move(result);
+  }
+
+  void SetSeed(UInt32 seed) override {
+    _seed = seed;
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex) override {
+    StartPixelSample(pixel, sampleIndex, 0);
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension) override {
+    //样本只由 (像素, 样本索引, 维度) 决定, 可以直接跳到任意维度
+    _pixel = pixel;
+    _sampleIndex = sampleIndex;
+    _dimension = dimension;
+  }
+
+  Float Next1D() override {
+    Float s = SampleDimension(_dimension);
+    _dimension += 1;
+    return s;
+  }
+  Vector2 Next2D() override {
+    Float s1 = SampleDimension(_dimension);
+    Float s2 = SampleDimension(_dimension + 1);
+    _dimension += 2;
+    return Vector2(s1, s2);
+  }
+  Vector3 Next3D() override {
+    Float s1 = SampleDimension(_dimension);
+    Float s2 = SampleDimension(_dimension + 1);
+    Float s3 = SampleDimension(_dimension + 2);
+    _dimension += 3;
+    return Vector3(s1, s2, s3);
+  }
+
+ private:
+  Float SampleDimension(UInt32 dimension) const {
+    UInt32 base = HaltonPrimes[dimension % HaltonPrimeCount];
+    UInt64 hash = HashPixelDimension(_seed, _pixel, dimension);
+    return OwenScrambledRadicalInverse(base, _sampleIndex, hash);
+  }
+
+  static Float OwenScrambledRadicalInverse(UInt32 base, UInt64 a, UInt64 hash) {
+    Float invBase = Float(1) / Float(base);
+    Float invBaseM = 1;
+    UInt64 reversedDigits = 0;
+    //即使索引的高位都是0, 也要继续生成加扰后的数字, 直到超出浮点数的精度
+    while (1 - (base - 1) * invBaseM < 1) {
+      UInt64 next = a / base;
+      UInt32 digit = UInt32(a - next * base);
+      UInt32 digitHash = UInt32(MixBits(hash ^ reversedDigits));
+      digit = PermutationElement(digit, base, digitHash);
+      reversedDigits = reversedDigits * base + digit;
+      invBaseM *= invBase;
+      a = next;
+    }
+    return std::min(invBaseM * Float(reversedDigits), Math::OneMinusEpsilon<Float>());
+  }
+
+  Vector2i _pixel{0, 0};
+  UInt32 _sampleIndex{0};
+};
+
+class HaltonFactory final : public SamplerFactory {
+ public:
+  HaltonFactory() : SamplerFactory("halton") {}
+  ~HaltonFactory() noexcept override = default;
+  Unique<Sampler> Create(BuildContext* ctx, const ConfigNode& cfg) const override {
+    return std::make_unique<Halton>(ctx, cfg);
+  }
+};
+
+Unique<SamplerFactory> _FactoryCreateHaltonFunc_() {
+  return std::make_unique<HaltonFactory>();
+}
+
+}  // namespace Rad
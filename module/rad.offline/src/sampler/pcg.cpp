@@ -0,0 +1,86 @@
+#include <rad/offline/render/sampler.h>
+
+#include <rad/offline/build/factory.h>
+#include <rad/offline/pcg32.h>
+
+namespace Rad {
+
+/**
+ * @brief 基于 PCG32 的独立样本采样器, 同时注册为 independent 与 pcg
+ * 每一维正好消耗一个32位随机数, 所以跳到任意维度只需要 Advance, 克隆也只是复制16字节的状态
+ */
+class PcgSampler final : public Sampler {
+ public:
+  PcgSampler(BuildContext* ctx, const ConfigNode& cfg) : Sampler(ctx, cfg) {
+    _seed = cfg.ReadOrDefault("seed", UInt32(0));
+  }
+  ~PcgSampler() noexcept override = default;
+
+  Unique<Sampler> Clone(UInt32 seed) const override {
+    auto result = std::make_unique<PcgSampler>(*this);
+    result->SetSeed(seed);
+    return std::move(result);
+  }
+
+  void SetSeed(UInt32 seed) override {
+    _seed = seed;
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex) override {
+    //每个 (像素, 样本索引) 使用独立的序列, 维度就是序列里的偏移
+    _rng.Seed(HashPixelSample(_seed, pixel, sampleIndex), MixBits(_seed));
+    _dimension = 0;
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension) override {
+    StartPixelSample(pixel, sampleIndex);
+    _rng.Advance(dimension);
+    _dimension = dimension;
+  }
+
+  Float Next1D() override {
+    _dimension += 1;
+    return _rng.NextFloat();
+  }
+  Vector2 Next2D() override {
+    _dimension += 2;
+    Float s1 = _rng.NextFloat();
+    Float s2 = _rng.NextFloat();
+    return Vector2(s1, s2);
+  }
+  Vector3 Next3D() override {
+    _dimension += 3;
+    Float s1 = _rng.NextFloat();
+    Float s2 = _rng.NextFloat();
+    Float s3 = _rng.NextFloat();
+    return Vector3(s1, s2, s3);
+  }
+  void NextArray(Float* samples, UInt32 count) override {
+    _dimension += count;
+    for (UInt32 i = 0; i < count; i++) {
+      samples[i] = _rng.NextFloat();
+    }
+  }
+
+ private:
+  Pcg32 _rng;
+};
+
+class PcgSamplerFactory final : public SamplerFactory {
+ public:
+  PcgSamplerFactory(const std::string& name) : SamplerFactory(name) {}
+  ~PcgSamplerFactory() noexcept override = default;
+  Unique<Sampler> Create(BuildContext* ctx, const ConfigNode& cfg) const override {
+    return std::make_unique<PcgSampler>(ctx, cfg);
+  }
+};
+
+Unique<SamplerFactory> _FactoryCreateIndependentFunc_() {
+  return std::make_unique<PcgSamplerFactory>("independent");
+}
+
+Unique<SamplerFactory> _FactoryCreatePcgFunc_() {
+  return std::make_unique<PcgSamplerFactory>("pcg");
+}
+
+}  // namespace Rad
@@ -0,0 +1,307 @@
+#include <rad/offline/render/sampler.h>
+
+#include <rad/offline/build/factory.h>
+#include <rad/offline/math_ext.h>
+
+#include <array>
+
+namespace Rad {
+
+static UInt32 ReverseBits32(UInt32 v) {
+  v = (v << 16) | (v >> 16);
+  v = ((v & 0x00ff00ff) << 8) | ((v & 0xff00ff00) >> 8);
+  v = ((v & 0x0f0f0f0f) << 4) | ((v & 0xf0f0f0f0) >> 4);
+  v = ((v & 0x33333333) << 2) | ((v & 0xcccccccc) >> 2);
+  v = ((v & 0x55555555) << 1) | ((v & 0xaaaaaaaa) >> 1);
+  return v;
+}
+
+/**
+ * @brief Sobol 序列第二维的生成矩阵, 本原多项式 x + 1, m_1 = 1
+ * 第一维就是 van der Corput 序列, 等价于把索引按位翻转
+ * 矩阵有64列, 支持64位的样本索引. 第32列以后只保留结果的高32位, 右移不会让低位影响高位, 所以截断后仍然精确
+ */
+static std::array<UInt32, 64> BuildSobolSecondDimension() {
+  std::array<UInt32, 64> result{};
+  UInt32 v = 0x80000000;
+  for (UInt32 i = 0; i < 64; i++) {
+    result[i] = v;
+    v ^= v >> 1;
+  }
+  return result;
+}
+
+static const std::array<UInt32, 64> SobolSecondDimension = BuildSobolSecondDimension();
+
+static UInt32 SobolSample(UInt64 index, UInt32 dim) {
+  if (dim == 0) {
+    //索引第32位以上的翻转后都落在结果的32位之外
+    return ReverseBits32(UInt32(index));
+  }
+  UInt32 v = 0;
+  for (UInt32 i = 0; index != 0; index >>= 1, i++) {
+    if (index & 1) {
+      v ^= SobolSecondDimension[i];
+    }
+  }
+  return v;
+}
+
+/**
+ * @brief 用哈希近似的 Owen 加扰, 每一位只受更高位的影响, 不会破坏序列的分层性质
+ * https://psychopath.io/post/2021_01_30_building_a_better_lk_hash
+ */
+static UInt32 FastOwenScramble(UInt32 v, UInt32 seed) {
+  v = ReverseBits32(v);
+  v ^= v * 0x3d20adea;
+  v += seed;
+  v *= (seed >> 16) | 1;
+  v ^= v * 0x05526c56;
+  v ^= v * 0x53a22864;
+  return ReverseBits32(v);
+}
+
+/**
+ * @brief Owen 加扰的 Sobol 序列, 每个像素的每一维都有独立的加扰
+ * 高维使用填充 (padding) 的方式构造: 每次取样都只用 Sobol 的前两维, 并且按维度打乱样本索引
+ * 这样每一对维度都是分层良好的 (0,2) 序列, 维度之间又互不相关, 不受维度数量的限制
+ * 样本数是2的幂次时效果最好
+ */
+class Sobol final : public Sampler {
+ public:
+  Sobol(BuildContext* ctx, const ConfigNode& cfg) : Sampler(ctx, cfg) {
+    _seed = cfg.ReadOrDefault("seed", UInt32(0));
+    if (_sampleCount == 0) {
+      throw RadArgumentException("sobol sampler sample_count should be positive");
+    }
+  }
+  ~Sobol() noexcept override = default;
+
+  Unique<Sampler> Clone(UInt32 seed) const override {
+    auto result = std::make_unique<Sobol>(*this);
+    result->SetSeed(seed);
+    return std::move(result);
+  }
+
+  void SetSeed(UInt32 seed) override {
+    _seed = seed;
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex) override {
+    StartPixelSample(pixel, sampleIndex, 0);
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension) override {
+    //样本只由 (像素, 样本索引, 维度) 决定, 可以直接跳到任意维度
+    _pixel = pixel;
+    _sampleIndex = sampleIndex;
+    _dimension = dimension;
+  }
+
+  Float Next1D() override {
+    UInt64 hash = HashPixelDimension(_seed, _pixel, _dimension);
+    _dimension += 1;
+    UInt32 index = PermuteIndex(hash);
+    return ToFloat(FastOwenScramble(SobolSample(index, 0), UInt32(hash >> 32)));
+  }
+  Vector2 Next2D() override {
+    UInt64 hash = HashPixelDimension(_seed, _pixel, _dimension);
+    _dimension += 2;
+    UInt32 index = PermuteIndex(hash);
+    Float s1 = ToFloat(FastOwenScramble(SobolSample(index, 0), UInt32(hash >> 32)));
+    Float s2 = ToFloat(FastOwenScramble(SobolSample(index, 1), UInt32(MixBits(hash) >> 32)));
+    return Vector2(s1, s2);
+  }
+  Vector3 Next3D() override {
+    Vector2 s12 = Next2D();
+    Float s3 = Next1D();
+    return Vector3(s12.x(), s12.y(), s3);
+  }
+
+ private:
+  /**
+   * @brief 每一维使用不同的索引排列, 超过样本数的索引按样本数分块, 每块单独排列
+   */
+  UInt32 PermuteIndex(UInt64 hash) const {
+    UInt32 block = _sampleIndex / _sampleCount;
+    UInt32 offset = _sampleIndex % _sampleCount;
+    return block * _sampleCount + PermutationElement(offset, _sampleCount, UInt32(hash) ^ (block * 0x9e3779b9));
+  }
+
+  static Float ToFloat(UInt32 v) {
+    return std::min(Float(v) * Float(0x1p-32), Math::OneMinusEpsilon<Float>());
+  }
+
+  Vector2i _pixel{0, 0};
+  UInt32 _sampleIndex{0};
+};
+
+static UInt64 LeftShift2(UInt64 x) {
+  x &= 0xffffffff;
+  x = (x ^ (x << 16)) & 0x0000ffff0000ffff;
+  x = (x ^ (x << 8)) & 0x00ff00ff00ff00ff;
+  x = (x ^ (x << 4)) & 0x0f0f0f0f0f0f0f0f;
+  x = (x ^ (x << 2)) & 0x3333333333333333;
+  x = (x ^ (x << 1)) & 0x5555555555555555;
+  return x;
+}
+
+static UInt64 EncodeMorton2(UInt32 x, UInt32 y) {
+  return (LeftShift2(y) << 1) | LeftShift2(x);
+}
+
+static UInt32 Log2Ceil(UInt32 v) {
+  UInt32 r = 0;
+  while ((UInt64(1) << r) < v) {
+    r++;
+  }
+  return r;
+}
+
+/**
+ * @brief 屏幕空间蓝噪声分布误差的 Sobol 采样器 (ZSobol)
+ * 把像素坐标按 Morton 顺序 (Z曲线) 排好, 与样本索引拼成一个全局索引, 整张图片共用一个 Owen 加扰的 Sobol 序列
+ * 全局索引的每一位四进制数字都用由更高位决定的随机排列打乱, 相邻像素拿到的是序列中相邻且互补的样本
+ * 所以误差在屏幕空间呈蓝噪声分布, 低样本数时的观感比白噪声好得多
+ * https://doi.org/10.1111/cgf.14063 Screen-Space Blue-Noise Diffusion of Monte Carlo Sampling Error via Hierarchical Ordering of Pixels
+ *
+ * 样本数会向上取到2的幂次. 超过样本数的样本索引 (比如自适应采样) 按样本数分块, 每块使用不同的加扰
+ */
+class ZSobol final : public Sampler {
+ public:
+  ZSobol(BuildContext* ctx, const ConfigNode& cfg) : Sampler(ctx, cfg) {
+    _seed = cfg.ReadOrDefault("seed", UInt32(0));
+    if (_sampleCount == 0) {
+      throw RadArgumentException("zsobol sampler sample_count should be positive");
+    }
+    _log2SampleCount = Log2Ceil(_sampleCount);
+    UpdateDigitCount();
+  }
+  ~ZSobol() noexcept override = default;
+
+  Unique<Sampler> Clone(UInt32 seed) const override {
+    auto result = std::make_unique<ZSobol>(*this);
+    result->SetSeed(seed);
+    return std::move(result);
+  }
+
+  void SetSeed(UInt32 seed) override {
+    _seed = seed;
+  }
+
+  void SetResolution(const Vector2i& resolution) override {
+    Sampler::SetResolution(resolution);
+    UpdateDigitCount();
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex) override {
+    StartPixelSample(pixel, sampleIndex, 0);
+  }
+
+  void StartPixelSample(const Vector2i& pixel, UInt32 sampleIndex, UInt32 dimension) override {
+    UInt32 spp = UInt32(1) << _log2SampleCount;
+    _block = sampleIndex / spp;
+    _mortonIndex = (EncodeMorton2(UInt32(pixel.x()), UInt32(pixel.y())) << _log2SampleCount) | (sampleIndex % spp);
+    _dimension = dimension;
+  }
+
+  Float Next1D() override {
+    UInt64 index = SampleIndex();
+    UInt64 hash = DimensionHash(_dimension);
+    _dimension += 1;
+    return ToFloat(FastOwenScramble(SobolSample(index, 0), UInt32(hash)));
+  }
+  Vector2 Next2D() override {
+    UInt64 index = SampleIndex();
+    UInt64 hash = DimensionHash(_dimension);
+    _dimension += 2;
+    Float s1 = ToFloat(FastOwenScramble(SobolSample(index, 0), UInt32(hash)));
+    Float s2 = ToFloat(FastOwenScramble(SobolSample(index, 1), UInt32(hash >> 32)));
+    return Vector2(s1, s2);
+  }
+  Vector3 Next3D() override {
+    Vector2 s12 = Next2D();
+    Float s3 = Next1D();
+    return Vector3(s12.x(), s12.y(), s3);
+  }
+
+ private:
+  void UpdateDigitCount() {
+    UInt32 res = std::max(std::max(_resolution.x(), _resolution.y()), 1);
+    //全局索引由 Morton 索引和样本索引拼成, 需要 2*log2(res) + log2(spp) 位
+    if (2 * Log2Ceil(res) + _log2SampleCount > 64) {
+      throw RadArgumentException("zsobol sampler resolution {} with {} spp needs more than 64 index bits", res, _sampleCount);
+    }
+    _base4DigitCount = Log2Ceil(res) + (_log2SampleCount + 1) / 2;
+  }
+
+  UInt64 DimensionHash(UInt32 dimension) const {
+    //加扰只与维度有关, 与像素无关, 整张图片才是同一个序列
+    return MixBits((UInt64(dimension) << 32) ^ UInt64(_seed) ^ (UInt64(_block) * 0x9e3779b97f4a7c15));
+  }
+
+  /**
+   * @brief 逐位打乱 Morton 索引的四进制数字, 每一位的排列由更高位的数字与维度决定
+   */
+  UInt64 SampleIndex() const {
+    static constexpr UInt8 Permutations[24][4] = {
+        {0, 1, 2, 3}, {0, 1, 3, 2}, {0, 2, 1, 3}, {0, 2, 3, 1}, {0, 3, 2, 1}, {0, 3, 1, 2},
+        {1, 0, 2, 3}, {1, 0, 3, 2}, {1, 2, 0, 3}, {1, 2, 3, 0}, {1, 3, 2, 0}, {1, 3, 0, 2},
+        {2, 1, 0, 3}, {2, 1, 3, 0}, {2, 0, 1, 3}, {2, 0, 3, 1}, {2, 3, 0, 1}, {2, 3, 1, 0},
+        {3, 1, 2, 0}, {3, 1, 0, 2}, {3, 2, 1, 0}, {3, 2, 0, 1}, {3, 0, 2, 1}, {3, 0, 1, 2}};
+    UInt64 salt = 0x55555555u * UInt64(_dimension) ^ (UInt64(_block) << 40);
+    UInt64 result = 0;
+    //样本数是2的奇数次幂时, 最低位单独作为一位二进制数字处理
+    bool isOddPower = (_log2SampleCount & 1) != 0;
+    Int32 lastDigit = isOddPower ? 1 : 0;
+    for (Int32 i = Int32(_base4DigitCount) - 1; i >= lastDigit; i--) {
+      Int32 shift = 2 * i - (isOddPower ? 1 : 0);
+      UInt32 digit = UInt32(_mortonIndex >> shift) & 3;
+      UInt64 higherDigits = _mortonIndex >> (shift + 2);
+      UInt32 p = UInt32((MixBits(higherDigits ^ salt) >> 24) % 24);
+      result |= UInt64(Permutations[p][digit]) << shift;
+    }
+    if (isOddPower) {
+      UInt64 digit = _mortonIndex & 1;
+      result |= digit ^ (MixBits((_mortonIndex >> 1) ^ salt) & 1);
+    }
+    return result;
+  }
+
+  static Float ToFloat(UInt32 v) {
+    return std::min(Float(v) * Float(0x1p-32), Math::OneMinusEpsilon<Float>());
+  }
+
+  UInt32 _log2SampleCount{0};
+  UInt32 _base4DigitCount{0};
+  UInt64 _mortonIndex{0};
+  UInt32 _block{0};
+};
+
+class SobolFactory final : public SamplerFactory {
+ public:
+  SobolFactory() : SamplerFactory("sobol") {}
+  ~SobolFactory() noexcept override = default;
+  Unique<Sampler> Create(BuildContext* ctx, const ConfigNode& cfg) const override {
+    return std::make_unique<Sobol>(ctx, cfg);
+  }
+};
+
+Unique<SamplerFactory> _FactoryCreateSobolFunc_() {
+  return std::make_unique<SobolFactory>();
+}
+
+class ZSobolFactory final : public SamplerFactory {
+ public:
+  ZSobolFactory() : SamplerFactory("zsobol") {}
+  ~ZSobolFactory() noexcept override = default;
+  Unique<Sampler> Create(BuildContext* ctx, const ConfigNode& cfg) const override {
+    return std::make_unique<ZSobol>(ctx, cfg);
+  }
+};
+
+Unique<SamplerFactory> _FactoryCreateZSobolFunc_() {
+  return std::make_unique<ZSobolFactory>();
+}
+
+}  // namespace Rad
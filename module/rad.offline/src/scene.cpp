@@ -51,15 +51,57 @@ bool Scene::RayIntersect(const Ray& ray, SurfaceInteraction& si) const {
 }
 
 bool Scene::IsOcclude(const Interaction& ref, const Vector3& p) const {
+  Ray shadowRay;
+  if (!SpawnShadowRay(ref, p, shadowRay)) {
+    return true;
+  }
+  return RayIntersect(shadowRay);
+}
+
+void Scene::RayIntersect(const Ray* rays, HitShapeRecord* records, SurfaceInteraction* sis, UInt8* isHit, UInt32 count) const {
+  _accel->RayIntersectPreliminary(rays, records, isHit, count);
+  for (UInt32 i = 0; i < count; i++) {
+    if (isHit[i]) {
+      sis[i] = records[i].ComputeSurfaceInteraction(rays[i]);
+    } else {
+      sis[i] = {};
+      sis[i].Wi = -rays[i].D;
+    }
+  }
+}
+
+void Scene::RayIntersect(const Ray* rays, UInt8* isHit, UInt32 count) const {
+  _accel->RayIntersect(rays, isHit, count);
+}
+
+void Scene::RayIntersectPacket(UInt32 width, const Int32* valid, const Ray* rays, SurfaceInteraction* sis, UInt8* isHit) const {
+  HitShapeRecord records[16];
+  if (width > 16) {
+    throw RadArgumentException("packet width {} out of max 16", width);
+  }
+  _accel->RayIntersectPreliminaryPacket(width, valid, rays, records, isHit);
+  for (UInt32 i = 0; i < width; i++) {
+    if (!valid[i]) {
+      sis[i] = {};
+    } else if (isHit[i]) {
+      sis[i] = records[i].ComputeSurfaceInteraction(rays[i]);
+    } else {
+      sis[i] = {};
+      sis[i].Wi = -rays[i].D;
+    }
+  }
+}
+
+bool Scene::SpawnShadowRay(const Interaction& ref, const Vector3& p, Ray& ray) {
   Vector3 o = ref.OffsetP(p - ref.P);
   Vector3 d = p - o;
   Float dist = d.norm();
   if (dist < Math::ShadowEpsilon) {
-    return true;
+    return false;
   }
   d /= dist;
-  Ray shadowRay{o, d, 0, dist * (1 - Math::ShadowEpsilon)};
-  return RayIntersect(shadowRay);
+  ray = Ray{o, d, 0, dist * (1 - Math::ShadowEpsilon)};
+  return true;
 }
 
 std::pair<UInt32, Float> Scene::SampleLight(Float xi) const {
@@ -4,6 +4,18 @@
 
 namespace Rad {
 
+void Shape::SubmitBatchToEmbree(RTCDevice device, RTCScene scene, UInt32 id, const Shape* const* shapes, UInt32 count) const {
+  throw RadNotSupportedException("this shape cannot be submitted as a batch");
+}
+
+BoundingBox3 Shape::GetPrimitiveBound(UInt32 index) const {
+  throw RadNotSupportedException("this shape can only be intersected by embree");
+}
+
+bool Shape::IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const {
+  throw RadNotSupportedException("this shape can only be intersected by embree");
+}
+
 DirectionSampleResult Shape::SampleDirection(const Interaction& ref, const Vector2& xi) const {
   PositionSampleResult psr = SamplePosition(xi);
   DirectionSampleResult dsr{psr};
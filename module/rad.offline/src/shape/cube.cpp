@@ -105,7 +105,7 @@ class Cube final : public MeshBase {
     _vertexCount = 24;
     _triangleCount = 12;
 
-    _position = Share<Eigen::Vector3f[]>(new Eigen::Vector3f[_vertexCount]);
+    _position = TriangleModel::AllocPosition(_vertexCount);
     _normal = Share<Eigen::Vector3f[]>(new Eigen::Vector3f[_vertexCount]);
     _uv = Share<Eigen::Vector2f[]>(new Eigen::Vector2f[_vertexCount]);
     _indices = Share<UInt32[]>(new UInt32[_indexCount]);
@@ -119,6 +119,8 @@ class Cube final : public MeshBase {
         _indices[i * 3 + j] = triangles[i][j];
       }
     }
+    CompressAttributes(ctx, false, false);
+    BuildTriangleRecords(ctx, false);
     UpdateDistibution();
   }
   ~Cube() noexcept override = default;
@@ -4,6 +4,9 @@
 #include <rad/offline/build/build_context.h>
 #include <rad/offline/build/factory.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+
 namespace Rad {
 
 /**
@@ -16,31 +19,47 @@ class Mesh final : public MeshBase {
     const ModelAsset* modelAsset = ctx->GetAssetManager().Borrow<ModelAsset>(assetName);
 
     Share<TriangleModel> model;
+    std::string submodelName;
     {
-      std::string submodelName;
       if (cfg.TryRead<std::string>("sub_model", submodelName)) {
         model = modelAsset->GetSubModel(submodelName);
       } else {
         model = modelAsset->FullModel();
       }
     }
+    //默认焊接顶点并按空间顺序重排. --convert-obj 离线处理过的模型直接跳过, 内存映射的数据不会被复制
+    if (cfg.ReadOrDefault("preprocess", true) && !model->IsPreprocessed()) {
+      model = ctx->GetPreprocessedModel(model);
+    }
+    //多个实体引用同一个模型时默认实例化, 所有实例共享物体空间的顶点和同一个 embree 场景
+    _isInstance = cfg.ReadOrDefault("instance", ctx->GetMeshReferenceCount(assetName, submodelName) > 1);
 
-    if (_toWorld.IsIdentity()) {
+    bool isShareModel = _toWorld.IsIdentity() || _isInstance;
+    if (isShareModel) {
       _position = model->GetPosition();
       _normal = model->GetNormal();
     } else {
-      _position = std::shared_ptr<Eigen::Vector3f[]>(new Eigen::Vector3f[model->VertexCount()]);
+      _position = TriangleModel::AllocPosition(model->VertexCount());
       std::shared_ptr<Eigen::Vector3f[]> p = model->GetPosition();
-      for (size_t i = 0; i < model->VertexCount(); i++) {
-        _position[i] = _toWorld.ApplyAffineToWorld(p[i].cast<Float>()).cast<Float32>();
-      }
+      std::shared_ptr<Eigen::Vector3f[]> n = model->GetNormal();
       if (model->HasNormal()) {
-        _normal = std::shared_ptr<Eigen::Vector3f[]>(new Eigen::Vector3f[model->VertexCount()]);
-        std::shared_ptr<Eigen::Vector3f[]> n = model->GetNormal();
-        for (size_t i = 0; i < model->VertexCount(); i++) {
-          _normal[i] = _toWorld.ApplyNormalToWorld(n[i].cast<Float>()).cast<Float32>();
+        if (_isCompressAttribute) {
+          //直接压缩变换后的法线, 不分配世界空间的浮点数组, 构建时的内存峰值更低
+          _packedNormal = PackNormals(n.get(), model->VertexCount(), &_toWorld);
+        } else {
+          _normal = std::shared_ptr<Eigen::Vector3f[]>(new Eigen::Vector3f[model->VertexCount()]);
         }
       }
+      tbb::parallel_for(tbb::blocked_range<size_t>(0, model->VertexCount()), [&](const tbb::blocked_range<size_t>& r) {
+        for (size_t i = r.begin(); i != r.end(); i++) {
+          _position[i] = _toWorld.ApplyAffineToWorld(p[i].cast<Float>()).cast<Float32>();
+        }
+        if (_normal != nullptr) {
+          for (size_t i = r.begin(); i != r.end(); i++) {
+            _normal[i] = _toWorld.ApplyNormalToWorld(n[i].cast<Float>()).cast<Float32>();
+          }
+        }
+      });
     }
     _indices = model->GetIndices();
     _uv = model->GetUV();
@@ -48,6 +67,9 @@ class Mesh final : public MeshBase {
     _indexCount = model->IndexCount();
     _triangleCount = model->TriangleCount();
 
+    //uv 不随变换改变, 总是直接引用模型的数组
+    CompressAttributes(ctx, isShareModel, true);
+    BuildTriangleRecords(ctx, isShareModel);
     UpdateDistibution();
   }
   ~Mesh() noexcept override = default;
@@ -1,44 +1,56 @@
 #include <rad/offline/render/mesh_base.h>
 
+#include <rad/core/logger.h>
 #include <rad/offline/math_ext.h>
 #include <rad/offline/warp.h>
 #include <rad/offline/build/build_context.h>
 
+#include <tbb/blocked_range.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+
 using namespace Rad::Math;
 
 namespace Rad {
 
 MeshBase::MeshBase(BuildContext* ctx, const Matrix4& toWorld, const ConfigNode& cfg) {
   _toWorld = Transform(toWorld);
+  _isCompressAttribute = cfg.ReadOrDefault("compress_attributes", false);
+  _isTriangleRecord = cfg.ReadOrDefault("triangle_records", false);
 }
 
 void MeshBase::SubmitToEmbree(RTCDevice device, RTCScene scene, UInt32 id) const {
+  //直接共享网格自己的顶点与索引, 不再复制一份给 embree
+  //顶点数组都由 TriangleModel::AllocPosition 分配, 末尾有 embree 要求的填充
+  //形状的生命周期比加速结构长, 所以共享的内存在 embree 场景释放前一直有效
   RTCGeometry geo = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_TRIANGLE);
-  auto vertices = (Eigen::Vector3f*)rtcSetNewGeometryBuffer(
+  rtcSetSharedGeometryBuffer(
       geo,
       RTC_BUFFER_TYPE_VERTEX,
       0,
       RTC_FORMAT_FLOAT3,
+      _position.get(),
+      0,
       3 * sizeof(float),
       _vertexCount);
-  auto indices = (UInt32*)rtcSetNewGeometryBuffer(
+  rtcSetSharedGeometryBuffer(
       geo,
       RTC_BUFFER_TYPE_INDEX,
       0,
       RTC_FORMAT_UINT3,
+      _indices.get(),
+      0,
       3 * sizeof(UInt32),
       _triangleCount);
-  std::copy(_position.get(), _position.get() + _vertexCount, vertices);
-  std::copy(_indices.get(), _indices.get() + _indexCount, indices);
   rtcCommitGeometry(geo);
   rtcAttachGeometryByID(scene, geo, id);
   rtcReleaseGeometry(geo);
 }
 
 SurfaceInteraction MeshBase::ComputeInteraction(const Ray& ray, const HitShapeRecord& rec) {
-  UInt32 face = rec.PrimitiveIndex * 3;
-  UInt32 f0 = _indices[face + 0], f1 = _indices[face + 1], f2 = _indices[face + 2];
-  Vector3 p0 = _position[f0].cast<Float>(), p1 = _position[f1].cast<Float>(), p2 = _position[f2].cast<Float>();
+  ShadingTriangle tri;
+  FetchShadingTriangle(rec.PrimitiveIndex, tri);
+  const Vector3 &p0 = tri.P[0], &p1 = tri.P[1], &p2 = tri.P[2];
   Float t = rec.T;
   Vector2 primUV = rec.PrimitiveUV;
   Vector3 bary(1.f - primUV.x() - primUV.y(), primUV.x(), primUV.y());
@@ -48,11 +60,11 @@ SurfaceInteraction MeshBase::ComputeInteraction(const Ray& ray, const HitShapeRe
   si.T = t;
   si.N = (dp0.cross(dp1)).normalized();
   si.Shape = this;
-  if (_uv == nullptr) {
+  if (!tri.HasUV) {
     si.UV = primUV;
     std::tie(si.dPdU, si.dPdV) = CoordinateSystem(si.N);
   } else {
-    Vector2 uv0 = _uv[f0].cast<Float>(), uv1 = _uv[f1].cast<Float>(), uv2 = _uv[f2].cast<Float>();
+    const Vector2 &uv0 = tri.UV[0], &uv1 = tri.UV[1], &uv2 = tri.UV[2];
     si.UV = uv0 * bary.x() + (uv1 * bary.y() + (uv2 * bary.z()));
     Vector2 duv0 = uv1 - uv0, duv1 = uv2 - uv0;
     Float det = duv0.x() * duv1.y() - (duv0.y() * duv1.x());
@@ -65,10 +77,10 @@ SurfaceInteraction MeshBase::ComputeInteraction(const Ray& ray, const HitShapeRe
       si.dPdV = (-duv1.x() * dp0 + (duv0.x() * dp1)) * invDet;
     }
   }
-  if (_normal == nullptr) {
+  if (!tri.HasNormal) {
     si.Shading.N = si.N;
   } else {
-    Vector3 n0 = _normal[f0].cast<Float>(), n1 = _normal[f1].cast<Float>(), n2 = _normal[f2].cast<Float>();
+    const Vector3 &n0 = tri.N[0], &n1 = tri.N[1], &n2 = tri.N[2];
     Vector3 shN = n0 * bary.x() + (n1 * bary.y() + (n2 * bary.z()));
     Float il = Rsqrt(shN.squaredNorm());
     shN *= il;
@@ -85,26 +97,24 @@ PositionSampleResult MeshBase::SamplePosition(const Vector2& xi) const {
   Vector2 txi = xi;
   size_t index;
   std::tie(index, txi.y()) = _dist.SampleReuse(txi.y());
-  UInt32 face = UInt32(index) * 3;
-  UInt32 f0 = _indices[face + 0], f1 = _indices[face + 1], f2 = _indices[face + 2];
-  Vector3 p0 = _position[f0].cast<Float>(), p1 = _position[f1].cast<Float>(), p2 = _position[f2].cast<Float>();
+  ShadingTriangle tri;
+  FetchShadingTriangle(UInt32(index), tri);
+  const Vector3 &p0 = tri.P[0], &p1 = tri.P[1], &p2 = tri.P[2];
   Vector3 e0 = p1 - p0, e1 = p2 - p0;
   Vector2 b = Warp::SquareToUniformTriangle(txi);
   PositionSampleResult psr{};
   psr.P = e0 * b.x() + (e1 * b.y() + p0);
   psr.Pdf = _dist.Normalization();
   psr.IsDelta = false;
-  if (_uv == nullptr) {
+  if (!tri.HasUV) {
     psr.UV = b;
   } else {
-    Vector2 uv0 = _uv[f0].cast<Float>(), uv1 = _uv[f1].cast<Float>(), uv2 = _uv[f2].cast<Float>();
-    psr.UV = uv0 * (1 - b.x() - b.y()) + (uv1 * b.x() + (uv2 * b.y()));
+    psr.UV = tri.UV[0] * (1 - b.x() - b.y()) + (tri.UV[1] * b.x() + (tri.UV[2] * b.y()));
   }
-  if (_normal == nullptr) {
+  if (!tri.HasNormal) {
     psr.N = e0.cross(e1).normalized();
   } else {
-    Vector3 n0 = _normal[f0].cast<Float>(), n1 = _normal[f1].cast<Float>(), n2 = _normal[f2].cast<Float>();
-    psr.N = (n0 * (1 - b.x() - b.y()) + (n1 * b.x() + (n2 * b.y()))).normalized();
+    psr.N = (tri.N[0] * (1 - b.x() - b.y()) + (tri.N[1] * b.x() + (tri.N[2] * b.y()))).normalized();
   }
   return psr;
 }
@@ -113,20 +123,230 @@ Float MeshBase::PdfPosition(const PositionSampleResult& psr) const {
   return _dist.Normalization();
 }
 
+const void* MeshBase::GetInstanceKey() const {
+  //同一个模型的索引数组是共享的, 用它作为几何数据的标识
+  return _isInstance ? _indices.get() : nullptr;
+}
+
+const Transform* MeshBase::GetInstanceTransform() const {
+  return _isInstance ? &_toWorld : nullptr;
+}
+
+BoundingBox3 MeshBase::GetPrimitiveBound(UInt32 index) const {
+  Vector3 p0, p1, p2;
+  GetWorldTriangle(index, p0, p1, p2);
+  BoundingBox3 bound(p0, p0);
+  bound.extend(p1);
+  bound.extend(p2);
+  return bound;
+}
+
+bool MeshBase::IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const {
+  //Moller Trumbore, 用克莱姆法则解上面的方程组
+  Vector3 p0, p1, p2;
+  GetWorldTriangle(index, p0, p1, p2);
+  Vector3 e0 = p1 - p0, e1 = p2 - p0;
+  Vector3 pvec = ray.D.cross(e1);
+  Float det = e0.dot(pvec);
+  if (det == 0) {
+    return false;
+  }
+  Float invDet = Rcp(det);
+  Vector3 tvec = ray.O - p0;
+  Float b1 = tvec.dot(pvec) * invDet;
+  if (b1 < 0 || b1 > 1) {
+    return false;
+  }
+  Vector3 qvec = tvec.cross(e0);
+  Float b2 = ray.D.dot(qvec) * invDet;
+  if (b2 < 0 || b1 + b2 > 1) {
+    return false;
+  }
+  Float t = e1.dot(qvec) * invDet;
+  if (t < ray.MinT || t > ray.MaxT) {
+    return false;
+  }
+  rec.T = t;
+  rec.PrimitiveIndex = index;
+  rec.PrimitiveUV = Vector2(b1, b2);
+  rec.GeometryNormal = e0.cross(e1);
+  return true;
+}
+
+void MeshBase::GetWorldTriangle(UInt32 index, Vector3& p0, Vector3& p1, Vector3& p2) const {
+  UInt32 face = index * 3;
+  p0 = WorldPosition(_indices[face + 0]);
+  p1 = WorldPosition(_indices[face + 1]);
+  p2 = WorldPosition(_indices[face + 2]);
+}
+
+void MeshBase::FetchShadingTriangle(UInt32 index, ShadingTriangle& tri) const {
+  if (_triangleRecords != nullptr) {
+    const MeshTriangleRecord& rec = _triangleRecords[index];
+    tri.HasNormal = (rec.Flags & 1) != 0;
+    tri.HasUV = (rec.Flags & 2) != 0;
+    for (UInt32 k = 0; k < 3; k++) {
+      Vector3 p = rec.Position[k].cast<Float>();
+      tri.P[k] = _isInstance ? _toWorld.ApplyAffineToWorld(p) : p;
+      if (tri.HasNormal) {
+        Vector3 n = DecodeOctahedral(rec.Normal[k]);
+        tri.N[k] = _isInstance ? _toWorld.ApplyNormalToWorld(n) : n;
+      }
+      if (tri.HasUV) {
+        tri.UV[k] = UnpackHalf2(rec.UV[k]);
+      }
+    }
+    return;
+  }
+  tri.HasNormal = HasVertexNormal();
+  tri.HasUV = HasVertexUV();
+  UInt32 face = index * 3;
+  for (UInt32 k = 0; k < 3; k++) {
+    UInt32 v = _indices[face + k];
+    tri.P[k] = WorldPosition(v);
+    if (tri.HasNormal) {
+      tri.N[k] = WorldNormal(v);
+    }
+    if (tri.HasUV) {
+      tri.UV[k] = VertexUV(v);
+    }
+  }
+}
+
+Vector3 MeshBase::WorldPosition(UInt32 index) const {
+  Vector3 p = _position[index].cast<Float>();
+  return _isInstance ? _toWorld.ApplyAffineToWorld(p) : p;
+}
+
+Vector3 MeshBase::WorldNormal(UInt32 index) const {
+  Vector3 n = _packedNormal != nullptr ? DecodeOctahedral(_packedNormal[index]) : _normal[index].cast<Float>();
+  return _isInstance ? _toWorld.ApplyNormalToWorld(n) : n;
+}
+
+Vector2 MeshBase::VertexUV(UInt32 index) const {
+  return _packedUV != nullptr ? UnpackHalf2(_packedUV[index]) : _uv[index].cast<Float>();
+}
+
+Share<UInt32[]> MeshBase::PackNormals(const Eigen::Vector3f* normal, UInt32 count, const Transform* toWorld) {
+  Share<UInt32[]> packed(new UInt32[count]);
+  Float maxError = tbb::parallel_reduce(
+      tbb::blocked_range<UInt32>(0, count), Float(0),
+      [&](const tbb::blocked_range<UInt32>& r, Float error) {
+        for (UInt32 i = r.begin(); i != r.end(); i++) {
+          Vector3 n = normal[i].cast<Float>();
+          if (toWorld != nullptr) {
+            n = toWorld->ApplyNormalToWorld(n);
+          }
+          packed[i] = EncodeOctahedral(n.cast<Float32>());
+          Float c = DecodeOctahedral(packed[i]).dot(n.normalized());
+          error = std::max(error, std::acos(std::clamp(c, Float(-1), Float(1))));
+        }
+        return error;
+      },
+      [](Float a, Float b) { return std::max(a, b); });
+  Logger::Get()->info(
+      "pack {} normals: {} -> {} bytes, max error {:.5f} degrees",
+      count, size_t(count) * sizeof(Eigen::Vector3f), size_t(count) * sizeof(UInt32), Degree(maxError));
+  return packed;
+}
+
+static Share<UInt32[]> PackUVs(const Eigen::Vector2f* uv, UInt32 count) {
+  Share<UInt32[]> packed(new UInt32[count]);
+  Float maxError = tbb::parallel_reduce(
+      tbb::blocked_range<UInt32>(0, count), Float(0),
+      [&](const tbb::blocked_range<UInt32>& r, Float error) {
+        for (UInt32 i = r.begin(); i != r.end(); i++) {
+          packed[i] = PackHalf2(uv[i]);
+          Vector2 d = UnpackHalf2(packed[i]) - uv[i].cast<Float>();
+          error = std::max(error, d.cwiseAbs().maxCoeff());
+        }
+        return error;
+      },
+      [](Float a, Float b) { return std::max(a, b); });
+  Logger::Get()->info(
+      "pack {} uvs: {} -> {} bytes, max error {:.6f}",
+      count, size_t(count) * sizeof(Eigen::Vector2f), size_t(count) * sizeof(UInt32), maxError);
+  return packed;
+}
+
+void MeshBase::CompressAttributes(BuildContext* ctx, bool isSharedNormal, bool isSharedUV) {
+  if (!_isCompressAttribute) {
+    return;
+  }
+  //只有模型自己的数组会被多个网格引用, 需要经过上下文缓存. 网格独有的数组直接压缩, 马上释放浮点数组
+  UInt32 count = _vertexCount;
+  if (_normal != nullptr) {
+    const Eigen::Vector3f* normal = _normal.get();
+    _packedNormal = isSharedNormal
+                        ? ctx->GetPackedAttribute(_normal, [normal, count]() { return PackNormals(normal, count); })
+                        : PackNormals(normal, count);
+    _normal = nullptr;
+  }
+  if (_uv != nullptr) {
+    const Eigen::Vector2f* uv = _uv.get();
+    _packedUV = isSharedUV
+                    ? ctx->GetPackedAttribute(_uv, [uv, count]() { return PackUVs(uv, count); })
+                    : PackUVs(uv, count);
+    _uv = nullptr;
+  }
+}
+
+void MeshBase::BuildTriangleRecords(BuildContext* ctx, bool isSharedPosition) {
+  if (!_isTriangleRecord) {
+    return;
+  }
+  auto build = [this]() {
+    Share<MeshTriangleRecord[]> records(new MeshTriangleRecord[_triangleCount]);
+    UInt32 flags = (HasVertexNormal() ? 1 : 0) | (HasVertexUV() ? 2 : 0);
+    tbb::parallel_for(tbb::blocked_range<UInt32>(0, _triangleCount), [&](const tbb::blocked_range<UInt32>& r) {
+      for (UInt32 i = r.begin(); i != r.end(); i++) {
+        MeshTriangleRecord& rec = records[i];
+        for (UInt32 k = 0; k < 3; k++) {
+          UInt32 v = _indices[i * 3 + k];
+          rec.Position[k] = _position[v];
+          if (_packedNormal != nullptr) {
+            rec.Normal[k] = _packedNormal[v];
+          } else {
+            rec.Normal[k] = _normal != nullptr ? EncodeOctahedral(_normal[v]) : 0;
+          }
+          if (_packedUV != nullptr) {
+            rec.UV[k] = _packedUV[v];
+          } else {
+            rec.UV[k] = _uv != nullptr ? PackHalf2(_uv[v]) : 0;
+          }
+        }
+        rec.Flags = flags;
+      }
+    });
+    Logger::Get()->info(
+        "build {} triangle records: {} bytes",
+        _triangleCount, size_t(_triangleCount) * sizeof(MeshTriangleRecord));
+    return records;
+  };
+  //记录由位置、法线、uv 和索引共同决定, 同一个位置数组的网格来自同一个模型, 也就有相同的记录
+  _triangleRecords = isSharedPosition ? ctx->GetTriangleRecords(_position, build) : build();
+  _normal = nullptr;
+  _uv = nullptr;
+  _packedNormal = nullptr;
+  _packedUV = nullptr;
+}
+
 Float MeshBase::TriangleArea(const Vector3& p0, const Vector3& p1, const Vector3& p2) {
   return (p1 - p0).cross(p2 - p0).norm() * Float(0.5);
 }
 
 void MeshBase::UpdateDistibution() {
-  std::vector<Float> areaData;
-  areaData.reserve(_triangleCount);
-  for (UInt32 i = 0; i < _triangleCount; i++) {
-    Eigen::Vector3f p0 = _position[_indices[i * 3 + 0]];
-    Eigen::Vector3f p1 = _position[_indices[i * 3 + 1]];
-    Eigen::Vector3f p2 = _position[_indices[i * 3 + 2]];
-    areaData.emplace_back(TriangleArea(p0.cast<Float>(), p1.cast<Float>(), p2.cast<Float>()));
-  }
-  _dist = DiscreteDistribution1D(areaData);
+  //每个三角形的面积互不相关, 可以并行计算. 累加仍然是顺序的, 结果与串行时完全一样
+  std::vector<Float> areaData(_triangleCount);
+  tbb::parallel_for(tbb::blocked_range<UInt32>(0, _triangleCount), [&](const tbb::blocked_range<UInt32>& r) {
+    for (UInt32 i = r.begin(); i != r.end(); i++) {
+      Vector3 p0 = WorldPosition(_indices[i * 3 + 0]);
+      Vector3 p1 = WorldPosition(_indices[i * 3 + 1]);
+      Vector3 p2 = WorldPosition(_indices[i * 3 + 2]);
+      areaData[i] = TriangleArea(p0, p1, p2);
+    }
+  });
+  _dist = DiscreteDistribution1D(std::move(areaData));
   _surfaceArea = _dist.Sum();
 }
 
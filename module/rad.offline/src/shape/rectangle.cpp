@@ -63,102 +63,131 @@ static void EmbreeRectangleBoundingBox(const struct RTCBoundsFunctionArguments*
   bounds->upper_z = bbox.max().z();
 }
 
+/**
+ * @brief 把第 i 条光线的候选交点交给 embree 的过滤函数, 通过后写回. 流式与包求交时 N 可能大于1, 数据按 SoA 排列
+ */
+static void EmbreeRectangleCommitHit(
+    const RTCIntersectFunctionNArguments* args, unsigned int i,
+    float t, const Eigen::Vector2f& uv, const Eigen::Vector3f& ng, unsigned int geomID) {
+  unsigned int N = args->N;
+  RTCRayN* ray = RTCRayHitN_RayN(args->rayhit, N);
+  RTCHitN* hit = RTCRayHitN_HitN(args->rayhit, N);
+  alignas(64) char hitBuffer[sizeof(RTCHit) * 16];
+  RTCHitN* potentialHit = (RTCHitN*)hitBuffer;
+  RTCHitN_u(potentialHit, N, i) = uv.x();
+  RTCHitN_v(potentialHit, N, i) = uv.y();
+  RTCHitN_instID(potentialHit, N, i, 0) = args->context->instID[0];
+  RTCHitN_geomID(potentialHit, N, i) = geomID;
+  RTCHitN_primID(potentialHit, N, i) = args->primID;
+  RTCHitN_Ng_x(potentialHit, N, i) = ng.x();
+  RTCHitN_Ng_y(potentialHit, N, i) = ng.y();
+  RTCHitN_Ng_z(potentialHit, N, i) = ng.z();
+  int imask[16]{};
+  imask[i] = -1;
+  const float oldT = RTCRayN_tfar(ray, N, i);
+  RTCRayN_tfar(ray, N, i) = t;
+  RTCFilterFunctionNArguments fargs;
+  fargs.valid = imask;
+  fargs.geometryUserPtr = args->geometryUserPtr;
+  fargs.context = args->context;
+  fargs.ray = (RTCRayN*)args->rayhit;
+  fargs.hit = potentialHit;
+  fargs.N = N;
+  rtcFilterIntersection(args, &fargs);
+  if (imask[i] == -1) {
+    RTCHitN_u(hit, N, i) = RTCHitN_u(potentialHit, N, i);
+    RTCHitN_v(hit, N, i) = RTCHitN_v(potentialHit, N, i);
+    RTCHitN_instID(hit, N, i, 0) = RTCHitN_instID(potentialHit, N, i, 0);
+    RTCHitN_geomID(hit, N, i) = RTCHitN_geomID(potentialHit, N, i);
+    RTCHitN_primID(hit, N, i) = RTCHitN_primID(potentialHit, N, i);
+    RTCHitN_Ng_x(hit, N, i) = RTCHitN_Ng_x(potentialHit, N, i);
+    RTCHitN_Ng_y(hit, N, i) = RTCHitN_Ng_y(potentialHit, N, i);
+    RTCHitN_Ng_z(hit, N, i) = RTCHitN_Ng_z(potentialHit, N, i);
+  } else {
+    RTCRayN_tfar(ray, N, i) = oldT;
+  }
+}
+
+static void EmbreeRectangleCommitOcclusion(
+    const RTCOccludedFunctionNArguments* args, unsigned int i,
+    float t, const Eigen::Vector2f& uv, const Eigen::Vector3f& ng, unsigned int geomID) {
+  unsigned int N = args->N;
+  RTCRayN* ray = args->ray;
+  alignas(64) char hitBuffer[sizeof(RTCHit) * 16];
+  RTCHitN* potentialHit = (RTCHitN*)hitBuffer;
+  RTCHitN_u(potentialHit, N, i) = uv.x();
+  RTCHitN_v(potentialHit, N, i) = uv.y();
+  RTCHitN_instID(potentialHit, N, i, 0) = args->context->instID[0];
+  RTCHitN_geomID(potentialHit, N, i) = geomID;
+  RTCHitN_primID(potentialHit, N, i) = args->primID;
+  RTCHitN_Ng_x(potentialHit, N, i) = ng.x();
+  RTCHitN_Ng_y(potentialHit, N, i) = ng.y();
+  RTCHitN_Ng_z(potentialHit, N, i) = ng.z();
+  int imask[16]{};
+  imask[i] = -1;
+  const float oldT = RTCRayN_tfar(ray, N, i);
+  RTCRayN_tfar(ray, N, i) = t;
+  RTCFilterFunctionNArguments fargs;
+  fargs.valid = imask;
+  fargs.geometryUserPtr = args->geometryUserPtr;
+  fargs.context = args->context;
+  fargs.ray = ray;
+  fargs.hit = potentialHit;
+  fargs.N = N;
+  rtcFilterOcclusion(args, &fargs);
+  if (imask[i] == -1) {
+    RTCRayN_tfar(ray, N, i) = -std::numeric_limits<float>::infinity();
+  } else {
+    RTCRayN_tfar(ray, N, i) = oldT;
+  }
+}
+
 static void EmbreeRectangleIntersect(const RTCIntersectFunctionNArguments* args) {
   int* valid = args->valid;
-  void* ptr = args->geometryUserPtr;
-  RTCRayHit* rayhit = (RTCRayHit*)args->rayhit;
-  RTCRay& ray = rayhit->ray;
-  RTCHit& hit = rayhit->hit;
-  unsigned int primID = args->primID;
-  assert(args->N == 1);
-  const EmbreeRectangle* rects = (const EmbreeRectangle*)ptr;
-  const EmbreeRectangle& rect = rects[primID];
-  if (!valid[0]) {
-    return;
-  }
-  Eigen::Vector3f rayO = Eigen::Vector3f(ray.org_x, ray.org_y, ray.org_z);
-  Eigen::Vector3f rayD = Eigen::Vector3f(ray.dir_x, ray.dir_y, ray.dir_z);
-  auto [isHit, t, uv] = RectangleIntersect(
-      rect,
-      rayO, rayD, ray.tnear, ray.tfar);
-  if (isHit) {
-    RTCHit potentialHit;
-    potentialHit.u = uv.x();
-    potentialHit.v = uv.y();
-    potentialHit.instID[0] = args->context->instID[0];
-    potentialHit.geomID = rect.GeomID;
-    potentialHit.primID = primID;
-    potentialHit.Ng_x = rect.N.x();
-    potentialHit.Ng_y = rect.N.y();
-    potentialHit.Ng_z = rect.N.z();
-    int imask;
-    bool mask = 1;
-    imask = mask ? -1 : 0;
-    const float oldT = ray.tfar;
-    ray.tfar = t;
-    RTCFilterFunctionNArguments fargs;
-    fargs.valid = (int*)&imask;
-    fargs.geometryUserPtr = ptr;
-    fargs.context = args->context;
-    fargs.ray = (RTCRayN*)args->rayhit;
-    fargs.hit = (RTCHitN*)&potentialHit;
-    fargs.N = 1;
-    rtcFilterIntersection(args, &fargs);
-    if (imask == -1) {
-      hit = potentialHit;
-    } else {
-      ray.tfar = oldT;
+  unsigned int N = args->N;
+  RTCRayN* ray = RTCRayHitN_RayN(args->rayhit, N);
+  const EmbreeRectangle* rects = (const EmbreeRectangle*)args->geometryUserPtr;
+  const EmbreeRectangle& rect = rects[args->primID];
+  for (unsigned int i = 0; i < N; i++) {
+    if (!valid[i]) {
+      continue;
     }
+    Eigen::Vector3f rayO = Eigen::Vector3f(RTCRayN_org_x(ray, N, i), RTCRayN_org_y(ray, N, i), RTCRayN_org_z(ray, N, i));
+    Eigen::Vector3f rayD = Eigen::Vector3f(RTCRayN_dir_x(ray, N, i), RTCRayN_dir_y(ray, N, i), RTCRayN_dir_z(ray, N, i));
+    auto [isHit, t, uv] = RectangleIntersect(
+        rect,
+        rayO, rayD, RTCRayN_tnear(ray, N, i), RTCRayN_tfar(ray, N, i));
+    if (!isHit) {
+      continue;
+    }
+    EmbreeRectangleCommitHit(args, i, t, uv, rect.N, rect.GeomID);
   }
 }
 
 static void EmbreeRectangleOccluded(const RTCOccludedFunctionNArguments* args) {
   int* valid = args->valid;
-  void* ptr = args->geometryUserPtr;
-  RTCRay& ray = *(RTCRay*)args->ray;
-  unsigned int primID = args->primID;
-  assert(args->N == 1);
-  const EmbreeRectangle* rects = (const EmbreeRectangle*)ptr;
-  const EmbreeRectangle& rect = rects[primID];
-  if (!valid[0]) {
-    return;
-  }
-  Eigen::Vector3f rayO = Eigen::Vector3f(ray.org_x, ray.org_y, ray.org_z);
-  Eigen::Vector3f rayD = Eigen::Vector3f(ray.dir_x, ray.dir_y, ray.dir_z);
-  auto [isHit, t, uv] = RectangleIntersect(
-      rect,
-      rayO, rayD, ray.tnear, ray.tfar);
-  if (isHit) {
-    RTCHit potentialHit;
-    potentialHit.u = uv.x();
-    potentialHit.v = uv.y();
-    potentialHit.instID[0] = args->context->instID[0];
-    potentialHit.geomID = rect.GeomID;
-    potentialHit.primID = primID;
-    potentialHit.Ng_x = rect.N.x();
-    potentialHit.Ng_y = rect.N.y();
-    potentialHit.Ng_z = rect.N.z();
-    int imask;
-    bool mask = 1;
-    imask = mask ? -1 : 0;
-    const float oldT = ray.tfar;
-    ray.tfar = t;
-    RTCFilterFunctionNArguments fargs;
-    fargs.valid = (int*)&imask;
-    fargs.geometryUserPtr = ptr;
-    fargs.context = args->context;
-    fargs.ray = (RTCRayN*)args->ray;
-    fargs.hit = (RTCHitN*)&potentialHit;
-    fargs.N = 1;
-    rtcFilterOcclusion(args, &fargs);
-    if (imask == -1) {
-      ray.tfar = -std::numeric_limits<float>::infinity();
-    } else {
-      ray.tfar = oldT;
+  unsigned int N = args->N;
+  RTCRayN* ray = args->ray;
+  const EmbreeRectangle* rects = (const EmbreeRectangle*)args->geometryUserPtr;
+  const EmbreeRectangle& rect = rects[args->primID];
+  for (unsigned int i = 0; i < N; i++) {
+    if (!valid[i]) {
+      continue;
+    }
+    Eigen::Vector3f rayO = Eigen::Vector3f(RTCRayN_org_x(ray, N, i), RTCRayN_org_y(ray, N, i), RTCRayN_org_z(ray, N, i));
+    Eigen::Vector3f rayD = Eigen::Vector3f(RTCRayN_dir_x(ray, N, i), RTCRayN_dir_y(ray, N, i), RTCRayN_dir_z(ray, N, i));
+    auto [isHit, t, uv] = RectangleIntersect(
+        rect,
+        rayO, rayD, RTCRayN_tnear(ray, N, i), RTCRayN_tfar(ray, N, i));
+    if (!isHit) {
+      continue;
     }
+    EmbreeRectangleCommitOcclusion(args, i, t, uv, rect.N, rect.GeomID);
   }
 }
 
+static const char NativeRectangleBatchKey = 0;
+
 class Rectangle final : public Shape {
  public:
   Rectangle(BuildContext* ctx, const Matrix4& toWorld, const ConfigNode& cfg) {
@@ -175,7 +204,8 @@ class Rectangle final : public Shape {
     Vector3 normal = _toWorld.ApplyNormalToWorld(Vector3(0, 0, 1)).normalized();
     _frame = Frame(dpdu, dpdv, normal);
     _surfaceArea = dpdu.cross(dpdv).norm();
-    _giveEmbreeData = (EmbreeRectangle*)AlignedMalloc(32, sizeof(EmbreeRectangle));
+    _isNative = cfg.ReadOrDefault("native", false);
+    _giveEmbreeData = _isNative ? nullptr : (EmbreeRectangle*)AlignedMalloc(32, sizeof(EmbreeRectangle));
   }
   ~Rectangle() noexcept override {
     if (_giveEmbreeData != nullptr) {
@@ -185,13 +215,19 @@ class Rectangle final : public Shape {
   }
 
   void SubmitToEmbree(RTCDevice device, RTCScene scene, UInt32 id) const override {
+    if (_isNative) {
+      const Shape* self = this;
+      SubmitBatchToEmbree(device, scene, id, &self, 1);
+      return;
+    }
     RTCGeometry geom = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
     EmbreeRectangle* rect = _giveEmbreeData;
     rect->ToWorld = _toWorld.ToWorld.cast<Eigen::Matrix4f::Scalar>();
     rect->ToObject = _toWorld.ToLocal.cast<Eigen::Matrix4f::Scalar>();
     rect->N = _frame.N.cast<Eigen::Matrix4f::Scalar>();
     rect->Geometry = geom;
-    rect->GeomID = rtcAttachGeometry(scene, geom);
+    rect->GeomID = id;
+    rtcAttachGeometryByID(scene, geom, id);
     rtcSetGeometryUserPrimitiveCount(geom, 1);
     rtcSetGeometryUserData(geom, rect);
     rtcSetGeometryBoundsFunction(geom, EmbreeRectangleBoundingBox, nullptr);
@@ -201,6 +237,61 @@ class Rectangle final : public Shape {
     rtcReleaseGeometry(geom);
   }
 
+  const void* GetEmbreeBatchKey() const override {
+    return _isNative ? &NativeRectangleBatchKey : nullptr;
+  }
+
+  /**
+   * @brief 每个矩形是 embree 原生四边形图元, 四个顶点直接变换到世界空间
+   * 顶点顺序让 embree 返回的 uv 就是矩形的参数坐标, 不需要再变换到本地空间
+   */
+  void SubmitBatchToEmbree(RTCDevice device, RTCScene scene, UInt32 id, const Shape* const* shapes, UInt32 count) const override {
+    RTCGeometry geom = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_QUAD);
+    Eigen::Vector3f* vertices = (Eigen::Vector3f*)rtcSetNewGeometryBuffer(
+        geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT3, sizeof(Eigen::Vector3f), size_t(count) * 4);
+    UInt32* indices = (UInt32*)rtcSetNewGeometryBuffer(
+        geom, RTC_BUFFER_TYPE_INDEX, 0, RTC_FORMAT_UINT4, sizeof(UInt32) * 4, count);
+    const Vector2 corners[4] = {Vector2(-1, -1), Vector2(1, -1), Vector2(1, 1), Vector2(-1, 1)};
+    for (UInt32 i = 0; i < count; i++) {
+      const Rectangle* rect = static_cast<const Rectangle*>(shapes[i]);
+      for (UInt32 j = 0; j < 4; j++) {
+        Vector3 p = rect->_toWorld.ApplyAffineToWorld(Vector3(corners[j].x(), corners[j].y(), 0));
+        vertices[i * 4 + j] = p.cast<Float32>();
+        indices[i * 4 + j] = i * 4 + j;
+      }
+    }
+    rtcCommitGeometry(geom);
+    rtcAttachGeometryByID(scene, geom, id);
+    rtcReleaseGeometry(geom);
+  }
+
+  BoundingBox3 GetPrimitiveBound(UInt32 index) const override {
+    BoundingBox3 bound;
+    bound.extend(_toWorld.ApplyAffineToWorld(Vector3(-1, -1, 0)));
+    bound.extend(_toWorld.ApplyAffineToWorld(Vector3(1, -1, 0)));
+    bound.extend(_toWorld.ApplyAffineToWorld(Vector3(1, 1, 0)));
+    bound.extend(_toWorld.ApplyAffineToWorld(Vector3(-1, 1, 0)));
+    return bound;
+  }
+
+  bool IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const override {
+    //与回调里的求交相同, 只是直接使用形状自己的变换
+    Vector3 rayO = _toWorld.ApplyAffineToLocal(ray.O);
+    Vector3 rayD = _toWorld.ApplyLinearToLocal(ray.D);
+    Float t = -rayO.z() / rayD.z();
+    Vector3 local = rayD * t + rayO;
+    bool isHit = t >= ray.MinT && t <= ray.MaxT && std::abs(local.x()) <= 1 && std::abs(local.y()) <= 1;
+    if (!isHit) {
+      return false;
+    }
+    Vector2 uv(local.x(), local.y());
+    rec.T = t;
+    rec.PrimitiveIndex = index;
+    rec.PrimitiveUV = _isNative ? Vector2(uv * Float(0.5) + Vector2::Constant(Float(0.5))) : uv;
+    rec.GeometryNormal = _frame.N;
+    return true;
+  }
+
   SurfaceInteraction ComputeInteraction(const Ray& ray, const HitShapeRecord& rec) override {
     SurfaceInteraction si{};
     si.T = rec.T;
@@ -211,7 +302,11 @@ class Rectangle final : public Shape {
     si.Shading.N = _frame.N;
     si.dPdU = _frame.S;
     si.dPdV = _frame.T;
-    si.UV = rec.PrimitiveUV * Float(0.5) + Vector2::Constant(Float(0.5));
+    if (_isNative) {
+      si.UV = rec.PrimitiveUV;
+    } else {
+      si.UV = rec.PrimitiveUV * Float(0.5) + Vector2::Constant(Float(0.5));
+    }
     si.dNdU = Vector3::Zero();
     si.dNdV = Vector3::Zero();
     si.Shape = this;
@@ -253,6 +348,7 @@ class Rectangle final : public Shape {
   Transform _toWorld;
   Frame _frame;
   EmbreeRectangle* _giveEmbreeData;
+  bool _isNative;
 };
 
 class RectangleFactory final : public ShapeFactory {
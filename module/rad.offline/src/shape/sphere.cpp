@@ -68,106 +68,136 @@ static void EmbreeSphereBoundingBox(const struct RTCBoundsFunctionArguments* arg
   bounds_o->upper_z = max.z();
 }
 
+/**
+ * @brief 把第 i 条光线的候选交点交给 embree 的过滤函数, 通过后写回. 流式与包求交时 N 可能大于1, 数据按 SoA 排列
+ */
+static void EmbreeSphereCommitHit(
+    const RTCIntersectFunctionNArguments* args, unsigned int i,
+    float t, const Eigen::Vector2f& uv, const Eigen::Vector3f& ng, unsigned int geomID) {
+  unsigned int N = args->N;
+  RTCRayN* ray = RTCRayHitN_RayN(args->rayhit, N);
+  RTCHitN* hit = RTCRayHitN_HitN(args->rayhit, N);
+  alignas(64) char hitBuffer[sizeof(RTCHit) * 16];
+  RTCHitN* potentialHit = (RTCHitN*)hitBuffer;
+  RTCHitN_u(potentialHit, N, i) = uv.x();
+  RTCHitN_v(potentialHit, N, i) = uv.y();
+  RTCHitN_instID(potentialHit, N, i, 0) = args->context->instID[0];
+  RTCHitN_geomID(potentialHit, N, i) = geomID;
+  RTCHitN_primID(potentialHit, N, i) = args->primID;
+  RTCHitN_Ng_x(potentialHit, N, i) = ng.x();
+  RTCHitN_Ng_y(potentialHit, N, i) = ng.y();
+  RTCHitN_Ng_z(potentialHit, N, i) = ng.z();
+  int imask[16]{};
+  imask[i] = -1;
+  const float oldT = RTCRayN_tfar(ray, N, i);
+  RTCRayN_tfar(ray, N, i) = t;
+  RTCFilterFunctionNArguments fargs;
+  fargs.valid = imask;
+  fargs.geometryUserPtr = args->geometryUserPtr;
+  fargs.context = args->context;
+  fargs.ray = (RTCRayN*)args->rayhit;
+  fargs.hit = potentialHit;
+  fargs.N = N;
+  rtcFilterIntersection(args, &fargs);
+  if (imask[i] == -1) {
+    RTCHitN_u(hit, N, i) = RTCHitN_u(potentialHit, N, i);
+    RTCHitN_v(hit, N, i) = RTCHitN_v(potentialHit, N, i);
+    RTCHitN_instID(hit, N, i, 0) = RTCHitN_instID(potentialHit, N, i, 0);
+    RTCHitN_geomID(hit, N, i) = RTCHitN_geomID(potentialHit, N, i);
+    RTCHitN_primID(hit, N, i) = RTCHitN_primID(potentialHit, N, i);
+    RTCHitN_Ng_x(hit, N, i) = RTCHitN_Ng_x(potentialHit, N, i);
+    RTCHitN_Ng_y(hit, N, i) = RTCHitN_Ng_y(potentialHit, N, i);
+    RTCHitN_Ng_z(hit, N, i) = RTCHitN_Ng_z(potentialHit, N, i);
+  } else {
+    RTCRayN_tfar(ray, N, i) = oldT;
+  }
+}
+
+static void EmbreeSphereCommitOcclusion(
+    const RTCOccludedFunctionNArguments* args, unsigned int i,
+    float t, const Eigen::Vector2f& uv, const Eigen::Vector3f& ng, unsigned int geomID) {
+  unsigned int N = args->N;
+  RTCRayN* ray = args->ray;
+  alignas(64) char hitBuffer[sizeof(RTCHit) * 16];
+  RTCHitN* potentialHit = (RTCHitN*)hitBuffer;
+  RTCHitN_u(potentialHit, N, i) = uv.x();
+  RTCHitN_v(potentialHit, N, i) = uv.y();
+  RTCHitN_instID(potentialHit, N, i, 0) = args->context->instID[0];
+  RTCHitN_geomID(potentialHit, N, i) = geomID;
+  RTCHitN_primID(potentialHit, N, i) = args->primID;
+  RTCHitN_Ng_x(potentialHit, N, i) = ng.x();
+  RTCHitN_Ng_y(potentialHit, N, i) = ng.y();
+  RTCHitN_Ng_z(potentialHit, N, i) = ng.z();
+  int imask[16]{};
+  imask[i] = -1;
+  const float oldT = RTCRayN_tfar(ray, N, i);
+  RTCRayN_tfar(ray, N, i) = t;
+  RTCFilterFunctionNArguments fargs;
+  fargs.valid = imask;
+  fargs.geometryUserPtr = args->geometryUserPtr;
+  fargs.context = args->context;
+  fargs.ray = ray;
+  fargs.hit = potentialHit;
+  fargs.N = N;
+  rtcFilterOcclusion(args, &fargs);
+  if (imask[i] == -1) {
+    RTCRayN_tfar(ray, N, i) = -std::numeric_limits<float>::infinity();
+  } else {
+    RTCRayN_tfar(ray, N, i) = oldT;
+  }
+}
+
 static void EmbreeSphereIntersect(const RTCIntersectFunctionNArguments* args) {
   int* valid = args->valid;
-  void* ptr = args->geometryUserPtr;
-  RTCRayHit* rayhit = (RTCRayHit*)args->rayhit;
-  RTCRay& ray = rayhit->ray;
-  RTCHit& hit = rayhit->hit;
-  unsigned int primID = args->primID;
-  assert(args->N == 1);
-  const EmbreeSphere* spheres = (const EmbreeSphere*)ptr;
-  const EmbreeSphere& sphere = spheres[primID];
-  if (!valid[0]) {
-    return;
-  }
-  Eigen::Vector3f rayO = Eigen::Vector3f(ray.org_x, ray.org_y, ray.org_z);
-  Eigen::Vector3f rayD = Eigen::Vector3f(ray.dir_x, ray.dir_y, ray.dir_z);
-  auto [isHit, t] = SphereIntersect(
-      rayO, rayD,
-      sphere.Center, sphere.Radius,
-      ray.tnear, ray.tfar);
-  if (isHit) {
-    RTCHit potentialHit;
-    potentialHit.u = 0.0f;
-    potentialHit.v = 0.0f;
-    potentialHit.instID[0] = args->context->instID[0];
-    potentialHit.geomID = sphere.GeomID;
-    potentialHit.primID = primID;
-    Eigen::Vector3f n = ((rayD * t + rayO) - sphere.Center).normalized();
-    potentialHit.Ng_x = n.x();
-    potentialHit.Ng_y = n.y();
-    potentialHit.Ng_z = n.z();
-    int imask;
-    bool mask = 1;
-    imask = mask ? -1 : 0;
-    const float oldT = ray.tfar;
-    ray.tfar = t;
-    RTCFilterFunctionNArguments fargs;
-    fargs.valid = (int*)&imask;
-    fargs.geometryUserPtr = ptr;
-    fargs.context = args->context;
-    fargs.ray = (RTCRayN*)args->rayhit;
-    fargs.hit = (RTCHitN*)&potentialHit;
-    fargs.N = 1;
-    rtcFilterIntersection(args, &fargs);
-    if (imask == -1) {
-      hit = potentialHit;
-    } else {
-      ray.tfar = oldT;
+  unsigned int N = args->N;
+  RTCRayN* ray = RTCRayHitN_RayN(args->rayhit, N);
+  const EmbreeSphere* spheres = (const EmbreeSphere*)args->geometryUserPtr;
+  const EmbreeSphere& sphere = spheres[args->primID];
+  for (unsigned int i = 0; i < N; i++) {
+    if (!valid[i]) {
+      continue;
     }
+    Eigen::Vector3f rayO = Eigen::Vector3f(RTCRayN_org_x(ray, N, i), RTCRayN_org_y(ray, N, i), RTCRayN_org_z(ray, N, i));
+    Eigen::Vector3f rayD = Eigen::Vector3f(RTCRayN_dir_x(ray, N, i), RTCRayN_dir_y(ray, N, i), RTCRayN_dir_z(ray, N, i));
+    auto [isHit, t] = SphereIntersect(
+        rayO, rayD,
+        sphere.Center, sphere.Radius,
+        RTCRayN_tnear(ray, N, i), RTCRayN_tfar(ray, N, i));
+    if (!isHit) {
+      continue;
+    }
+    Eigen::Vector3f n = ((rayD * t + rayO) - sphere.Center).normalized();
+    EmbreeSphereCommitHit(args, i, t, Eigen::Vector2f(0.0f, 0.0f), n, sphere.GeomID);
   }
 }
 
 static void EmbreeSphereOccluded(const RTCOccludedFunctionNArguments* args) {
   int* valid = args->valid;
-  void* ptr = args->geometryUserPtr;
-  RTCRay& ray = *(RTCRay*)args->ray;
-  unsigned int primID = args->primID;
-  assert(args->N == 1);
-  const EmbreeSphere* spheres = (const EmbreeSphere*)ptr;
-  const EmbreeSphere& sphere = spheres[primID];
-  if (!valid[0]) {
-    return;
-  }
-  Eigen::Vector3f rayO = Eigen::Vector3f(ray.org_x, ray.org_y, ray.org_z);
-  Eigen::Vector3f rayD = Eigen::Vector3f(ray.dir_x, ray.dir_y, ray.dir_z);
-  auto [isHit, t] = SphereIntersect(
-      rayO, rayD,
-      sphere.Center, sphere.Radius,
-      ray.tnear, ray.tfar);
-  if (isHit) {
-    RTCHit potentialHit;
-    potentialHit.u = 0.0f;
-    potentialHit.v = 0.0f;
-    potentialHit.instID[0] = args->context->instID[0];
-    potentialHit.geomID = sphere.GeomID;
-    potentialHit.primID = primID;
-    Eigen::Vector3f n = ((rayD * t + rayO) - sphere.Center).normalized();
-    potentialHit.Ng_x = n.x();
-    potentialHit.Ng_y = n.y();
-    potentialHit.Ng_z = n.z();
-    int imask;
-    bool mask = 1;
-    imask = mask ? -1 : 0;
-    const float oldT = ray.tfar;
-    ray.tfar = t;
-    RTCFilterFunctionNArguments fargs;
-    fargs.valid = (int*)&imask;
-    fargs.geometryUserPtr = ptr;
-    fargs.context = args->context;
-    fargs.ray = (RTCRayN*)args->ray;
-    fargs.hit = (RTCHitN*)&potentialHit;
-    fargs.N = 1;
-    rtcFilterOcclusion(args, &fargs);
-    if (imask == -1) {
-      ray.tfar = -std::numeric_limits<float>::infinity();
-    } else {
-      ray.tfar = oldT;
+  unsigned int N = args->N;
+  RTCRayN* ray = args->ray;
+  const EmbreeSphere* spheres = (const EmbreeSphere*)args->geometryUserPtr;
+  const EmbreeSphere& sphere = spheres[args->primID];
+  for (unsigned int i = 0; i < N; i++) {
+    if (!valid[i]) {
+      continue;
+    }
+    Eigen::Vector3f rayO = Eigen::Vector3f(RTCRayN_org_x(ray, N, i), RTCRayN_org_y(ray, N, i), RTCRayN_org_z(ray, N, i));
+    Eigen::Vector3f rayD = Eigen::Vector3f(RTCRayN_dir_x(ray, N, i), RTCRayN_dir_y(ray, N, i), RTCRayN_dir_z(ray, N, i));
+    auto [isHit, t] = SphereIntersect(
+        rayO, rayD,
+        sphere.Center, sphere.Radius,
+        RTCRayN_tnear(ray, N, i), RTCRayN_tfar(ray, N, i));
+    if (!isHit) {
+      continue;
     }
+    Eigen::Vector3f n = ((rayD * t + rayO) - sphere.Center).normalized();
+    EmbreeSphereCommitOcclusion(args, i, t, Eigen::Vector2f(0.0f, 0.0f), n, sphere.GeomID);
   }
 }
 
+//所有使用原生图元的球体合并成同一个几何, 只需要一个唯一的地址作为标识
+static const char NativeSphereBatchKey = 0;
+
 class Sphere final : public Shape {
  public:
   Sphere(BuildContext* ctx, const Matrix4& toWorld, const ConfigNode& cfg) {
@@ -186,7 +216,8 @@ class Sphere final : public Shape {
     auto trans = (t * rotation * s) * affine;
     _toWorld = Transform(trans.matrix());
     _surfaceArea = 4 * PI * Sqr(_radius);
-    _giveEmbreeData = (EmbreeSphere*)AlignedMalloc(16, sizeof(EmbreeSphere));
+    _isNative = cfg.ReadOrDefault("native", false);
+    _giveEmbreeData = _isNative ? nullptr : (EmbreeSphere*)AlignedMalloc(16, sizeof(EmbreeSphere));
   }
 
   ~Sphere() noexcept override {
@@ -197,12 +228,18 @@ class Sphere final : public Shape {
   }
 
   void SubmitToEmbree(RTCDevice device, RTCScene scene, UInt32 id) const override {
+    if (_isNative) {
+      const Shape* self = this;
+      SubmitBatchToEmbree(device, scene, id, &self, 1);
+      return;
+    }
     RTCGeometry geom = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_USER);
     EmbreeSphere* sphere = _giveEmbreeData;
     sphere->Center = _center.cast<Float32>();
     sphere->Radius = Float32(_radius);
     sphere->Geometry = geom;
-    sphere->GeomID = rtcAttachGeometry(scene, geom);
+    sphere->GeomID = id;
+    rtcAttachGeometryByID(scene, geom, id);
     rtcSetGeometryUserPrimitiveCount(geom, 1);
     rtcSetGeometryUserData(geom, sphere);
     rtcSetGeometryBoundsFunction(geom, EmbreeSphereBoundingBox, nullptr);
@@ -212,10 +249,53 @@ class Sphere final : public Shape {
     rtcReleaseGeometry(geom);
   }
 
+  const void* GetEmbreeBatchKey() const override {
+    return _isNative ? &NativeSphereBatchKey : nullptr;
+  }
+
+  /**
+   * @brief 用 embree 原生的球体图元代替用户几何的回调, 每个球是顶点缓冲里的一个 (x, y, z, r)
+   * embree 可以对原生图元做 SIMD 求交, 也不需要每次都调用一遍过滤函数
+   */
+  void SubmitBatchToEmbree(RTCDevice device, RTCScene scene, UInt32 id, const Shape* const* shapes, UInt32 count) const override {
+    RTCGeometry geom = rtcNewGeometry(device, RTC_GEOMETRY_TYPE_SPHERE_POINT);
+    Eigen::Vector4f* points = (Eigen::Vector4f*)rtcSetNewGeometryBuffer(
+        geom, RTC_BUFFER_TYPE_VERTEX, 0, RTC_FORMAT_FLOAT4, sizeof(Eigen::Vector4f), count);
+    for (UInt32 i = 0; i < count; i++) {
+      const Sphere* sphere = static_cast<const Sphere*>(shapes[i]);
+      Eigen::Vector3f center = sphere->_center.cast<Float32>();
+      points[i] = Eigen::Vector4f(center.x(), center.y(), center.z(), Float32(sphere->_radius));
+    }
+    rtcCommitGeometry(geom);
+    rtcAttachGeometryByID(scene, geom, id);
+    rtcReleaseGeometry(geom);
+  }
+
+  BoundingBox3 GetPrimitiveBound(UInt32 index) const override {
+    Vector3 r = Vector3::Constant(_radius);
+    return BoundingBox3(_center - r, _center + r);
+  }
+
+  bool IntersectPrimitive(const Ray& ray, UInt32 index, HitShapeRecord& rec) const override {
+    Eigen::Vector3f rayO = ray.O.cast<Float32>();
+    Eigen::Vector3f rayD = ray.D.cast<Float32>();
+    Eigen::Vector3f center = _center.cast<Float32>();
+    auto [isHit, t] = SphereIntersect(rayO, rayD, center, Float32(_radius), Float32(ray.MinT), Float32(ray.MaxT));
+    if (!isHit) {
+      return false;
+    }
+    rec.T = t;
+    rec.PrimitiveIndex = index;
+    rec.PrimitiveUV = Vector2::Zero();
+    rec.GeometryNormal = ((rayD * t + rayO) - center).normalized().cast<Float>();
+    return true;
+  }
+
   SurfaceInteraction ComputeInteraction(const Ray& ray, const HitShapeRecord& rec) override {
     SurfaceInteraction si{};
     si.T = rec.T;
-    si.Shading.N = rec.GeometryNormal;
+    //embree 原生球体返回的几何法线没有归一化
+    si.Shading.N = rec.GeometryNormal.normalized();
     si.P = Fmadd(si.Shading.N, Vector3::Constant(_radius), _center);
     {
       Vector3 local = _toWorld.ApplyAffineToLocal(si.P);
@@ -332,6 +412,7 @@ class Sphere final : public Shape {
   Float _radius;
   Transform _toWorld;
   EmbreeSphere* _giveEmbreeData;
+  bool _isNative;
 };
 
 class SphereFactory final : public ShapeFactory {